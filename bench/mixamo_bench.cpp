@@ -0,0 +1,337 @@
+// GPU-free microbenchmarks of the core library: bone pose math, skeleton
+// evaluation, asset loading and capture encoding. Inputs are fixed or come
+// from a seeded generator, so runs on the same build do the same work and
+// their JSON results can be compared directly.
+//
+//     mixamo_bench [--assets DIR] [--repetitions N] [--filter TEXT] [--json PATH]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "assets.h"
+#include "frame_memory.h"
+#include "memory_stats.h"
+#include "pixel_convert.h"
+#include "pose_evaluator.h"
+#include "skeleton.h"
+#include "utils.h"
+
+namespace
+{
+
+using bench_clock = std::chrono::steady_clock;
+
+struct benchmark
+{
+    std::string name;
+    // operations per repetition
+    std::size_t operations;
+    // runs `operations` operations and returns a checksum of their results
+    std::function<double()> run;
+};
+
+struct result
+{
+    std::string name;
+    std::size_t operations = 0;
+    std::vector<double> ns_per_op;
+    double allocations_per_op = 0.;
+    double checksum = 0.;
+
+    double min() const { return *std::min_element(ns_per_op.begin(), ns_per_op.end()); }
+
+    double median() const
+    {
+        auto sorted = ns_per_op;
+        std::sort(sorted.begin(), sorted.end());
+        std::size_t n = sorted.size();
+        return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2.;
+    }
+
+    double mean() const
+    {
+        double sum = 0.;
+        for (double ns : ns_per_op)
+            sum += ns;
+        return sum / ns_per_op.size();
+    }
+};
+
+// one warm-up run, then `repetitions` timed ones; the allocations are those of the timed runs
+result measure(benchmark const & bench, int repetitions)
+{
+    result r;
+    r.name = bench.name;
+    r.operations = bench.operations;
+    r.checksum = bench.run();
+    r.ns_per_op.reserve(repetitions);
+
+    heap_counters before = heap_usage();
+    for (int i = 0; i < repetitions; ++i)
+    {
+        auto start = bench_clock::now();
+        double checksum = bench.run();
+        auto elapsed = std::chrono::duration<double, std::nano>(bench_clock::now() - start).count();
+
+        r.ns_per_op.push_back(elapsed / bench.operations);
+        if (checksum != r.checksum)
+            std::cerr << bench.name << ": checksum changed between runs\n";
+    }
+    r.allocations_per_op = double(heap_usage().allocations - before.allocations) / (double(repetitions) * bench.operations);
+    return r;
+}
+
+bone_pose random_pose(std::mt19937 & random)
+{
+    std::uniform_real_distribution<float> unit(-1.f, 1.f);
+    bone_pose pose;
+    pose.rotation = glm::normalize(glm::quat(unit(random), unit(random), unit(random), unit(random)));
+    pose.scale = 1.f + 0.1f * unit(random);
+    pose.translation = glm::vec3(unit(random), unit(random), unit(random));
+    return pose;
+}
+
+double pose_checksum(bone_pose const & pose)
+{
+    return pose.rotation.w + pose.rotation.x + pose.rotation.y + pose.rotation.z + pose.scale
+        + pose.translation.x + pose.translation.y + pose.translation.z;
+}
+
+// A frame as the renderer reads it back: the clear color with a shaded figure in
+// the middle and a little noise, so it compresses about like a real capture
+std::vector<char> synthetic_frame(int width, int height, std::uint32_t seed)
+{
+    std::mt19937 random(seed);
+    std::vector<char> pixels(std::size_t(width) * height * 4);
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+        {
+            float u = (x - width * 0.5f) / (width * 0.15f);
+            float v = (y - height * 0.5f) / (height * 0.4f);
+            float r2 = u * u + v * v;
+
+            auto pixel = reinterpret_cast<unsigned char *>(pixels.data()) + (std::size_t(y) * width + x) * 4;
+            if (r2 > 1.f)
+            {
+                pixel[0] = 204;
+                pixel[1] = 204;
+                pixel[2] = 255;
+                pixel[3] = 0;
+                continue;
+            }
+
+            float shade = 0.2f + 0.8f * std::sqrt(1.f - r2);
+            int noise = int(random() % 5) - 2;
+            pixel[0] = (unsigned char) std::clamp(int(255.f * shade * 0.9f) + noise, 0, 255);
+            pixel[1] = (unsigned char) std::clamp(int(255.f * shade * 0.5f) + noise, 0, 255);
+            pixel[2] = (unsigned char) std::clamp(int(255.f * shade * 0.4f) + noise, 0, 255);
+            pixel[3] = 255;
+        }
+    return pixels;
+}
+
+void write_json(std::ostream & out, std::string const & assets, int repetitions, std::vector<result> const & results)
+{
+    out << std::setprecision(6);
+    out << "{\n  \"compiler\": \"" << __VERSION__ << "\",\n";
+#ifdef NDEBUG
+    out << "  \"optimized\": true,\n";
+#else
+    out << "  \"optimized\": false,\n";
+#endif
+    out << "  \"assets\": \"" << assets << "\",\n";
+    out << "  \"repetitions\": " << repetitions << ",\n";
+    out << "  \"benchmarks\": [\n";
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+        auto const & r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"operations\": " << r.operations
+            << ", \"ns_per_op\": {\"min\": " << r.min() << ", \"median\": " << r.median() << ", \"mean\": " << r.mean()
+            << "}, \"allocations_per_op\": " << r.allocations_per_op << ", \"checksum\": " << r.checksum << '}'
+            << (i + 1 < results.size() ? "," : "") << '\n';
+    }
+    out << "  ]\n}\n";
+}
+
+}
+
+int main(int argc, char ** argv) try
+{
+    std::string assets = PRACTICE_SOURCE_DIRECTORY;
+    int repetitions = 5;
+    std::string filter;
+    std::string json_path;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string_view option = argv[i];
+        if (option == "--assets" && i + 1 < argc)
+            assets = argv[++i];
+        else if (option == "--repetitions" && i + 1 < argc)
+            repetitions = std::max(1, std::atoi(argv[++i]));
+        else if (option == "--filter" && i + 1 < argc)
+            filter = argv[++i];
+        else if (option == "--json" && i + 1 < argc)
+            json_path = argv[++i];
+        else
+        {
+            std::cerr << "Usage: mixamo_bench [--assets DIR] [--repetitions N] [--filter TEXT] [--json PATH]\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    character_assets character = load_character(assets);
+
+    std::mt19937 random(20220105);
+    std::vector<bone_pose> lhs(4096);
+    std::vector<bone_pose> rhs(4096);
+    for (std::size_t i = 0; i < lhs.size(); ++i)
+    {
+        lhs[i] = random_pose(random);
+        rhs[i] = random_pose(random);
+    }
+
+    // a fixed walk over the animation: every key pose, at blend factors that are not special cases,
+    // posed the way the renderer's animation jobs pose it, and edits of the last depth-1 bone's local pose
+    int const frames_per_pose = 37;
+    pose_evaluator evaluator(character.bones);
+    std::uint32_t edited_bone = character.bone_levels.size() > 2 ? character.bone_levels[2] - 1 : 0;
+    // that bone's subtree playing the clip half a cycle ahead, at three quarters weight
+    std::vector<animation_layer> layers = {{&character.poses, 0.5f * character_pose_count, evaluator.subtree_mask(edited_bone, 0.75f)}};
+
+    int const frame_width = 512;
+    int const frame_height = 512;
+    auto frame = synthetic_frame(frame_width, frame_height, 7);
+    auto rgba = convert_region(frame, frame_width, 0, 0, frame_width, frame_height, false, 4);
+    auto rgb = convert_region(frame, frame_width, 0, 0, frame_width, frame_height, false, 3);
+
+    std::vector<benchmark> benchmarks = {
+        {"bone_pose_multiply", lhs.size() * 64, [&] {
+            double checksum = 0.;
+            for (int round = 0; round < 64; ++round)
+                for (std::size_t i = 0; i < lhs.size(); ++i)
+                    checksum += pose_checksum(lhs[i] * rhs[(i + round) % rhs.size()]);
+            return checksum;
+        }},
+        {"bone_pose_transform_point", lhs.size() * 64, [&] {
+            double checksum = 0.;
+            for (int round = 0; round < 64; ++round)
+                for (std::size_t i = 0; i < lhs.size(); ++i)
+                {
+                    glm::vec3 p = lhs[i] * rhs[(i + round) % rhs.size()].translation;
+                    checksum += p.x + p.y + p.z;
+                }
+            return checksum;
+        }},
+        {"pose_evaluator_key_poses", std::size_t(character_pose_count) * frames_per_pose, [&] {
+            double checksum = 0.;
+            for (int n = 0; n < character_pose_count; ++n)
+                for (int f = 0; f < frames_per_pose; ++f)
+                {
+                    evaluator.set_key_poses(character.poses, n, float(f) / frames_per_pose);
+                    checksum += double(evaluator.evaluate()) + pose_checksum(evaluator.palette().back());
+                }
+            return checksum;
+        }},
+        {"pose_evaluator_one_bone", std::size_t(character_pose_count) * frames_per_pose, [&] {
+            double checksum = 0.;
+            for (int n = 0; n < character_pose_count; ++n)
+                for (int f = 0; f < frames_per_pose; ++f)
+                {
+                    evaluator.set_local_pose(edited_bone, character.poses[n][edited_bone],
+                                             character.poses[(n + 1) % character_pose_count][edited_bone], float(f) / frames_per_pose);
+                    checksum += double(evaluator.evaluate()) + pose_checksum(evaluator.palette().back());
+                }
+            return checksum;
+        }},
+        {"pose_evaluator_layered", std::size_t(character_pose_count) * frames_per_pose, [&] {
+            double checksum = 0.;
+            for (int n = 0; n < character_pose_count; ++n)
+                for (int f = 0; f < frames_per_pose; ++f)
+                {
+                    evaluator.set_layered_poses(character.poses, n + float(f) / frames_per_pose, layers);
+                    checksum += double(evaluator.evaluate()) + pose_checksum(evaluator.palette().back());
+                }
+            return checksum;
+        }},
+        {"load_character", 8, [&] {
+            double checksum = 0.;
+            for (int i = 0; i < 8; ++i)
+            {
+                auto loaded = load_character(assets);
+                checksum += double(loaded.mesh.vertices.size() + loaded.mesh.indices.size() + loaded.bones.size());
+            }
+            return checksum;
+        }},
+        {"convert_region_512_rgb", 16, [&] {
+            double checksum = 0.;
+            for (int i = 0; i < 16; ++i)
+            {
+                auto converted = convert_region(frame, frame_width, 0, 0, frame_width, frame_height, false, 3);
+                checksum += (unsigned char) converted[converted.size() / 2];
+                pixel_buffers().release(std::move(converted));
+            }
+            return checksum;
+        }},
+        {"encode_png_512_rgba", 4, [&] {
+            double checksum = 0.;
+            for (int i = 0; i < 4; ++i)
+            {
+                auto png = encode_png(frame_width, frame_height, 4, rgba);
+                checksum += double(png.size());
+                pixel_buffers().release(std::move(png));
+            }
+            return checksum;
+        }},
+        {"encode_png_512_rgb", 4, [&] {
+            double checksum = 0.;
+            for (int i = 0; i < 4; ++i)
+            {
+                auto png = encode_png(frame_width, frame_height, 3, rgb);
+                checksum += double(png.size());
+                pixel_buffers().release(std::move(png));
+            }
+            return checksum;
+        }},
+    };
+
+    std::vector<result> results;
+    std::cout << std::left << std::setw(28) << "benchmark" << std::right << std::setw(14) << "min ns/op"
+              << std::setw(14) << "median ns/op" << std::setw(12) << "allocs/op" << '\n';
+    std::cout << std::fixed;
+    for (auto const & bench : benchmarks)
+    {
+        if (!filter.empty() && bench.name.find(filter) == std::string::npos)
+            continue;
+
+        results.push_back(measure(bench, repetitions));
+        auto const & r = results.back();
+        std::cout << std::left << std::setw(28) << r.name << std::right << std::setprecision(1) << std::setw(14) << r.min()
+                  << std::setw(14) << r.median() << std::setprecision(2) << std::setw(12) << r.allocations_per_op << '\n';
+    }
+
+    if (!json_path.empty())
+    {
+        std::ofstream json(json_path);
+        if (!json)
+            throw std::runtime_error("Cannot write " + json_path);
+        write_json(json, assets, repetitions, results);
+    }
+}
+catch (std::exception const & e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
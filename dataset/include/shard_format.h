@@ -0,0 +1,97 @@
+#ifndef MIXAMORENDERER_SHARD_FORMAT_H
+#define MIXAMORENDERER_SHARD_FORMAT_H
+
+#include <cstdint>
+#include <cstddef>
+
+// On-disk layout of a frame shard:
+//
+//   shard_header
+//   frame payloads, each starting at a multiple of shard_payload_alignment
+//   shard_index_entry[frame_count]
+//   shard_footer
+//
+// The footer sits at a fixed distance from the end of the file, so a reader
+// finds the index without scanning the payloads. Raw payloads are stored
+// top-down and tightly packed, so they can be used straight from the mapping.
+
+constexpr char shard_magic[8] = {'M', 'X', 'S', 'H', 'A', 'R', 'D', '\0'};
+constexpr std::uint32_t shard_version = 2;
+constexpr std::size_t shard_payload_alignment = 64;
+
+enum class frame_format : std::uint32_t
+{
+    rgba8 = 0,
+    rgb8 = 1,
+    png = 2,
+    // single channel labels: linear depth and bone ids
+    r32f = 3,
+    r8 = 4,
+};
+
+constexpr std::uint32_t frame_format_channels(frame_format format)
+{
+    switch (format)
+    {
+        case frame_format::rgb8:
+            return 3;
+        case frame_format::r32f:
+        case frame_format::r8:
+            return 1;
+        default:
+            return 4;
+    }
+}
+
+constexpr std::uint32_t frame_format_pixel_size(frame_format format)
+{
+    return format == frame_format::r32f ? 4 : frame_format_channels(format);
+}
+
+constexpr bool frame_format_is_raw(frame_format format)
+{
+    return format != frame_format::png;
+}
+
+struct shard_header
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t reserved;
+};
+
+struct shard_index_entry
+{
+    std::uint64_t frame_id;
+    std::uint64_t offset;
+    std::uint64_t size;
+    std::uint32_t width;
+    std::uint32_t height;
+    frame_format format;
+    // top-left corner of a cropped frame within the rendered view
+    std::uint32_t crop_x;
+    std::uint32_t crop_y;
+    std::uint32_t reserved;
+};
+
+enum shard_flags : std::uint32_t
+{
+    // frame ids are first_frame_id, first_frame_id + 1, ... in index order
+    shard_dense_ids = 1u << 0,
+};
+
+struct shard_footer
+{
+    std::uint64_t index_offset;
+    std::uint64_t frame_count;
+    std::uint64_t first_frame_id;
+    std::uint32_t flags;
+    std::uint32_t version;
+    char magic[8];
+};
+
+static_assert(sizeof(shard_header) == 16);
+static_assert(sizeof(shard_index_entry) == 48);
+static_assert(sizeof(shard_footer) == 40);
+
+#endif //MIXAMORENDERER_SHARD_FORMAT_H
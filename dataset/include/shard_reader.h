@@ -0,0 +1,126 @@
+#ifndef MIXAMORENDERER_SHARD_READER_H
+#define MIXAMORENDERER_SHARD_READER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "shard_format.h"
+
+// A frame as stored in the shard; bytes point into the read-only mapping and
+// stay valid for the lifetime of the reader.
+struct frame_view
+{
+    std::uint64_t frame_id;
+    std::uint32_t width;
+    std::uint32_t height;
+    frame_format format;
+    std::uint32_t crop_x;
+    std::uint32_t crop_y;
+    std::span<std::byte const> bytes;
+};
+
+// A frame ready for consumption: raw frames alias the mapping, encoded frames
+// own their decoded pixels. Move-only, since `pixels` may point into `storage`.
+struct decoded_frame
+{
+    std::uint64_t frame_id = 0;
+    std::uint32_t width = 0;
+    std::uint32_t height = 0;
+    // PNG frames decode to 8-bit channels, raw frames keep their format
+    frame_format format = frame_format::png;
+    std::uint32_t channels = 0;
+    std::uint32_t crop_x = 0;
+    std::uint32_t crop_y = 0;
+    std::span<std::byte const> pixels;
+    std::vector<std::byte> storage;
+
+    decoded_frame() = default;
+    decoded_frame(decoded_frame const &) = delete;
+    decoded_frame & operator = (decoded_frame const &) = delete;
+    // a moved vector keeps its buffer, so `pixels` stays valid
+    decoded_frame(decoded_frame &&) = default;
+    decoded_frame & operator = (decoded_frame &&) = default;
+};
+
+class shard_reader
+{
+public:
+    explicit shard_reader(std::string const & path);
+    ~shard_reader();
+
+    shard_reader(shard_reader const &) = delete;
+    shard_reader & operator = (shard_reader const &) = delete;
+
+    std::size_t size() const { return index_.size(); }
+    std::span<shard_index_entry const> index() const { return index_; }
+
+    bool contains(std::uint64_t frame_id) const { return find(frame_id) != nullptr; }
+
+    // Throw std::out_of_range if the shard has no such frame
+    frame_view frame(std::uint64_t frame_id) const;
+    frame_view frame_at(std::size_t position) const;
+
+    // Raw frames are returned without copying; PNG frames are decoded
+    decoded_frame decode(frame_view const & view) const;
+
+    // Asks the kernel to start paging the frame in
+    void will_need(frame_view const & view) const;
+
+private:
+    shard_index_entry const * find(std::uint64_t frame_id) const;
+    frame_view view(shard_index_entry const & entry) const;
+
+    std::byte const * data_ = nullptr;
+    std::size_t mapped_size_ = 0;
+    std::span<shard_index_entry const> index_;
+    std::uint64_t first_frame_id_ = 0;
+    bool dense_ = false;
+    std::unordered_map<std::uint64_t, std::size_t> sparse_index_;
+};
+
+// Decodes frames on worker threads ahead of the consumer, returning them in
+// the requested order; at most `depth` frames are in flight at once.
+class prefetch_iterator
+{
+public:
+    prefetch_iterator(shard_reader const & reader, std::vector<std::uint64_t> frame_ids,
+                      unsigned thread_count = std::thread::hardware_concurrency(), std::size_t depth = 16);
+    ~prefetch_iterator();
+
+    prefetch_iterator(prefetch_iterator const &) = delete;
+    prefetch_iterator & operator = (prefetch_iterator const &) = delete;
+
+    // Blocks until the next frame is ready; std::nullopt after the last one.
+    // A frame that failed to decode rethrows its error once it is the next one
+    std::optional<decoded_frame> next();
+
+private:
+    void worker();
+
+    shard_reader const & reader_;
+    std::vector<std::uint64_t> frame_ids_;
+    std::size_t depth_;
+
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::condition_variable space_;
+    std::vector<std::optional<decoded_frame>> slots_;
+    std::size_t claimed_ = 0;
+    std::size_t consumed_ = 0;
+    bool stop_ = false;
+    std::exception_ptr error_;
+    std::size_t error_position_ = 0;
+
+    std::vector<std::thread> threads_;
+};
+
+#endif //MIXAMORENDERER_SHARD_READER_H
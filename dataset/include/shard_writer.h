@@ -0,0 +1,40 @@
+#ifndef MIXAMORENDERER_SHARD_WRITER_H
+#define MIXAMORENDERER_SHARD_WRITER_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "shard_format.h"
+
+// Appends frames to a shard file; the index and footer are written by close().
+class shard_writer
+{
+public:
+    explicit shard_writer(std::string const & path);
+    ~shard_writer();
+
+    shard_writer(shard_writer const &) = delete;
+    shard_writer & operator = (shard_writer const &) = delete;
+
+    void append(std::uint64_t frame_id, std::uint32_t width, std::uint32_t height, frame_format format,
+                void const * data, std::size_t size, std::uint32_t crop_x = 0, std::uint32_t crop_y = 0);
+
+    // Room for this many index entries, so appends do not reallocate the index
+    void reserve(std::size_t frames) { index_.reserve(frames); }
+
+    void close();
+
+    std::size_t frame_count() const { return index_.size(); }
+
+private:
+    void pad_to(std::size_t alignment);
+
+    std::string path_;
+    std::ofstream file_;
+    std::uint64_t offset_ = 0;
+    std::vector<shard_index_entry> index_;
+};
+
+#endif //MIXAMORENDERER_SHARD_WRITER_H
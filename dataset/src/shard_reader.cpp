@@ -0,0 +1,265 @@
+#include "shard_reader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_ONLY_PNG
+#include "stb_image.h"
+
+shard_reader::shard_reader(std::string const & path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open shard: " + path);
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || std::size_t(st.st_size) < sizeof(shard_header) + sizeof(shard_footer))
+    {
+        ::close(fd);
+        throw std::runtime_error("Shard is truncated: " + path);
+    }
+
+    mapped_size_ = st.st_size;
+    void * mapping = ::mmap(nullptr, mapped_size_, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+        throw std::runtime_error("Cannot map shard: " + path);
+    data_ = static_cast<std::byte const *>(mapping);
+
+    shard_footer footer;
+    std::memcpy(&footer, data_ + mapped_size_ - sizeof(footer), sizeof(footer));
+
+    // the sizes are checked before they are added up, so a corrupt footer cannot wrap around
+    bool valid = std::memcmp(footer.magic, shard_magic, sizeof(shard_magic)) == 0 && footer.version == shard_version
+        && footer.index_offset % alignof(shard_index_entry) == 0
+        && footer.frame_count <= (mapped_size_ - sizeof(footer)) / sizeof(shard_index_entry)
+        && footer.index_offset >= sizeof(shard_header)
+        && footer.index_offset + footer.frame_count * sizeof(shard_index_entry) + sizeof(footer) == mapped_size_;
+
+    // every frame lies between the header and the index
+    if (valid)
+    {
+        index_ = {reinterpret_cast<shard_index_entry const *>(data_ + footer.index_offset), footer.frame_count};
+        for (auto const & entry : index_)
+            if (entry.offset < sizeof(shard_header) || entry.offset > footer.index_offset
+                || entry.size > footer.index_offset - entry.offset)
+                valid = false;
+    }
+
+    if (!valid)
+    {
+        ::munmap(mapping, mapped_size_);
+        data_ = nullptr;
+        throw std::runtime_error("Not a valid shard: " + path);
+    }
+
+    first_frame_id_ = footer.first_frame_id;
+    dense_ = (footer.flags & shard_dense_ids) != 0;
+
+    if (!dense_)
+    {
+        sparse_index_.reserve(index_.size());
+        for (std::size_t i = 0; i < index_.size(); ++i)
+            sparse_index_.emplace(index_[i].frame_id, i);
+    }
+
+    ::madvise(mapping, mapped_size_, MADV_RANDOM);
+}
+
+shard_reader::~shard_reader()
+{
+    if (data_)
+        ::munmap(const_cast<std::byte *>(data_), mapped_size_);
+}
+
+shard_index_entry const * shard_reader::find(std::uint64_t frame_id) const
+{
+    if (dense_)
+    {
+        if (frame_id < first_frame_id_ || frame_id - first_frame_id_ >= index_.size())
+            return nullptr;
+        return &index_[frame_id - first_frame_id_];
+    }
+
+    auto it = sparse_index_.find(frame_id);
+    return it == sparse_index_.end() ? nullptr : &index_[it->second];
+}
+
+frame_view shard_reader::view(shard_index_entry const & entry) const
+{
+    return {entry.frame_id, entry.width, entry.height, entry.format, entry.crop_x, entry.crop_y,
+            {data_ + entry.offset, entry.size}};
+}
+
+frame_view shard_reader::frame(std::uint64_t frame_id) const
+{
+    auto entry = find(frame_id);
+    if (!entry)
+        throw std::out_of_range("Shard has no frame " + std::to_string(frame_id));
+    return view(*entry);
+}
+
+frame_view shard_reader::frame_at(std::size_t position) const
+{
+    if (position >= index_.size())
+        throw std::out_of_range("Shard has no frame at position " + std::to_string(position));
+    return view(index_[position]);
+}
+
+decoded_frame shard_reader::decode(frame_view const & view) const
+{
+    decoded_frame result;
+    result.frame_id = view.frame_id;
+    result.width = view.width;
+    result.height = view.height;
+    result.format = view.format;
+    result.channels = frame_format_channels(view.format);
+    result.crop_x = view.crop_x;
+    result.crop_y = view.crop_y;
+
+    if (frame_format_is_raw(view.format))
+    {
+        if (view.bytes.size() < std::size_t(view.width) * view.height * result.channels)
+            throw std::runtime_error("Frame " + std::to_string(view.frame_id) + " is shorter than its size");
+        result.pixels = view.bytes;
+        return result;
+    }
+
+    auto bytes = reinterpret_cast<stbi_uc const *>(view.bytes.data());
+    int width, height, channels;
+    if (!stbi_info_from_memory(bytes, int(view.bytes.size()), &width, &height, &channels))
+        throw std::runtime_error("Cannot decode frame " + std::to_string(view.frame_id) + ": " + stbi_failure_reason());
+
+    // grey + alpha has no frame format, expand it to RGBA
+    int requested = channels == 2 ? 4 : 0;
+    stbi_uc * pixels = stbi_load_from_memory(bytes, int(view.bytes.size()), &width, &height, &channels, requested);
+    if (!pixels)
+        throw std::runtime_error("Cannot decode frame " + std::to_string(view.frame_id) + ": " + stbi_failure_reason());
+    if (requested)
+        channels = requested;
+
+    result.width = width;
+    result.height = height;
+    result.format = channels == 1 ? frame_format::r8 : channels == 3 ? frame_format::rgb8 : frame_format::rgba8;
+    result.channels = channels;
+    result.storage.assign(reinterpret_cast<std::byte const *>(pixels),
+                          reinterpret_cast<std::byte const *>(pixels) + std::size_t(width) * height * channels);
+    result.pixels = result.storage;
+    stbi_image_free(pixels);
+    return result;
+}
+
+void shard_reader::will_need(frame_view const & view) const
+{
+    static std::size_t const page_size = ::sysconf(_SC_PAGESIZE);
+
+    auto begin = reinterpret_cast<std::uintptr_t>(view.bytes.data()) / page_size * page_size;
+    auto end = reinterpret_cast<std::uintptr_t>(view.bytes.data() + view.bytes.size());
+    ::madvise(reinterpret_cast<void *>(begin), end - begin, MADV_WILLNEED);
+}
+
+prefetch_iterator::prefetch_iterator(shard_reader const & reader, std::vector<std::uint64_t> frame_ids,
+                                     unsigned thread_count, std::size_t depth)
+    : reader_(reader)
+    , frame_ids_(std::move(frame_ids))
+    , depth_(std::max<std::size_t>(depth, 1))
+    , slots_(depth_)
+{
+    thread_count = std::clamp<unsigned>(thread_count, 1, unsigned(depth_));
+    for (unsigned i = 0; i < thread_count; ++i)
+        threads_.emplace_back(&prefetch_iterator::worker, this);
+}
+
+prefetch_iterator::~prefetch_iterator()
+{
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    space_.notify_all();
+    for (auto & thread : threads_)
+        thread.join();
+}
+
+std::optional<decoded_frame> prefetch_iterator::next()
+{
+    std::unique_lock lock(mutex_);
+    if (consumed_ == frame_ids_.size())
+        return std::nullopt;
+
+    auto & slot = slots_[consumed_ % depth_];
+    // a failed frame is reported when its turn comes, after the frames before it
+    ready_.wait(lock, [&]{ return slot.has_value() || (error_ && error_position_ == consumed_); });
+    if (!slot)
+        std::rethrow_exception(error_);
+
+    std::optional<decoded_frame> result = std::move(slot);
+    slot.reset();
+    ++consumed_;
+    lock.unlock();
+
+    space_.notify_all();
+    return result;
+}
+
+void prefetch_iterator::worker()
+{
+    while (true)
+    {
+        std::size_t position;
+        {
+            std::unique_lock lock(mutex_);
+            space_.wait(lock, [&]{ return stop_ || error_ || claimed_ == frame_ids_.size() || claimed_ < consumed_ + depth_; });
+            if (stop_ || error_ || claimed_ == frame_ids_.size())
+                return;
+            position = claimed_++;
+        }
+
+        try
+        {
+            auto view = reader_.frame(frame_ids_[position]);
+            reader_.will_need(view);
+
+            auto frame = reader_.decode(view);
+            if (frame.storage.empty())
+            {
+                // fault the pages in here rather than on the consumer's thread
+                static std::size_t const page_size = ::sysconf(_SC_PAGESIZE);
+                volatile std::byte sink{};
+                for (std::size_t offset = 0; offset < frame.pixels.size(); offset += page_size)
+                    sink = frame.pixels[offset];
+                (void)sink;
+            }
+
+            {
+                std::lock_guard lock(mutex_);
+                slots_[position % depth_] = std::move(frame);
+            }
+            ready_.notify_all();
+        }
+        catch (...)
+        {
+            {
+                std::lock_guard lock(mutex_);
+                // the frames before this one are still decoded and returned, no more are claimed
+                if (!error_ || position < error_position_)
+                {
+                    error_ = std::current_exception();
+                    error_position_ = position;
+                }
+            }
+            ready_.notify_all();
+            space_.notify_all();
+            return;
+        }
+    }
+}
@@ -0,0 +1,89 @@
+#include "shard_writer.h"
+
+#include <cstring>
+#include <stdexcept>
+
+shard_writer::shard_writer(std::string const & path)
+    : path_(path)
+    , file_(path, std::ios::binary | std::ios::trunc)
+{
+    if (!file_)
+        throw std::runtime_error("Cannot open shard for writing: " + path);
+
+    shard_header header{};
+    std::memcpy(header.magic, shard_magic, sizeof(shard_magic));
+    header.version = shard_version;
+    file_.write((char const *)(&header), sizeof(header));
+    offset_ = sizeof(header);
+}
+
+shard_writer::~shard_writer()
+{
+    try
+    {
+        close();
+    }
+    catch (std::exception const &)
+    {
+    }
+}
+
+void shard_writer::append(std::uint64_t frame_id, std::uint32_t width, std::uint32_t height, frame_format format,
+                          void const * data, std::size_t size, std::uint32_t crop_x, std::uint32_t crop_y)
+{
+    if (!file_.is_open())
+        throw std::logic_error("Shard is already closed: " + path_);
+
+    if (frame_format_is_raw(format) && size != std::size_t(width) * height * frame_format_pixel_size(format))
+        throw std::invalid_argument("Raw frame size does not match its dimensions");
+
+    pad_to(shard_payload_alignment);
+
+    index_.push_back({frame_id, offset_, size, width, height, format, crop_x, crop_y, 0});
+
+    file_.write((char const *)(data), size);
+    offset_ += size;
+
+    if (!file_)
+        throw std::runtime_error("Failed to write shard: " + path_);
+}
+
+void shard_writer::close()
+{
+    if (!file_.is_open())
+        return;
+
+    pad_to(alignof(shard_index_entry));
+
+    shard_footer footer{};
+    footer.index_offset = offset_;
+    footer.frame_count = index_.size();
+    footer.first_frame_id = index_.empty() ? 0 : index_.front().frame_id;
+    footer.version = shard_version;
+    std::memcpy(footer.magic, shard_magic, sizeof(shard_magic));
+
+    footer.flags = shard_dense_ids;
+    for (std::size_t i = 0; i < index_.size(); ++i)
+    {
+        if (index_[i].frame_id != footer.first_frame_id + i)
+        {
+            footer.flags &= ~shard_dense_ids;
+            break;
+        }
+    }
+
+    file_.write((char const *)(index_.data()), index_.size() * sizeof(index_[0]));
+    file_.write((char const *)(&footer), sizeof(footer));
+    file_.close();
+
+    if (file_.fail())
+        throw std::runtime_error("Failed to finalize shard: " + path_);
+}
+
+void shard_writer::pad_to(std::size_t alignment)
+{
+    static char const padding[shard_payload_alignment] = {};
+    std::size_t pad = (alignment - offset_ % alignment) % alignment;
+    file_.write(padding, pad);
+    offset_ += pad;
+}
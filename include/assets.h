@@ -0,0 +1,103 @@
+#ifndef MIXAMORENDERER_ASSETS_H
+#define MIXAMORENDERER_ASSETS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "mesh.h"
+#include "skeleton.h"
+
+// The key poses the animation blends between, pose_0.bin to pose_5.bin
+constexpr int character_pose_count = 6;
+
+// A level of detail: a range of mesh_data::indices over the shared vertices
+struct mesh_lod
+{
+    std::uint32_t first_index = 0;
+    std::uint32_t index_count = 0;
+    // largest distance from the full-detail surface, in mesh units
+    float error = 0.f;
+};
+
+// A cluster of at most 64 vertices and 124 triangles: a range of
+// mesh_data::indices within one level of detail, with the bind-pose bounds the
+// renderer poses each frame to cull it
+struct meshlet
+{
+    std::uint32_t first_index = 0;
+    std::uint32_t index_count = 0;
+    // range of mesh_data::meshlet_bones: the bones weighting any of its vertices
+    std::uint32_t first_bone = 0;
+    std::uint32_t bone_count = 0;
+    // bounding sphere of the vertices
+    glm::vec3 center = glm::vec3(0.f);
+    float radius = 0.f;
+    // every triangle normal is within acos(cone_cosine) of the axis; -1 when they spread too far to cull
+    glm::vec3 cone_axis = glm::vec3(0.f, 0.f, 1.f);
+    float cone_cosine = -1.f;
+};
+
+// A mesh as the renderer uploads it: the vertices packed in their layout for
+// the GPU, and decoded in `vertices` for the CPU side
+struct mesh_data
+{
+    vertex_layout layout;
+    mesh_bounds bounds;
+    std::vector<vertex> vertices;
+    std::vector<std::uint8_t> packed_vertices;
+    std::vector<std::uint32_t> indices;
+    // level 0 is the full mesh, each further one coarser; the loaders fill in at least one
+    std::vector<mesh_lod> lods;
+    // in index order, so each level's meshlets are consecutive; empty when the file has none
+    std::vector<meshlet> meshlets;
+    std::vector<std::uint16_t> meshlet_bones;
+
+    // Indices stay 32-bit in memory; files and index buffers use 16 bits
+    // when there are at most 65536 vertices
+    std::size_t index_size() const;
+
+    // bytes of the vertex buffer and of the index buffer
+    std::size_t vertex_bytes() const;
+    std::size_t index_bytes() const;
+};
+
+// The character as the asset directory holds it: the skinned mesh (human.bin,
+// or a converted mesh file), its skeleton (bones.bin) and the key poses, one
+// bone_pose per bone each. The bones are sorted breadth-first on load, and the
+// poses and the vertices' bone ids renumbered to match.
+struct character_assets
+{
+    mesh_data mesh;
+    std::vector<bone> bones;
+    std::vector<std::vector<bone_pose>> poses;
+    // depth d holds bones [bone_levels[d], bone_levels[d + 1])
+    std::vector<std::uint32_t> bone_levels;
+    // the id each bone has in bones.bin, which labels and keypoints keep using
+    std::vector<std::uint32_t> source_bone_ids;
+    // bones the shader's palette holds: the skeleton's, and identity ones for
+    // any higher id the vertices use
+    std::size_t palette_size = 0;
+};
+
+// The loaders throw std::runtime_error when a file is missing or shorter than its header says
+// human.bin: the counts, then full vertices with two 8-bit bone ids, then 32-bit indices
+mesh_data load_mesh(std::string const & path);
+std::vector<bone> load_bones(std::string const & path);
+std::vector<bone_pose> load_pose(std::string const & path, std::size_t bone_count);
+
+// Mesh files as mixamo_mesh_convert writes them: a header with a magic, a
+// version, the vertex layout, the counts, the bounds, the index size, the
+// number of levels of detail and of meshlets, then the vertices in that
+// layout, the indices of all levels, the level table, the meshlet table and
+// the meshlets' bone ids. Loading one also accepts a plain human.bin.
+mesh_data load_mesh_file(std::string const & path);
+void save_mesh_file(std::string const & path, mesh_data const & mesh);
+
+// `mesh_path` replaces human.bin when it is not empty. Throws when the bones'
+// parents do not form a forest.
+character_assets load_character(std::string const & directory, std::string const & mesh_path = {});
+
+#endif //MIXAMORENDERER_ASSETS_H
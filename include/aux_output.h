@@ -0,0 +1,22 @@
+#ifndef MIXAMORENDERER_AUX_OUTPUT_H
+#define MIXAMORENDERER_AUX_OUTPUT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "render_target.h"
+#include "shard_writer.h"
+
+// Format of an aux target once written out: depth stays float, normals become
+// RGB8 and bone ids an 8-bit mask
+frame_format aux_frame_format(int target);
+
+// The functions take pixels as read back from the aux target, rows bottom-up.
+// Files are written as base + ".pfm" for depth and base + ".png" otherwise.
+void save_aux_image(int target, std::string const & filename_base, int width, int height, std::vector<char> const & pixels);
+
+void append_aux_image(shard_writer & shard, int target, std::uint64_t frame_id, int width, int height,
+                      std::vector<char> const & pixels, int crop_x = 0, int crop_y = 0);
+
+#endif //MIXAMORENDERER_AUX_OUTPUT_H
@@ -0,0 +1,33 @@
+#ifndef MIXAMORENDERER_CROP_H
+#define MIXAMORENDERER_CROP_H
+
+#include <vector>
+
+#include <glm/mat4x4.hpp>
+
+#include "keypoints.h"
+#include "mesh.h"
+#include "skeleton.h"
+
+// Rectangle in pixels with the origin at the top-left corner of the view
+struct pixel_rect
+{
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+};
+
+// Radius around each joint, in bind pose, that contains every vertex the bone
+// influences. A skinned vertex is a blend of its bones' transforms of it, so it
+// stays within the convex hull of its bones' posed spheres.
+std::vector<float> bone_radii(std::vector<vertex> const & vertices, std::vector<bone> const & bones);
+
+// Conservative screen rectangle of the posed character in one view: the union
+// of every bone's sphere, padded by `margin` pixels and clamped to the view.
+// Falls back to the whole view when a sphere reaches the near plane.
+pixel_rect skinned_bounds(joint_batch const & joints, std::vector<float> const & radii,
+                          std::vector<bone_pose> const & bone_transforms, glm::mat4 const & view,
+                          glm::mat4 const & projection, int width, int height, int margin);
+
+#endif //MIXAMORENDERER_CROP_H
@@ -0,0 +1,133 @@
+#ifndef MIXAMORENDERER_FRAME_MEMORY_H
+#define MIXAMORENDERER_FRAME_MEMORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Linear allocator for data that lives for one frame, or one job. Allocation
+// bumps a pointer; nothing is freed individually, the arena is rewound as a
+// whole. Chunks are kept across rewinds, and once nothing is live the ones a
+// frame spilled into are merged, so steady-state frames never touch the heap.
+class frame_arena
+{
+public:
+    struct marker
+    {
+        std::size_t chunk = 0;
+        std::size_t offset = 0;
+    };
+
+    explicit frame_arena(std::size_t chunk_size = std::size_t(1) << 20);
+
+    frame_arena(frame_arena const &) = delete;
+    frame_arena & operator = (frame_arena const &) = delete;
+
+    void * allocate(std::size_t size, std::size_t alignment = alignof(std::max_align_t));
+
+    // Grows the newest allocation in place when it still fits, copies otherwise
+    void * reallocate(void * data, std::size_t old_size, std::size_t new_size);
+
+    template <typename T>
+    T * allocate_array(std::size_t count) { return static_cast<T *>(allocate(count * sizeof(T), alignof(T))); }
+
+    // printf into the arena
+    char const * print(char const * format, ...);
+
+    marker mark() const { return {current_, offset_}; }
+    void rewind(marker m);
+    void reset() { rewind({}); }
+
+    std::size_t capacity() const;
+
+private:
+    struct chunk
+    {
+        std::unique_ptr<std::byte[]> data;
+        std::size_t size = 0;
+    };
+
+    std::size_t chunk_size_;
+    std::vector<chunk> chunks_;
+    std::size_t current_ = 0;
+    std::size_t offset_ = 0;
+    void * last_ = nullptr;
+};
+
+// The calling thread's own arena; job system workers, pipeline stages and the
+// image encoder allocate scratch memory from it inside an arena_scope
+frame_arena & thread_arena();
+
+// Rewinds an arena to where it was when the scope was entered
+class arena_scope
+{
+public:
+    explicit arena_scope(frame_arena & arena = thread_arena())
+        : arena_(arena)
+        , mark_(arena.mark())
+    {}
+
+    ~arena_scope() { arena_.rewind(mark_); }
+
+    arena_scope(arena_scope const &) = delete;
+    arena_scope & operator = (arena_scope const &) = delete;
+
+private:
+    frame_arena & arena_;
+    frame_arena::marker mark_;
+};
+
+// Lets standard containers allocate from an arena; deallocation is a no-op
+template <typename T>
+struct arena_allocator
+{
+    using value_type = T;
+
+    arena_allocator(frame_arena & arena = thread_arena())
+        : arena(&arena)
+    {}
+
+    template <typename U>
+    arena_allocator(arena_allocator<U> const & other)
+        : arena(other.arena)
+    {}
+
+    T * allocate(std::size_t count) { return arena->allocate_array<T>(count); }
+    void deallocate(T *, std::size_t) {}
+
+    template <typename U>
+    bool operator == (arena_allocator<U> const & other) const { return arena == other.arena; }
+
+    frame_arena * arena;
+};
+
+template <typename T>
+using arena_vector = std::vector<T, arena_allocator<T>>;
+
+// Recycles the multi-megabyte pixel buffers of readbacks, converted images and
+// encoded files between frames. Thread-safe: buffers are taken on the GL
+// thread and given back on the output side.
+class pixel_buffer_pool
+{
+public:
+    explicit pixel_buffer_pool(std::size_t max_buffers = 64);
+
+    // `size` bytes, in the smallest free buffer that is large enough
+    std::vector<char> acquire(std::size_t size);
+
+    // Keeps the buffer for reuse; when the pool is full the smallest buffer is freed
+    void release(std::vector<char> && buffer);
+
+    std::size_t free_count() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::size_t max_buffers_;
+    std::vector<std::vector<char>> free_;
+};
+
+pixel_buffer_pool & pixel_buffers();
+
+#endif //MIXAMORENDERER_FRAME_MEMORY_H
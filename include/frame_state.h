@@ -0,0 +1,19 @@
+#ifndef MIXAMORENDERER_FRAME_STATE_H
+#define MIXAMORENDERER_FRAME_STATE_H
+
+// Everything an interactive frame depends on; a frame whose state equals the
+// one last presented would draw the same pixels and is skipped
+struct frame_state
+{
+    float view_angle = 0.f;
+    float camera_distance = 0.f;
+    float camera_height = 0.f;
+    float model_rotation = 0.f;
+    float time = 0.f;
+    int width = 0;
+    int height = 0;
+
+    bool operator == (frame_state const &) const = default;
+};
+
+#endif //MIXAMORENDERER_FRAME_STATE_H
@@ -0,0 +1,74 @@
+#ifndef MIXAMORENDERER_GEOMETRY_BUFFER_H
+#define MIXAMORENDERER_GEOMETRY_BUFFER_H
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "assets.h"
+#include "mesh.h"
+
+// Where a mesh lives in a geometry_buffer
+struct mesh_range
+{
+    GLenum index_type = GL_UNSIGNED_INT;
+    // bytes into the index buffer
+    std::size_t index_offset = 0;
+    GLsizei index_count = 0;
+    GLint base_vertex = 0;
+    // compact meshes: the bounds their positions are fractions of
+    mesh_bounds bounds;
+};
+
+// The `count` indices of `range` from index `first` on, e.g. one level of detail
+mesh_range sub_range(mesh_range const & range, std::uint32_t first, std::uint32_t count);
+
+// One vertex buffer, one index buffer and one VAO shared by all meshes of a
+// vertex layout, so several characters draw without rebinding. Each mesh keeps
+// indices relative to its first vertex and is drawn with
+// glDrawElementsBaseVertex; they are 16-bit when the mesh has at most 65536
+// vertices, however many the buffer holds. The buffers grow by doubling and
+// copying on the GPU.
+class geometry_buffer
+{
+public:
+    explicit geometry_buffer(vertex_layout const & layout);
+    ~geometry_buffer();
+
+    geometry_buffer(geometry_buffer const &) = delete;
+    geometry_buffer & operator = (geometry_buffer const &) = delete;
+
+    vertex_layout const & layout() const { return layout_; }
+
+    // Uploads the mesh behind the ones added before; throws if it has another vertex layout
+    mesh_range add(mesh_data const & mesh);
+
+    // Binds the VAO that draw() uses
+    void bind() const;
+    void draw(mesh_range const & range) const;
+    // Draws the listed meshlets of the mesh at `range` with one glMultiDrawElementsBaseVertex
+    void draw(mesh_range const & range, std::vector<meshlet> const & meshlets, std::span<std::uint32_t const> listed) const;
+
+    std::size_t vertex_bytes() const { return vertex_bytes_; }
+    std::size_t index_bytes() const { return index_bytes_; }
+
+private:
+    // Writes `size` bytes at `offset`, growing the buffer first when they do not fit
+    void write(GLuint & buffer, std::size_t & capacity, std::size_t offset, void const * data, std::size_t size);
+    void set_vertex_layout();
+
+    vertex_layout layout_;
+    GLuint vao_ = 0;
+    GLuint vertex_buffer_ = 0;
+    GLuint index_buffer_ = 0;
+    std::size_t vertex_capacity_ = 0;
+    std::size_t index_capacity_ = 0;
+    std::size_t vertex_bytes_ = 0;
+    std::size_t index_bytes_ = 0;
+    std::size_t vertex_count_ = 0;
+};
+
+#endif //MIXAMORENDERER_GEOMETRY_BUFFER_H
@@ -0,0 +1,47 @@
+#ifndef MIXAMORENDERER_KEYPOINTS_H
+#define MIXAMORENDERER_KEYPOINTS_H
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "skeleton.h"
+
+// Joint positions of a posed skeleton, stored as structure of arrays padded to
+// a multiple of 4 so the projection can work on 4 joints at a time
+struct joint_batch
+{
+    std::size_t count = 0;
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+};
+
+struct keypoint
+{
+    // pixel coordinates with the origin at the top-left corner of the view
+    float u;
+    float v;
+    // distance in front of the camera; joints with depth <= 0 are behind it
+    float depth;
+};
+
+// World-space joints: bones[i].offset is the bind position of joint i in mesh
+// space, the joint follows its bone's pose like the skinned vertices do
+void posed_joints(std::vector<bone_pose> const & bone_transforms, std::vector<bone> const & bones,
+                  glm::mat4 const & model, joint_batch & joints);
+
+// Projects every joint through every camera; result[camera * joints.count + joint]
+void project_keypoints(joint_batch const & joints, std::span<glm::mat4 const> view_projections,
+                       int width, int height, std::vector<keypoint> & result);
+
+// Appends one JSON object describing a frame, without a trailing newline; the
+// k-th joint listed is joints[order[k]]
+void format_keypoints(std::string & out, std::uint64_t frame_id, joint_batch const & joints,
+                      std::vector<keypoint> const & keypoints, std::span<std::uint32_t const> order);
+
+#endif //MIXAMORENDERER_KEYPOINTS_H
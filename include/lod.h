@@ -0,0 +1,37 @@
+#ifndef MIXAMORENDERER_LOD_H
+#define MIXAMORENDERER_LOD_H
+
+#include <vector>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+#include "assets.h"
+#include "mesh.h"
+
+// Picks a mesh's level of detail from its size on screen: the bind-pose
+// bounding sphere is projected into every view, and the coarsest level whose
+// error, scaled like the sphere, stays within `max_error_pixels` in the
+// largest view is used. Without coarser levels, or with a budget of 0, it
+// always picks level 0.
+class lod_selector
+{
+public:
+    lod_selector(std::vector<mesh_lod> const & lods, mesh_bounds const & bounds, float max_error_pixels);
+
+    // `radius_pixels`: projected radius of the bounding sphere
+    int select(float radius_pixels) const;
+
+    int select(glm::mat4 const & model, std::vector<glm::mat4> const & views, glm::mat4 const & projection,
+               int viewport_height) const;
+
+    std::size_t level_count() const { return errors_.size(); }
+
+private:
+    std::vector<float> errors_;
+    glm::vec3 center_;
+    float radius_;
+    float max_error_pixels_;
+};
+
+#endif //MIXAMORENDERER_LOD_H
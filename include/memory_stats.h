@@ -0,0 +1,99 @@
+#ifndef MIXAMORENDERER_MEMORY_STATS_H
+#define MIXAMORENDERER_MEMORY_STATS_H
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+// What the C++ heap memory of the process is for. Allocations are charged to
+// the category of the innermost memory_scope on the allocating thread and
+// given back to the same category when freed, on whatever thread.
+enum class memory_category
+{
+    other,
+    assets,
+    clips,
+    pixel_buffers,
+    queues,
+    arenas,
+};
+
+constexpr int memory_category_count = 6;
+
+char const * memory_category_name(memory_category category);
+
+class memory_scope
+{
+public:
+    explicit memory_scope(memory_category category);
+    ~memory_scope();
+
+    memory_scope(memory_scope const &) = delete;
+    memory_scope & operator = (memory_scope const &) = delete;
+
+private:
+    memory_category previous_;
+};
+
+// Live bytes and allocations are counted per thread and summed when asked
+// for. Peaks need a shared live total, which is only kept for allocations made
+// after this call; until then a peak is the live size at the time it is read.
+void track_memory_peaks();
+
+// Calls and bytes of operator new since the start of the program, across all threads
+struct heap_counters
+{
+    std::uint64_t allocations = 0;
+    std::uint64_t bytes = 0;
+};
+
+heap_counters heap_usage();
+
+struct memory_usage
+{
+    std::size_t live_bytes = 0;
+    std::size_t peak_bytes = 0;
+    std::uint64_t allocations = 0;
+};
+
+memory_usage heap_category_usage(memory_category category);
+memory_usage heap_total_usage();
+
+// GL object storage, estimated from the creation parameters: the driver's own
+// padding, mip chains it keeps and its system memory copies are not seen
+enum class gl_object_kind
+{
+    buffer,
+    texture,
+    renderbuffer,
+};
+
+constexpr int gl_object_kind_count = 3;
+
+// Sets the storage of a GL object, replacing what it had; called on the GL thread
+void track_gl_object(gl_object_kind kind, GLuint name, std::size_t bytes);
+void forget_gl_objects(gl_object_kind kind, GLsizei count, GLuint const * names);
+
+// Bytes per pixel of a color or depth internal format
+std::size_t gl_format_bytes(GLenum internal_format);
+
+memory_usage gl_object_usage(gl_object_kind kind);
+
+// Resident set size of the process and its peak (VmRSS and VmHWM of /proc/self/status), 0 where unknown
+struct process_memory
+{
+    std::size_t rss_bytes = 0;
+    std::size_t peak_rss_bytes = 0;
+};
+
+process_memory read_process_memory();
+
+// One line with heap, GL and resident totals, for periodic logging
+void print_memory_line(std::ostream & out);
+
+// Every heap category and GL object kind with live and peak bytes, and the peak RSS
+void print_memory_summary(std::ostream & out);
+
+#endif //MIXAMORENDERER_MEMORY_STATS_H
@@ -0,0 +1,80 @@
+#ifndef MIXAMORENDERER_MESH_H
+#define MIXAMORENDERER_MESH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+// Bone influences a vertex can carry; the ones it does not use have weight 0
+constexpr int max_bone_influences = 4;
+
+// A vertex as the CPU side works with it, whatever layout the GPU gets
+struct vertex
+{
+    glm::vec3 position;
+    glm::vec3 normal;
+    std::uint16_t bone_ids[max_bone_influences];
+    std::uint8_t bone_weights[max_bone_influences];
+};
+
+enum class vertex_format : std::uint32_t
+{
+    full = 0,
+    compact = 1,
+};
+
+char const * vertex_format_name(vertex_format format);
+
+// How vertices are packed for the GPU and in mesh files. Full vertices start
+// with the float position and normal (24 bytes). Compact ones start with the
+// position as 16-bit fractions of the mesh bounds, 2 bytes of padding and the
+// normal octahedral-encoded in two 16-bit snorms (12 bytes). Either is
+// followed by 2 or 4 bone ids of 8 or 16 bits and as many 8-bit weights,
+// padded to a multiple of 4 bytes.
+struct vertex_layout
+{
+    vertex_format format = vertex_format::full;
+    std::uint32_t influences = 2;
+    std::uint32_t bone_id_size = 1;
+
+    std::size_t bone_ids_offset() const { return format == vertex_format::compact ? 12 : 24; }
+    std::size_t bone_weights_offset() const { return bone_ids_offset() + influences * bone_id_size; }
+    std::size_t stride() const { return (bone_weights_offset() + influences + 3) / 4 * 4; }
+
+    bool operator == (vertex_layout const &) const = default;
+};
+
+// The layout human.bin and mesh files before version 5 store
+constexpr vertex_layout legacy_vertex_layout(vertex_format format) { return {format, 2, 1}; }
+
+// Axis-aligned bounds of the bind-pose positions
+struct mesh_bounds
+{
+    glm::vec3 min = glm::vec3(0.f);
+    glm::vec3 max = glm::vec3(0.f);
+
+    glm::vec3 extent() const { return max - min; }
+};
+
+mesh_bounds compute_bounds(std::vector<vertex> const & vertices);
+
+// Maps a unit vector onto the [-1, 1] square: the upper half of the octahedron
+// |x| + |y| + |z| = 1 projects straight down, the lower half folds over the edges
+glm::vec2 octahedral_encode(glm::vec3 normal);
+glm::vec3 octahedral_decode(glm::vec2 encoded);
+
+// The smallest layout of `format` that keeps every weighted influence in its
+// slot and every bone id of the slots it keeps
+vertex_layout fit_vertex_layout(vertex_format format, std::vector<vertex> const & vertices);
+
+// Compact positions are quantized to the nearest fraction of `bounds`;
+// unpacking decodes them the way the vertex shader does
+std::vector<std::uint8_t> pack_vertices(std::vector<vertex> const & vertices, vertex_layout const & layout,
+                                        mesh_bounds const & bounds);
+std::vector<vertex> unpack_vertices(std::uint8_t const * data, std::size_t count, vertex_layout const & layout,
+                                    mesh_bounds const & bounds);
+
+#endif //MIXAMORENDERER_MESH_H
@@ -0,0 +1,25 @@
+#ifndef MIXAMORENDERER_MESH_CLUSTER_H
+#define MIXAMORENDERER_MESH_CLUSTER_H
+
+#include <cstddef>
+
+#include "assets.h"
+
+constexpr std::size_t meshlet_max_vertices = 64;
+constexpr std::size_t meshlet_max_triangles = 124;
+
+// Replaces the mesh's meshlets by a split of every level of detail. A meshlet
+// starts at the first triangle left in the level's order and grows over
+// triangles sharing its vertices, preferring those that add the fewest
+// vertices, then those close to it and facing its way (`cone_weight` trades
+// the two), until it is full or nothing adjacent fits. Each level's indices
+// are rewritten meshlet by meshlet, every meshlet cache-optimized and the
+// meshlets in optimize_overdraw's order, outer shell first; the levels keep
+// their ranges.
+void build_meshlets(mesh_data & mesh, float cone_weight = 0.5f);
+
+// Recomputes the meshlets' bones, spheres and cones from mesh.vertices, e.g.
+// once they have been quantized
+void compute_meshlet_bounds(mesh_data & mesh);
+
+#endif //MIXAMORENDERER_MESH_CLUSTER_H
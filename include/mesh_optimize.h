@@ -0,0 +1,48 @@
+#ifndef MIXAMORENDERER_MESH_OPTIMIZE_H
+#define MIXAMORENDERER_MESH_OPTIMIZE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "mesh.h"
+
+// Post-transform cache efficiency of an index buffer on a FIFO cache of
+// `cache_size` vertices: ACMR is vertex shader runs per triangle (0.5 at best
+// on a regular grid, 3 without reuse), ATVR runs per vertex (1 at best)
+struct vertex_cache_stats
+{
+    std::size_t transforms = 0;
+    double acmr = 0.;
+    double atvr = 0.;
+};
+
+vertex_cache_stats analyze_vertex_cache(std::vector<std::uint32_t> const & indices, std::size_t vertex_count,
+                                        int cache_size = 16);
+
+// Reorders triangles for the post-transform cache with Forsyth's greedy
+// algorithm: the next triangle is the one whose vertices score highest, which
+// favours vertices recently used and vertices with few triangles left
+std::vector<std::uint32_t> optimize_vertex_cache(std::vector<std::uint32_t> const & indices, std::size_t vertex_count);
+
+// Area-weighted centroid of the triangles in `indices`
+glm::vec3 surface_centre(std::uint32_t const * indices, std::size_t index_count, std::vector<vertex> const & vertices);
+
+// How far a group of triangles faces away from `mesh_centre`: the distance of
+// its centroid from the centre along its mean normal, positive for the outer
+// shell, which is drawn first
+float overdraw_sort_key(std::uint32_t const * indices, std::size_t index_count, std::vector<vertex> const & vertices,
+                        glm::vec3 mesh_centre);
+
+// Reorders clusters of a cache-optimized index buffer so that triangles facing
+// away from the mesh centre, which tend to hide the others, are drawn first.
+// Clusters start where the cache simulation misses all three vertices; the
+// new order is kept only when its ACMR stays within `threshold` of the input's.
+std::vector<std::uint32_t> optimize_overdraw(std::vector<std::uint32_t> const & indices,
+                                             std::vector<vertex> const & vertices, float threshold = 1.05f);
+
+// Sorts vertices by first use in the index buffer, so the vertex fetch walks
+// memory forwards, and remaps the indices. Unreferenced vertices go last.
+void optimize_vertex_fetch(std::vector<vertex> & vertices, std::vector<std::uint32_t> & indices);
+
+#endif //MIXAMORENDERER_MESH_OPTIMIZE_H
@@ -0,0 +1,42 @@
+#ifndef MIXAMORENDERER_MESH_SIMPLIFY_H
+#define MIXAMORENDERER_MESH_SIMPLIFY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "assets.h"
+#include "mesh.h"
+
+struct simplify_result
+{
+    std::vector<std::uint32_t> indices;
+    // largest distance, in mesh units, between the simplified surface and the
+    // input one in bind pose, measured both ways at the vertices and at points
+    // across the simplified triangles
+    float error = 0.f;
+};
+
+// Quadric edge collapse down to about `target_index_count` indices. Vertices
+// are only ever moved onto other vertices, so the result indexes the input
+// vertex array and every corner keeps real bone ids and weights.
+//
+// Vertices at one position with different attributes (the wedges of a seam
+// or hard edge) move together: each wedge of the removed vertex goes to the
+// wedge of the kept one with the closest normal and bones, and a collapse
+// that leaves a wedge without a match is not made, so seams and hard edges
+// stay where they are. Collapses are made cheapest first, and moving a
+// vertex onto one with other bone weights costs as if it moved the surface by
+// `skin_weight` of the bounds diagonal per unit of weight that changes bone,
+// so the borders between bones, where the skin deforms most, are kept until
+// the coarse levels. That cost only orders the collapses; the error reported
+// is the geometric one.
+simplify_result simplify_mesh(std::vector<vertex> const & vertices, std::vector<std::uint32_t> const & indices,
+                              std::size_t target_index_count, float skin_weight = 0.02f);
+
+// Replaces the mesh's levels of detail by `levels` of them: its first level,
+// then simplifications of it to half as many triangles each, every level
+// cache-optimized. Levels that cannot get simpler are left out.
+void build_lods(mesh_data & mesh, int levels);
+
+#endif //MIXAMORENDERER_MESH_SIMPLIFY_H
@@ -0,0 +1,51 @@
+#ifndef MIXAMORENDERER_MESHLET_CULLING_H
+#define MIXAMORENDERER_MESHLET_CULLING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+#include "assets.h"
+#include "skeleton.h"
+
+// Culls a level's meshlets against the posed character. A skinned vertex is a
+// blend of its bones' transforms of it, so it stays within the sphere around
+// the meshlet's sphere as each of its bones poses it; that sphere is tested
+// against every view's frustum. A meshlet weighted by a single bone moves
+// rigidly, so its normal cone turns with that bone, and it is dropped from a
+// view when it faces away from the camera there as a whole. Blended normals
+// can turn further than any of their bones, so meshlets with more bones are
+// never backface-culled.
+class meshlet_culler
+{
+public:
+    explicit meshlet_culler(mesh_data const & mesh);
+
+    // false when the level has no meshlets and is drawn whole
+    bool has_meshlets(int lod) const;
+    std::size_t meshlet_count(int lod) const;
+
+    // Fills `views_visible[v]` with the meshlets that may be visible in view
+    // `v` and `visible` with those visible in any view, as mesh_data::meshlets
+    // indices in index order
+    void cull(int lod, std::vector<bone_pose> const & bone_transforms, glm::mat4 const & model,
+              std::span<glm::mat4 const> view_projections, std::span<glm::vec3 const> camera_positions,
+              std::vector<std::uint32_t> & visible, std::vector<std::vector<std::uint32_t>> & views_visible) const;
+
+private:
+    struct level_range
+    {
+        std::uint32_t begin = 0;
+        std::uint32_t end = 0;
+    };
+
+    std::vector<meshlet> meshlets_;
+    std::vector<std::uint16_t> bones_;
+    std::vector<level_range> levels_;
+};
+
+#endif //MIXAMORENDERER_MESHLET_CULLING_H
@@ -0,0 +1,38 @@
+#ifndef MIXAMORENDERER_MULTIVIEW_H
+#define MIXAMORENDERER_MULTIVIEW_H
+
+#include <cstddef>
+#include <vector>
+
+#include <glm/mat4x4.hpp>
+
+// Tiles of one atlas framebuffer, one per camera; view 0 is the top-left tile
+struct view_layout
+{
+    int count = 1;
+    int columns = 1;
+    int rows = 1;
+    int tile_width = 0;
+    int tile_height = 0;
+
+    int atlas_width() const { return columns * tile_width; }
+    int atlas_height() const { return rows * tile_height; }
+
+    // lower-left corner of the tile in GL window coordinates
+    int tile_x(int view) const { return (view % columns) * tile_width; }
+    int tile_y(int view) const { return (rows - 1 - view / columns) * tile_height; }
+};
+
+view_layout make_view_layout(int count, int tile_width, int tile_height);
+
+// The viewer camera, orbited around the vertical axis by `orbit` radians
+glm::mat4 camera_view(float view_angle, float camera_distance, float camera_height, float orbit = 0.f);
+
+// Orbit of each view: the K cameras are spread evenly around the character
+float view_orbit(int view, int count);
+
+// Copies one tile out of an atlas read back with glReadPixels/glGetTexImage;
+// both keep GL's bottom-up row order. The tile comes from pixel_buffers()
+std::vector<char> extract_tile(std::vector<char> const & atlas, view_layout const & layout, int view, std::size_t pixel_size);
+
+#endif //MIXAMORENDERER_MULTIVIEW_H
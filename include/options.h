@@ -0,0 +1,106 @@
+#ifndef MIXAMORENDERER_OPTIONS_H
+#define MIXAMORENDERER_OPTIONS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "shard_format.h"
+#include "video_stream.h"
+#include "render_target.h"
+
+// --layer BONE:OFFSET[:WEIGHT]
+struct layer_option
+{
+    // root of the subtree the layer covers, numbered as in bones.bin
+    std::uint32_t bone = 0;
+    // seconds the layer's animation runs ahead of the base
+    float time_offset = 0.f;
+    float weight = 1.f;
+};
+
+struct render_options
+{
+    // interactive window size, or the offscreen size in batch mode
+    int width = 800;
+    int height = 600;
+
+    // batch mode: render this many frames with a fixed time step, capture each one and exit
+    int frames = 0;
+    float fps = 30.f;
+
+    // write captured frames into a shard instead of separate PNG files
+    std::string shard_path;
+    frame_format shard_format = frame_format::png;
+
+    // stream every rendered frame to a file, named pipe or stdout ("-")
+    std::string stream_path;
+    stream_format stream_type = stream_format::y4m;
+
+    // mesh file written by mixamo_mesh_convert, drawn instead of the asset directory's human.bin
+    std::string mesh_path;
+
+    // largest screen-space error in pixels of the level of detail drawn, 0 always draws full detail
+    float lod_error = 1.f;
+
+    // render this many cameras orbiting the character into tiles of one atlas
+    int views = 1;
+    // draw the tiles one by one even when viewport arrays are available
+    bool view_loop = false;
+
+    // aux_bit() mask of label targets written next to every captured frame
+    unsigned aux_targets = 0;
+
+    // write 3D joints and their projection in every view next to every captured frame
+    bool keypoints = false;
+
+    // scissor the draw to the character's screen bounds and capture only that rectangle
+    bool crop = false;
+    // pixels added around the bounds on every side
+    int crop_margin = 8;
+
+    // samples per pixel of the offscreen target, resolved before readback and display
+    int samples = 1;
+
+    // GPU memory kept in pooled render targets before idle ones are freed
+    int target_budget_mb = 256;
+
+    // post-processing passes applied, in order, to the displayed image
+    std::vector<std::string> post_effects;
+
+    // animation layers blended over the base animation, in order
+    std::vector<layer_option> layers;
+
+    // interactive mode: start with the animation paused (Space toggles it)
+    bool paused = false;
+
+    // print readback + convert throughput of every capture path over this many reads and exit
+    int bench_readback = 0;
+
+    // render this many frames of a seeded pose and camera sequence as a batch and report
+    // images/s, frame latency and where the time went; the first `bench_warmup` frames are
+    // not measured (-1: a tenth of them)
+    int bench_render = 0;
+    int bench_warmup = -1;
+    std::uint32_t bench_seed = 1;
+    std::string bench_json;
+
+    // print a memory line (heap, GL objects, RSS) every this many seconds and a summary at exit;
+    // 0 prints the summary only, negative nothing
+    float memory_stats = -1.f;
+
+    // job system threads besides the main one, -1 for one less than the hardware threads
+    int workers = -1;
+    // bind every worker thread to its own core
+    bool pin_threads = false;
+
+    // batch mode: frames animated ahead of the GL thread and frames of outputs in flight behind it;
+    // 0 runs animation, GL and output one after another
+    int pipeline_depth = 2;
+
+    bool batch() const { return frames > 0; }
+};
+
+render_options parse_options(int argc, char ** argv);
+
+#endif //MIXAMORENDERER_OPTIONS_H
@@ -0,0 +1,252 @@
+#ifndef MIXAMORENDERER_PIPELINE_H
+#define MIXAMORENDERER_PIPELINE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "assets.h"
+#include "crop.h"
+#include "job_system.h"
+#include "keypoints.h"
+#include "lod.h"
+#include "memory_stats.h"
+#include "meshlet_culling.h"
+#include "multiview.h"
+#include "options.h"
+#include "pose_evaluator.h"
+#include "readback.h"
+#include "skeleton.h"
+#include "spsc_queue.h"
+
+struct camera_state
+{
+    float view_angle = 0.f;
+    float camera_distance = 0.f;
+    float camera_height = 0.f;
+    float model_rotation = 0.f;
+};
+
+// Everything the GL thread needs to draw one frame, computed ahead of it by
+// the animation stage
+struct frame_job
+{
+    std::uint64_t frame_id = 0;
+    bool capture = false;
+    float time = 0.f;
+
+    std::vector<bone_pose> bone_transforms;
+    // bones whose pose had to be recomputed for this frame
+    std::size_t bones_evaluated = 0;
+    glm::mat4 model{1.f};
+    glm::mat4 projection{1.f};
+    // level of detail to draw, and the meshlets of it to draw in any view and in each one
+    int lod = 0;
+    std::vector<std::uint32_t> meshlets;
+    std::vector<std::vector<std::uint32_t>> view_meshlets;
+    std::vector<glm::mat4> views;
+    std::vector<glm::vec3> camera_positions;
+    std::vector<glm::mat4> view_projections;
+
+    // crops are relative to the top-left of their tile, scissors are the same rectangles in GL atlas coordinates
+    std::vector<pixel_rect> crops;
+    std::vector<pixel_rect> scissors;
+
+    // one JSON line for a captured frame with keypoints, empty otherwise
+    std::string keypoints_json;
+};
+
+// The CPU side of a frame: bone palette, cameras, crop bounds, level of
+// detail, visible meshlets and keypoints. Reads the skeleton and poses only,
+// so it can run as a job off the GL thread, one frame after the other.
+class frame_simulator
+{
+public:
+    frame_simulator(character_assets const & character, std::vector<float> const & radii, lod_selector const & lods, meshlet_culler const & culler,
+                    render_options const & options);
+
+    // Fills `job` for its time, frame id and capture flag
+    void run(frame_job & job, camera_state const & camera, view_layout const & views);
+
+private:
+    character_assets const & character_;
+    std::vector<float> const & radii_;
+    lod_selector const & lods_;
+    meshlet_culler const & culler_;
+    render_options const & options_;
+
+    // the palette carries over between frames, only what the animation moved is re-posed
+    pose_evaluator poses_;
+    std::vector<animation_layer> layers_;
+    joint_batch joints_;
+    std::vector<keypoint> keypoints_;
+    // keypoints list the joints by their id in bones.bin
+    std::vector<std::uint32_t> keypoint_order_;
+};
+
+// A readback, or the side files of a frame, on its way to be encoded and written
+struct output_job
+{
+    enum kind_t
+    {
+        color,
+        aux,
+        metadata,
+    };
+
+    kind_t kind = color;
+    std::uint64_t frame_id = 0;
+    // aux target index
+    int target = 0;
+    // color: the cropped view this readback holds, or -1 for the whole atlas
+    int view = -1;
+    // color atlas: write its tiles as captures, push it to the stream
+    bool capture = false;
+    bool stream = false;
+    readback_result image;
+    // color captures: the converted and encoded tile of each view, or the one cropped view,
+    // and how long that took
+    std::vector<std::vector<char>> encoded;
+    std::chrono::steady_clock::duration encode_time{};
+
+    // metadata: keypoints line and crop rectangles of a captured frame
+    std::string keypoints_json;
+    std::vector<pixel_rect> crops;
+};
+
+// A stage hand-off between the GL thread and a chain of jobs on the pool: a
+// bounded single-producer/single-consumer queue, plus the job that last filled
+// or drained each slot. Whichever side the GL thread is on, it never blocks in
+// the queue itself. Before pushing item n it waits for the job that drained
+// that slot a lap earlier, before popping item n for the job that pushed it,
+// and runs other jobs while it waits, so the queue makes progress without
+// workers. The jobs on the other side use queue() directly. They are spawned
+// after the GL thread's end_push(), or once there is room for what they push,
+// so they do not block in it either.
+template <typename T>
+class job_queue
+{
+public:
+    job_queue(job_system & jobs, std::size_t capacity)
+        : jobs_(jobs)
+        , queue_(capacity)
+    {
+        memory_scope scope(memory_category::queues);
+        handles_.resize(capacity);
+    }
+
+    // the jobs reference the slots, so they have to finish first; when the
+    // queue is torn down by an error, theirs are dropped
+    ~job_queue()
+    {
+        for (auto const & handle : handles_)
+        {
+            try
+            {
+                jobs_.wait(handle);
+            }
+            catch (...)
+            {
+            }
+        }
+    }
+
+    job_queue(job_queue const &) = delete;
+    job_queue & operator = (job_queue const &) = delete;
+
+    std::size_t capacity() const { return queue_.capacity(); }
+    spsc_queue<T> & queue() { return queue_; }
+
+    // Records `job` as the one that fills or drains item `n`
+    void track(std::uint64_t n, job_handle job) { handles_[n % handles_.size()] = std::move(job); }
+
+    // GL thread producing: the slot of item `n`; rethrows what its last job threw
+    T & begin_push(std::uint64_t n)
+    {
+        wait_for(n, full_wait_);
+        return *queue_.begin_push();
+    }
+    void end_push() { queue_.end_push(); }
+
+    // GL thread consuming: item `n` once its job has pushed it; rethrows what the job threw
+    T & begin_pop(std::uint64_t n)
+    {
+        wait_for(n, empty_wait_);
+        return *queue_.begin_pop();
+    }
+    void end_pop() { queue_.end_pop(); }
+
+    // Waits for every tracked job, rethrowing the first error
+    void drain()
+    {
+        for (auto const & handle : handles_)
+            jobs_.wait(handle);
+    }
+
+    // The queue's occupancy and waits, the GL thread's waits on jobs included
+    queue_stats stats() const
+    {
+        queue_stats stats = queue_.stats();
+        stats.full_wait += full_wait_;
+        stats.empty_wait += empty_wait_;
+        return stats;
+    }
+
+private:
+    void wait_for(std::uint64_t n, std::chrono::steady_clock::duration & waited)
+    {
+        auto const & handle = handles_[n % handles_.size()];
+        auto start = std::chrono::steady_clock::now();
+        bool ready = handle.done();
+        jobs_.wait(handle);
+        if (!ready)
+            waited += std::chrono::steady_clock::now() - start;
+    }
+
+    job_system & jobs_;
+    spsc_queue<T> queue_;
+    std::vector<job_handle> handles_;
+    std::chrono::steady_clock::duration full_wait_{};
+    std::chrono::steady_clock::duration empty_wait_{};
+};
+
+// Time the jobs of one stage ran, summed over the threads that ran them
+class stage_clock
+{
+public:
+    void add(std::chrono::steady_clock::duration time) { ticks_.fetch_add(time.count(), std::memory_order_relaxed); }
+    std::chrono::steady_clock::duration total() const { return std::chrono::steady_clock::duration(ticks_.load()); }
+
+private:
+    std::atomic<std::chrono::steady_clock::rep> ticks_{0};
+};
+
+// A stage that runs as jobs reports the time they ran and no waits; its busy
+// share can pass 100% when its jobs run on several threads at once
+struct stage_report
+{
+    char const * name;
+    std::chrono::steady_clock::duration elapsed;
+    // waiting for an item from upstream, for room downstream
+    std::chrono::steady_clock::duration input_wait;
+    std::chrono::steady_clock::duration output_wait;
+};
+
+struct queue_report
+{
+    char const * name;
+    std::size_t capacity;
+    queue_stats stats;
+};
+
+void print_pipeline_stats(std::ostream & out, std::uint64_t frames, std::chrono::steady_clock::duration wall,
+                          std::span<stage_report const> stages, std::span<queue_report const> queues);
+
+#endif //MIXAMORENDERER_PIPELINE_H
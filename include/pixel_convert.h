@@ -0,0 +1,40 @@
+#ifndef MIXAMORENDERER_PIXEL_CONVERT_H
+#define MIXAMORENDERER_PIXEL_CONVERT_H
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <vector>
+
+// Layout color is read back in: 4 bytes per pixel, RGBA or BGRA order
+struct read_layout
+{
+    GLenum format = GL_RGBA;
+    GLenum type = GL_UNSIGNED_BYTE;
+
+    bool bgra() const { return format == GL_BGRA; }
+};
+
+// The implementation's preferred layout for the bound read framebuffer
+// (GL_IMPLEMENTATION_COLOR_READ_FORMAT/TYPE) when it is 8-bit RGBA or BGRA,
+// plain RGBA otherwise. Reading in it lets the driver skip its own conversion.
+read_layout native_read_layout();
+
+// Reads a rectangle of the current read buffer; rows are bottom-up and, with
+// 4 bytes per pixel, always meet the default pack alignment
+std::vector<char> read_pixels(int x, int y, int width, int height, read_layout layout = {});
+
+// Converts 4-byte pixels to RGBA (channels = 4) or RGB (channels = 3) in one
+// pass, swapping R and B of BGRA input. Source row y starts at src + y * stride,
+// so a negative stride turns a bottom-up GL image top-down. Output rows are tightly packed.
+void convert_pixels(char const * src, std::ptrdiff_t stride, int width, int height, bool bgra, int channels, char * dst);
+
+// Same conversion without SIMD, the reference for convert_pixels
+void convert_pixels_scalar(char const * src, std::ptrdiff_t stride, int width, int height, bool bgra, int channels, char * dst);
+
+// Converts the width x height region at (x, y) of a bottom-up image that is
+// `row_length` pixels wide into a top-down image, in a buffer from pixel_buffers()
+std::vector<char> convert_region(std::vector<char> const & pixels, int row_length, int x, int y, int width, int height,
+                                 bool bgra, int channels);
+
+#endif //MIXAMORENDERER_PIXEL_CONVERT_H
@@ -0,0 +1,91 @@
+#ifndef MIXAMORENDERER_POSE_EVALUATOR_H
+#define MIXAMORENDERER_POSE_EVALUATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "skeleton.h"
+
+// The bones an animation layer covers, as a bitset, and its weight on each;
+// bones outside the set have weight 0
+struct bone_mask
+{
+    std::vector<std::uint64_t> bits;
+    std::vector<float> weights;
+
+    explicit bone_mask(std::size_t bone_count = 0);
+
+    // a weight of 0 takes the bone out of the set
+    void set(std::uint32_t bone, float weight);
+    bool covers(std::uint32_t bone) const { return bits[bone / 64] >> (bone % 64) & 1; }
+};
+
+// A clip played over the layers below it: its key poses cycle one per second
+// like the character's, `time_offset` seconds ahead of the base clip, and are
+// blended in local space by the mask's weights
+struct animation_layer
+{
+    std::vector<std::vector<bone_pose>> const * clip = nullptr;
+    float time_offset = 0.f;
+    bone_mask mask;
+};
+
+// Keeps a skeleton's palette from frame to frame and re-poses only what
+// changed. Each bone's local pose (the two poses relative to its parent and
+// the factor blending them) is compared with the one it was last posed with;
+// a bone whose local pose changed is dirty, and so is its whole subtree. The
+// bones are also numbered depth-first, so every subtree is one range of that
+// order, and evaluate() walks the ranges of the dirty bones only.
+class pose_evaluator
+{
+public:
+    // `bones` in breadth-first order, as load_character leaves them
+    explicit pose_evaluator(std::vector<bone> const & bones);
+
+    // Sets the bone's local pose for the next evaluate(); roots take `from`
+    // as it is. Marks the bone dirty unless the pose is the one it has.
+    void set_local_pose(std::uint32_t bone, bone_pose const & from, bone_pose const & to, float blend);
+
+    // Every bone's local pose for key pose `n` blended towards the next one
+    // by the smoothstep of `t`
+    void set_key_poses(std::vector<std::vector<bone_pose>> const & poses, int n, float t);
+
+    // Every bone's local pose for `clip` at `time` with `layers` on top, in
+    // one pass over the bones. A bone no layer covers gets the pose
+    // set_key_poses gives it; a layer is only sampled for the bones it covers.
+    void set_layered_poses(std::vector<std::vector<bone_pose>> const & clip, float time,
+                           std::span<animation_layer const> layers);
+
+    // The bone and its descendants, with `weight` each
+    bone_mask subtree_mask(std::uint32_t bone, float weight) const;
+
+    // Re-poses the dirty bones and their descendants; returns how many it posed
+    std::size_t evaluate();
+
+    std::vector<bone_pose> const & palette() const { return palette_; }
+    std::size_t bone_count() const { return palette_.size(); }
+
+private:
+    struct local_pose
+    {
+        bone_pose from;
+        bone_pose to;
+        float blend = 0.f;
+    };
+
+    std::vector<std::int32_t> parents_;
+    std::vector<local_pose> locals_;
+    std::vector<bone_pose> palette_;
+
+    // bones in depth-first order, the end of the subtree starting at each
+    // position, and each bone's position
+    std::vector<std::uint32_t> depth_first_;
+    std::vector<std::uint32_t> subtree_ends_;
+    std::vector<std::uint32_t> positions_;
+    // by depth-first position
+    std::vector<std::uint8_t> dirty_;
+};
+
+#endif //MIXAMORENDERER_POSE_EVALUATOR_H
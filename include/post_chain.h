@@ -0,0 +1,59 @@
+#ifndef MIXAMORENDERER_POST_CHAIN_H
+#define MIXAMORENDERER_POST_CHAIN_H
+
+#include <GL/glew.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "render_target.h"
+
+// A fullscreen pass: a fragment shader sampling the previous image as renderedTexture
+struct post_effect
+{
+    const char * name;
+    const char * fragment_source;
+};
+
+// nullptr for an unknown name
+post_effect const * find_post_effect(std::string_view name);
+
+// Opt-in post-processing for the displayed image. Each effect draws a
+// fullscreen quad into an intermediate texture, the last one into the output
+// framebuffer. Without effects the chain is empty and nothing is drawn.
+class post_chain
+{
+public:
+    explicit post_chain(std::vector<std::string> const & effects);
+    ~post_chain();
+
+    post_chain(post_chain const &) = delete;
+    post_chain & operator = (post_chain const &) = delete;
+
+    bool empty() const { return passes_.empty(); }
+
+    // Runs the effects over the color of `source`, writing the result to `output` at width x height
+    void apply(render_target const & source, GLuint output, int width, int height, float time);
+
+private:
+    struct pass
+    {
+        GLuint program = 0;
+        GLint texture_location = -1;
+        GLint time_location = -1;
+        GLint uv_scale_location = -1;
+    };
+
+    void resize(int width, int height);
+
+    std::vector<pass> passes_;
+    GLuint vao_ = 0;
+    GLuint vbo_ = 0;
+    GLuint framebuffer_ = 0;
+    GLuint textures_[2] = {};
+    int width_ = 0;
+    int height_ = 0;
+};
+
+#endif //MIXAMORENDERER_POST_CHAIN_H
@@ -0,0 +1,63 @@
+#ifndef MIXAMORENDERER_READBACK_H
+#define MIXAMORENDERER_READBACK_H
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+struct readback_result
+{
+    std::uint64_t tag;
+    int x;
+    int y;
+    int width;
+    int height;
+    // bottom-up rows, tightly packed, in a buffer from pixel_buffers()
+    std::vector<char> pixels;
+};
+
+// Reads the current read buffer into pixel pack buffers guarded by fences, so
+// glReadPixels returns immediately and the copy is collected frames later.
+class async_readback
+{
+public:
+    // `name` is what the readback reads, for errors
+    explicit async_readback(char const * name) : name_(name) {}
+    ~async_readback();
+
+    async_readback(async_readback const &) = delete;
+    async_readback & operator = (async_readback const &) = delete;
+
+    void start(std::uint64_t tag, int x, int y, int width, int height, GLenum format, GLenum type, std::size_t pixel_size);
+
+    // Returns the oldest readback once the GPU is done with it; with `wait` blocks until it is.
+    // Throws std::runtime_error when its buffer cannot be mapped or loses its contents.
+    std::optional<readback_result> poll(bool wait = false);
+
+    bool pending() const { return !in_flight_.empty(); }
+    std::size_t in_flight() const { return in_flight_.size(); }
+
+private:
+    struct slot
+    {
+        GLuint buffer = 0;
+        std::size_t capacity = 0;
+        std::size_t size = 0;
+        GLsync fence = nullptr;
+        std::uint64_t tag = 0;
+        int x = 0;
+        int y = 0;
+        int width = 0;
+        int height = 0;
+    };
+
+    char const * name_;
+    // oldest first; a handful of slots, kept in vectors so steady frames do not allocate
+    std::vector<slot> in_flight_;
+    std::vector<slot> free_;
+};
+
+#endif //MIXAMORENDERER_READBACK_H
@@ -0,0 +1,14 @@
+#ifndef MIXAMORENDERER_READBACK_BENCH_H
+#define MIXAMORENDERER_READBACK_BENCH_H
+
+#include <ostream>
+
+#include "render_target.h"
+
+// Reads the color target back `iterations` times through every capture path
+// (legacy texture read, RGBA and native layouts, scalar and SIMD conversion,
+// RGBA and RGB output) and prints readback, convert and combined MB/s of the
+// frame's RGBA size
+void bench_readback(render_target const & target, int iterations, std::ostream & out);
+
+#endif //MIXAMORENDERER_READBACK_BENCH_H
@@ -0,0 +1,122 @@
+#ifndef MIXAMORENDERER_RENDER_BENCH_H
+#define MIXAMORENDERER_RENDER_BENCH_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "pipeline.h"
+
+// Time and camera of frame `index` of a seeded benchmark sequence: a random key
+// pose blend seen from a random distance, height and turn. Depends on nothing
+// but its arguments, so every run and thread layout renders the same frames.
+void bench_frame(std::uint32_t seed, std::uint64_t index, float & time, camera_state & camera);
+
+enum class bench_stage
+{
+    animation,
+    upload,
+    draw,
+    readback,
+    encode,
+    write,
+};
+
+constexpr int bench_stage_count = 6;
+
+char const * bench_stage_name(bench_stage stage);
+
+// Per-frame timings of a render benchmark. Records are preallocated; each field
+// of a frame is written by a single stage and the job dependencies between the
+// stages order the accesses, so recording needs no locks. Encodes run at once,
+// their times are added by the writes that follow them.
+class frame_profiler
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    explicit frame_profiler(std::size_t frames);
+
+    // The animation stage starts on the frame
+    void start(std::uint64_t frame);
+    void add(std::uint64_t frame, bench_stage stage, clock::duration time);
+    // An output of the frame has been written; the last one finishes it
+    void finish(std::uint64_t frame);
+
+    struct record
+    {
+        clock::time_point start;
+        clock::time_point finish;
+        std::array<clock::duration, bench_stage_count> stages{};
+    };
+
+    std::vector<record> const & frames() const { return frames_; }
+
+private:
+    std::vector<record> frames_;
+};
+
+// Adds the time until it goes out of scope to a stage of a frame; does nothing without a profiler
+class stage_timer
+{
+public:
+    stage_timer(frame_profiler * profiler, std::uint64_t frame, bench_stage stage)
+        : profiler_(profiler)
+        , frame_(frame)
+        , stage_(stage)
+    {
+        if (profiler_)
+            start_ = frame_profiler::clock::now();
+    }
+
+    ~stage_timer()
+    {
+        if (profiler_)
+            profiler_->add(frame_, stage_, frame_profiler::clock::now() - start_);
+    }
+
+    stage_timer(stage_timer const &) = delete;
+    stage_timer & operator = (stage_timer const &) = delete;
+
+private:
+    frame_profiler * profiler_;
+    std::uint64_t frame_;
+    bench_stage stage_;
+    frame_profiler::clock::time_point start_;
+};
+
+// Runs `f` and adds its time to a stage of a frame
+template <typename F>
+decltype(auto) timed_stage(frame_profiler * profiler, std::uint64_t frame, bench_stage stage, F && f)
+{
+    stage_timer timer(profiler, frame, stage);
+    return f();
+}
+
+struct render_bench_summary
+{
+    std::uint64_t frames = 0;
+    std::uint64_t warmup = 0;
+    int views = 1;
+    int width = 0;
+    int height = 0;
+    std::uint32_t seed = 0;
+
+    double images_per_second = 0.;
+    double latency_p50_ms = 0.;
+    double latency_p99_ms = 0.;
+    double latency_mean_ms = 0.;
+    // mean per measured frame
+    std::array<double, bench_stage_count> stage_ms{};
+};
+
+// Throughput over the frames after the first `warmup`, from the finish of the last
+// warm-up frame to the finish of the last frame; latency from start to finish of each frame
+render_bench_summary summarize_render_bench(frame_profiler const & profiler, std::uint64_t warmup, int views);
+
+void print_render_bench(std::ostream & out, render_bench_summary const & summary);
+void write_render_bench_json(std::ostream & out, render_bench_summary const & summary);
+
+#endif //MIXAMORENDERER_RENDER_BENCH_H
@@ -0,0 +1,111 @@
+#ifndef MIXAMORENDERER_RENDER_TARGET_H
+#define MIXAMORENDERER_RENDER_TARGET_H
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+
+// Optional label targets written by the same draw as the color; attachment i + 1
+enum aux_target
+{
+    aux_depth,
+    aux_normals,
+    aux_bones,
+    aux_target_count,
+};
+
+struct aux_target_spec
+{
+    const char * name;
+    GLenum internal_format;
+    GLenum format;
+    GLenum type;
+    std::size_t pixel_size;
+};
+
+aux_target_spec const & aux_spec(int target);
+
+constexpr unsigned aux_bit(int target) { return 1u << target; }
+
+// Offscreen framebuffer with an RGBA8 color texture, a depth renderbuffer and
+// the aux targets selected by aux_mask. The attachments are storage_width x
+// storage_height; frames use the width x height corner at the origin. With
+// samples > 1 the textures are multisampled and are read back or sampled
+// through a copy made by resolve_render_target.
+struct render_target
+{
+    GLuint framebuffer = 0;
+    GLuint color = 0;
+    GLuint depth = 0;
+    GLuint aux[aux_target_count] = {};
+    unsigned aux_mask = 0;
+    int samples = 1;
+    int width = 0;
+    int height = 0;
+    int storage_width = 0;
+    int storage_height = 0;
+};
+
+render_target create_render_target(int width, int height, unsigned aux_mask = 0, int samples = 1);
+
+// Reallocates the attachments at exactly width x height
+void resize_render_target(render_target & target, int width, int height);
+
+void destroy_render_target(render_target & target);
+
+// Blits the width x height corner of every attachment of a multisampled target
+// into the single-sample `resolved`, which has the same aux targets and at
+// least that size. Color samples are averaged, integer labels take one sample.
+void resolve_render_target(render_target const & source, render_target & resolved);
+
+// Approximate GPU memory of the target's attachments
+std::size_t render_target_bytes(render_target const & target);
+
+// The largest width or height a render target can have: the smaller of the
+// driver's texture and renderbuffer limits
+int max_render_target_size();
+
+// The most samples a render target with `aux_mask` can have: GL_MAX_SAMPLES,
+// lowered by the limits of multisampled color textures and, for the bones
+// target, of integer ones
+int max_render_target_samples(unsigned aux_mask);
+
+// Keeps released render targets for reuse, keyed by (aux mask, storage size,
+// samples). Storage sizes are rounded up to powers of two, so nearby sizes,
+// e.g. during a window drag, share one target. Idle targets are evicted least
+// recently used first once all targets together exceed the memory budget.
+class render_target_pool
+{
+public:
+    explicit render_target_pool(std::size_t budget_bytes);
+    ~render_target_pool();
+
+    render_target_pool(render_target_pool const &) = delete;
+    render_target_pool & operator = (render_target_pool const &) = delete;
+
+    // A target whose width x height is the requested size; throws if either
+    // exceeds max_render_target_size()
+    render_target acquire(int width, int height, unsigned aux_mask = 0, int samples = 1);
+
+    void release(render_target target);
+
+    // Memory of all targets created by the pool and not evicted yet, in use or idle
+    std::size_t allocated_bytes() const { return allocated_; }
+    std::size_t idle_count() const { return idle_.size(); }
+
+private:
+    void evict();
+
+    std::size_t budget_;
+    std::size_t allocated_ = 0;
+    int max_size_;
+    // most recently released first
+    std::list<render_target> idle_;
+};
+
+// Clears the color, depth and aux targets of the bound render target
+void clear_render_target(render_target const & target);
+
+#endif //MIXAMORENDERER_RENDER_TARGET_H
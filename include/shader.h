@@ -7,10 +7,16 @@
 
 #include <GL/glew.h>
 #include <string>
+#include <string_view>
 #include <stdexcept>
 
 GLuint create_shader(GLenum type, const char * source);
 
+// Compiles the source with `defines` (e.g. "#define MULTIVIEW\n") inserted after its #version line
+GLuint create_shader(GLenum type, const char * source, std::string_view defines);
+
 GLuint create_program(GLuint vertex_shader, GLuint fragment_shader);
 
+GLuint create_program(GLuint vertex_shader, GLuint geometry_shader, GLuint fragment_shader);
+
 #endif //MIXAMORENDERER_SHADER_H
@@ -12,17 +12,40 @@ uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
-uniform vec3 bone_translation[61];
-uniform vec4 bone_rotation[61];
-uniform float bone_scale[61];
+// BONE_COUNT bones: rotations as (w, x, y, z), translations with the scale in w;
+// the skeleton is sorted on load, labels keep the bone ids of bones.bin
+layout (std140) uniform bone_palette
+{
+    vec4 bone_rotation[BONE_COUNT];
+    vec4 bone_translation_scale[BONE_COUNT];
+    uvec4 source_bone_ids[(BONE_COUNT + 3) / 4];
+};
+
+#ifdef COMPACT_VERTICES
+// positions are 16-bit fractions of the mesh bounds, normals octahedral-encoded
+uniform vec3 mesh_bounds_min;
+uniform vec3 mesh_bounds_extent;
 
+layout (location = 0) in vec3 in_position_unorm;
+layout (location = 1) in vec2 in_normal_octahedral;
+#else
 layout (location = 0) in vec3 in_position;
 layout (location = 1) in vec3 in_normal;
+#endif
+#if BONE_INFLUENCES == 4
+layout (location = 2) in ivec4 in_bone_id;
+layout (location = 3) in vec4 in_bone_weight;
+#else
 layout (location = 2) in ivec2 in_bone_id;
 layout (location = 3) in vec2 in_bone_weight;
+#endif
 
-out vec3 normal;
-out vec3 position;
+out vertex_data
+{
+    vec3 normal;
+    vec3 position;
+    flat uint bone_id;
+} vs_out;
 
 vec4 quat_mult(vec4 q1, vec4 q2)
 {
@@ -39,49 +62,117 @@ vec3 quat_rotate(vec4 q, vec3 v)
 	return quat_mult(q, quat_mult(vec4(0.0, v), quat_conj(q))).yzw;
 }
 
+vec3 bone_transform(int id, vec3 pos) {
+    return bone_translation_scale[id].w * quat_rotate(bone_rotation[id], pos) + bone_translation_scale[id].xyz;
+}
+
+vec3 bone_transform_normal(int id, vec3 norm) {
+    return bone_translation_scale[id].w * quat_rotate(bone_rotation[id], norm);
+}
+
 vec3 transform_bone(vec3 pos) {
-    vec3 res = in_bone_weight.x *
-        (bone_scale[in_bone_id.x] * quat_rotate(bone_rotation[in_bone_id.x], pos) + bone_translation[in_bone_id.x]) +
-        in_bone_weight.y *
-        (bone_scale[in_bone_id.y] * quat_rotate(bone_rotation[in_bone_id.y], pos) + bone_translation[in_bone_id.y]);
+    vec3 res = in_bone_weight.x * bone_transform(in_bone_id.x, pos) + in_bone_weight.y * bone_transform(in_bone_id.y, pos);
+#if BONE_INFLUENCES == 4
+    res += in_bone_weight.z * bone_transform(in_bone_id.z, pos) + in_bone_weight.w * bone_transform(in_bone_id.w, pos);
+#endif
     return res;
 }
 
 vec3 transform_bone_normal(vec3 norm) {
-    vec3 res = in_bone_weight.x *
-           (bone_scale[in_bone_id.x] * quat_rotate(bone_rotation[in_bone_id.x], norm)) +
-           in_bone_weight.y *
-           (bone_scale[in_bone_id.y] * quat_rotate(bone_rotation[in_bone_id.y], norm));
+    vec3 res = in_bone_weight.x * bone_transform_normal(in_bone_id.x, norm)
+        + in_bone_weight.y * bone_transform_normal(in_bone_id.y, norm);
+#if BONE_INFLUENCES == 4
+    res += in_bone_weight.z * bone_transform_normal(in_bone_id.z, norm)
+        + in_bone_weight.w * bone_transform_normal(in_bone_id.w, norm);
+#endif
     return res;
 }
 
+// the heaviest influence, the first of equal ones
+int dominant_bone() {
+    int dominant = 0;
+    for (int k = 1; k < BONE_INFLUENCES; ++k)
+        if (in_bone_weight[k] > in_bone_weight[dominant])
+            dominant = k;
+    return in_bone_id[dominant];
+}
+
+#ifdef COMPACT_VERTICES
+vec3 octahedral_decode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float fold = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -fold : fold, n.y >= 0.0 ? -fold : fold);
+    return normalize(n);
+}
+#endif
+
 void main()
 {
+#ifdef COMPACT_VERTICES
+    vec3 in_position = mesh_bounds_min + in_position_unorm * mesh_bounds_extent;
+    vec3 in_normal = octahedral_decode(in_normal_octahedral);
+#endif
     vec3 b_pos = transform_bone(in_position);
     vec3 b_norm = transform_bone_normal(in_normal);
+#ifdef MULTIVIEW
+	// the geometry shader applies the per-view transforms
+	gl_Position = model * vec4(b_pos, 1.0);
+#else
 	gl_Position = projection * view * model * vec4(b_pos, 1.0);
-	position = (model * vec4(b_pos, 1.0)).xyz;
-	normal = normalize((model * vec4(b_norm, 0.0)).xyz);
+#endif
+	vs_out.position = (model * vec4(b_pos, 1.0)).xyz;
+	vs_out.normal = normalize((model * vec4(b_norm, 0.0)).xyz);
+	int bone = dominant_bone();
+	vs_out.bone_id = source_bone_ids[bone / 4][bone % 4];
 }
 )";
 
 const char fragment_shader_source[] =
         R"(#version 330 core
 
+#ifdef MULTIVIEW
+uniform vec3 view_camera_position[VIEW_COUNT];
+flat in int view_index;
+#else
 uniform vec3 camera_position;
+#endif
 
 uniform vec3 ambient;
 
 uniform vec3 light_direction;
 uniform vec3 light_color;
 
-in vec3 normal;
-in vec3 position;
+in vertex_data
+{
+    vec3 normal;
+    vec3 position;
+    flat uint bone_id;
+} fs_in;
 
 layout (location = 0) out vec4 out_color;
 
+#ifdef AUX_TARGETS
+#ifdef MULTIVIEW
+uniform mat4 view_matrix[VIEW_COUNT];
+#else
+uniform mat4 view;
+#endif
+
+// outputs without an attachment are dropped by glDrawBuffers
+layout (location = 1) out float out_depth;
+layout (location = 2) out vec4 out_normal;
+layout (location = 3) out uint out_bone;
+#endif
+
 void main()
 {
+#ifdef MULTIVIEW
+	vec3 camera_position = view_camera_position[view_index];
+#endif
+	vec3 normal = fs_in.normal;
+	vec3 position = fs_in.position;
+
 	vec3 reflected = 2.0 * normal * dot(normal, light_direction) - light_direction;
 	vec3 camera_direction = normalize(camera_position - position);
 
@@ -90,6 +181,63 @@ void main()
 	vec3 light = ambient + light_color * (max(0.0, dot(normal, light_direction)) + pow(max(0.0, dot(camera_direction, reflected)), 64.0));
 	vec3 color = albedo * light;
 	out_color = vec4(color, 1.0);
+
+#ifdef AUX_TARGETS
+#ifdef MULTIVIEW
+	mat4 eye = view_matrix[view_index];
+#else
+	mat4 eye = view;
+#endif
+	out_depth = -(eye * vec4(position, 1.0)).z;
+	out_normal = vec4(normalize(mat3(eye) * normal) * 0.5 + 0.5, 1.0);
+	out_bone = fs_in.bone_id;
+#endif
+}
+)";
+
+// Replicates each triangle into VIEW_COUNT viewports of the atlas;
+// VIEW_VERTEX_COUNT is 3 * VIEW_COUNT, layout qualifiers need a literal
+const char multiview_geometry_shader_source[] =
+        R"(#version 330 core
+#extension GL_ARB_viewport_array : require
+
+layout (triangles) in;
+layout (triangle_strip, max_vertices = VIEW_VERTEX_COUNT) out;
+
+uniform mat4 view_projection[VIEW_COUNT];
+
+in vertex_data
+{
+    vec3 normal;
+    vec3 position;
+    flat uint bone_id;
+} gs_in[];
+
+out vertex_data
+{
+    vec3 normal;
+    vec3 position;
+    flat uint bone_id;
+} gs_out;
+
+flat out int view_index;
+
+void main()
+{
+	for (int view = 0; view < VIEW_COUNT; ++view)
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			gl_ViewportIndex = view;
+			view_index = view;
+			gs_out.normal = gs_in[i].normal;
+			gs_out.position = gs_in[i].position;
+			gs_out.bone_id = gs_in[i].bone_id;
+			gl_Position = view_projection[view] * gl_in[i].gl_Position;
+			EmitVertex();
+		}
+		EndPrimitive();
+	}
 }
 )";
 
@@ -99,10 +247,13 @@ layout(location = 0) in vec3 pos;
 
 out vec2 UV;
 
+// fraction of the input texture holding the image
+uniform vec2 uv_scale;
+
 void main(){
 	gl_Position =  vec4(pos, 1);
 //	UV = (gl_Position.xy+vec2(1,1))/2.0;
-    UV = (gl_Position.xy + 1)/2.0;
+    UV = (gl_Position.xy + 1)/2.0 * uv_scale;
 }
 )";
 
@@ -122,4 +273,33 @@ void main(){
 }
 )";
 
+// Post-processing passes share the rect vertex shader and sample renderedTexture
+const char gamma_fragment_shader_source[] =
+        R"(#version 330 core
+
+in vec2 UV;
+
+out vec3 color;
+
+uniform sampler2D renderedTexture;
+
+void main(){
+    color = pow(texture(renderedTexture, UV).rgb, vec3(1.0 / 2.2));
+}
+)";
+
+const char grayscale_fragment_shader_source[] =
+        R"(#version 330 core
+
+in vec2 UV;
+
+out vec3 color;
+
+uniform sampler2D renderedTexture;
+
+void main(){
+    color = vec3(dot(texture(renderedTexture, UV).rgb, vec3(0.299, 0.587, 0.114)));
+}
+)";
+
 #endif //MIXAMORENDERER_SHADER_SOURCES_H
@@ -0,0 +1,53 @@
+#ifndef MIXAMORENDERER_SKELETON_H
+#define MIXAMORENDERER_SKELETON_H
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+struct bone
+{
+    std::int32_t parent_id;
+    glm::vec3 offset;
+    glm::quat rotation;
+};
+
+struct bone_pose
+{
+    glm::quat rotation = glm::quat(1.f, 0.f, 0.f, 0.f);
+    float scale = 1.f;
+    glm::vec3 translation = glm::vec3(0.f, 0.f, 0.f);
+
+    bool operator == (bone_pose const &) const = default;
+};
+
+bone_pose operator * (bone_pose const & p1, bone_pose const & p2);
+
+glm::vec3 operator * (bone_pose const & p, glm::vec3 const & v);
+
+// Breadth-first order of a skeleton: the roots, then their children, then
+// theirs, with the children of a bone next to each other
+struct bone_order
+{
+    // the id each bone of the new order has in the asset files
+    std::vector<std::uint32_t> source_ids;
+    // depth d holds bones [level_starts[d], level_starts[d + 1])
+    std::vector<std::uint32_t> level_starts;
+};
+
+// Throws std::runtime_error when a parent id is out of range or the parents form a cycle
+bone_order sort_bones_breadth_first(std::vector<bone> const & bones);
+
+// `bones` in the new order, with their parent ids renumbered
+std::vector<bone> reorder_bones(std::vector<bone> const & bones, bone_order const & order);
+
+// Slerps the rotations and lerps the translations and scales
+bone_pose blend_poses(bone_pose const & p0, bone_pose const & p1, float s);
+
+// A child's pose under its posed parent: the parent's pose times `from` and
+// times `to`, blended by `s`. The two are not blended when they are the same.
+bone_pose pose_child(bone_pose const & parent, bone_pose const & from, bone_pose const & to, float s);
+
+#endif //MIXAMORENDERER_SKELETON_H
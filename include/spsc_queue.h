@@ -0,0 +1,142 @@
+#ifndef MIXAMORENDERER_SPSC_QUEUE_H
+#define MIXAMORENDERER_SPSC_QUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "memory_stats.h"
+
+// Occupancy of a queue, sampled on every push, and how long each side was
+// blocked on it. Read it once both sides are done.
+struct queue_stats
+{
+    std::uint64_t pushes = 0;
+    std::uint64_t occupancy_sum = 0;
+    std::size_t max_occupancy = 0;
+    // producer waiting for a free slot, consumer waiting for a filled one
+    std::chrono::steady_clock::duration full_wait{};
+    std::chrono::steady_clock::duration empty_wait{};
+
+    double mean_occupancy() const { return pushes ? double(occupancy_sum) / pushes : 0.; }
+};
+
+// Bounded single-producer/single-consumer ring. Slots are filled and drained
+// in place, so whatever they own (the capacity of their vectors) is reused
+// from lap to lap. A side only blocks, on an atomic wait, when the ring is
+// full or empty.
+//
+// close() ends the queue from either side: the consumer still drains what
+// was pushed, then begin_pop() returns nullptr; begin_push() returns nullptr
+// right away, which is how a failing consumer stops its producer.
+template <typename T>
+class spsc_queue
+{
+public:
+    explicit spsc_queue(std::size_t capacity)
+    {
+        memory_scope scope(memory_category::queues);
+        slots_.resize(capacity);
+    }
+
+    spsc_queue(spsc_queue const &) = delete;
+    spsc_queue & operator = (spsc_queue const &) = delete;
+
+    std::size_t capacity() const { return slots_.size(); }
+
+    // Producer: a free slot to fill, or nullptr once the queue is closed
+    T * begin_push()
+    {
+        if (closed_.load(std::memory_order_acquire))
+            return nullptr;
+        std::size_t tail = tail_.load(std::memory_order_relaxed);
+        if (!wait_until([&] { return tail - head_.load(std::memory_order_acquire) < slots_.size(); }, stats_.full_wait))
+            return nullptr;
+        return &slots_[tail % slots_.size()];
+    }
+
+    // Producer: publishes the slot returned by begin_push()
+    void end_push()
+    {
+        std::size_t tail = tail_.load(std::memory_order_relaxed) + 1;
+        tail_.store(tail, std::memory_order_release);
+        signal();
+
+        std::size_t occupancy = tail - head_.load(std::memory_order_acquire);
+        ++stats_.pushes;
+        stats_.occupancy_sum += occupancy;
+        if (occupancy > stats_.max_occupancy)
+            stats_.max_occupancy = occupancy;
+    }
+
+    // Consumer: the oldest filled slot, or nullptr once the queue is closed and drained
+    T * begin_pop()
+    {
+        std::size_t head = head_.load(std::memory_order_relaxed);
+        if (!wait_until([&] { return tail_.load(std::memory_order_acquire) != head; }, stats_.empty_wait))
+            return nullptr;
+        return &slots_[head % slots_.size()];
+    }
+
+    // Consumer: hands the slot returned by begin_pop() back to the producer
+    void end_pop()
+    {
+        head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        signal();
+    }
+
+    void close()
+    {
+        closed_.store(true, std::memory_order_release);
+        signal();
+    }
+
+    queue_stats const & stats() const { return stats_; }
+
+private:
+    // Every state change bumps `events_`, so a waiter that saw the old value
+    // cannot miss the change it is waiting for. False when closed first.
+    template <typename Ready>
+    bool wait_until(Ready ready, std::chrono::steady_clock::duration & waited)
+    {
+        if (ready())
+            return true;
+
+        auto start = std::chrono::steady_clock::now();
+        bool result;
+        for (;;)
+        {
+            std::uint32_t seen = events_.load(std::memory_order_acquire);
+            if (ready())
+            {
+                result = true;
+                break;
+            }
+            if (closed_.load(std::memory_order_acquire))
+            {
+                result = false;
+                break;
+            }
+            events_.wait(seen, std::memory_order_acquire);
+        }
+        waited += std::chrono::steady_clock::now() - start;
+        return result;
+    }
+
+    void signal()
+    {
+        events_.fetch_add(1, std::memory_order_release);
+        events_.notify_all();
+    }
+
+    std::vector<T> slots_;
+    std::atomic<std::size_t> head_{0};
+    std::atomic<std::size_t> tail_{0};
+    std::atomic<std::uint32_t> events_{0};
+    std::atomic<bool> closed_{false};
+    queue_stats stats_;
+};
+
+#endif //MIXAMORENDERER_SPSC_QUEUE_H
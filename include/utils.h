@@ -10,8 +10,27 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <cstdint>
+
+#include "shard_writer.h"
 
 std::string to_string(std::string_view str);
 
 void save_texture(GLuint target, const char * const filename);
+
+// Channels a captured image needs for a frame format: PNG keeps alpha, raw formats store theirs
+int capture_channels(frame_format format);
+
+// The image functions take top-down pixels with `channels` (save_image) or
+// capture_channels(format) (append_image) bytes per pixel
+// Thread-safe: encodes without touching stb's global state, which stays at its defaults.
+// The result comes from pixel_buffers()
+std::vector<char> encode_png(int width, int height, int channels, std::vector<char> const & pixels);
+
+void save_encoded(const char * const filename, std::vector<char> const & png);
+
+void save_image(const char * const filename, int width, int height, int channels, std::vector<char> const & pixels);
+
+void append_image(shard_writer & shard, std::uint64_t frame_id, int width, int height, frame_format format,
+                  std::vector<char> const & pixels, int crop_x = 0, int crop_y = 0);
 #endif //MIXAMORENDERER_UTILS_H
@@ -0,0 +1,72 @@
+#ifndef MIXAMORENDERER_VIDEO_STREAM_H
+#define MIXAMORENDERER_VIDEO_STREAM_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class stream_format
+{
+    y4m,
+    rgb,
+};
+
+// Converts RGBA rows to planar I420 (BT.601, limited range). The source row y
+// starts at rgba + y * stride, so a negative stride walks a bottom-up image.
+// Odd sizes are handled; chroma planes are ((width + 1) / 2) x ((height + 1) / 2).
+void rgba_to_i420(std::uint8_t const * rgba, std::ptrdiff_t stride, int width, int height,
+                  std::uint8_t * y_plane, std::uint8_t * u_plane, std::uint8_t * v_plane);
+
+// Streams rendered frames to a file, named pipe or stdout ("-") as YUV4MPEG2
+// or raw RGB24. Conversion and writes happen on a worker thread; push()
+// blocks only when `queue_depth` frames are already waiting. With `bgra` the
+// pushed frames have blue in the first byte of every pixel.
+class video_stream
+{
+public:
+    video_stream(std::string const & path, stream_format format, int width, int height, float fps,
+                 bool bgra = false, std::size_t queue_depth = 4);
+    ~video_stream();
+
+    video_stream(video_stream const &) = delete;
+    video_stream & operator = (video_stream const &) = delete;
+
+    // pixels holds 4-byte pixels in bottom-up rows, as returned by glReadPixels
+    void push(int width, int height, std::vector<char> pixels);
+
+    // Flushes the queued frames and rethrows a write error from the worker
+    void close();
+
+private:
+    void worker();
+    void write_all(void const * data, std::size_t size);
+    void write_frame(std::vector<char> const & pixels);
+
+    int fd_;
+    bool owns_fd_;
+    stream_format format_;
+    bool bgra_;
+    int width_;
+    int height_;
+    std::size_t queue_depth_;
+    std::vector<std::uint8_t> converted_;
+    std::vector<char> rgba_;
+
+    std::mutex mutex_;
+    std::condition_variable queued_;
+    std::condition_variable drained_;
+    // at most queue_depth_ frames, reserved up front; their buffers go back to pixel_buffers()
+    std::vector<std::vector<char>> queue_;
+    bool closing_ = false;
+    bool warned_size_ = false;
+    std::exception_ptr error_;
+
+    std::thread thread_;
+};
+
+#endif //MIXAMORENDERER_VIDEO_STREAM_H
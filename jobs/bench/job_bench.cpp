@@ -0,0 +1,161 @@
+// Microbenchmark of the job system: spawn overhead, continuation latency and
+// parallel_for scaling with the number of workers.
+//
+//     mixamo_job_bench [--jobs N] [--workers N] [--pin]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+#include "job_system.h"
+
+namespace
+{
+
+using bench_clock = std::chrono::steady_clock;
+
+double seconds(bench_clock::duration d)
+{
+    return std::chrono::duration<double>(d).count();
+}
+
+// spawns `count` empty jobs from the calling thread and waits for all of them
+double spawn_from_caller(job_system & jobs, int count)
+{
+    std::vector<job_handle> handles;
+    handles.reserve(count);
+
+    auto start = bench_clock::now();
+    for (int i = 0; i < count; ++i)
+        handles.push_back(jobs.spawn([] {}));
+    for (auto const & handle : handles)
+        jobs.wait(handle);
+    return seconds(bench_clock::now() - start);
+}
+
+// one job spawns the children from a worker, into its own deque, where the others steal them
+double spawn_from_worker(job_system & jobs, int count)
+{
+    auto start = bench_clock::now();
+    auto root = jobs.spawn([&]
+    {
+        std::vector<job_handle> handles;
+        handles.reserve(count);
+        for (int i = 0; i < count; ++i)
+            handles.push_back(jobs.spawn([] {}));
+        for (auto const & handle : handles)
+            jobs.wait(handle);
+    });
+    jobs.wait(root);
+    return seconds(bench_clock::now() - start);
+}
+
+// every job is a continuation of the previous one
+double continuation_chain(job_system & jobs, int count)
+{
+    auto start = bench_clock::now();
+    job_handle last = jobs.spawn([] {});
+    for (int i = 1; i < count; ++i)
+        last = jobs.then(last, [] {});
+    jobs.wait(last);
+    return seconds(bench_clock::now() - start);
+}
+
+double parallel_sum(job_system & jobs, std::vector<float> const & data, std::size_t grain, double & result)
+{
+    std::vector<double> partial((data.size() + grain - 1) / grain);
+
+    auto start = bench_clock::now();
+    jobs.parallel_for(0, data.size(), grain, [&](std::size_t first, std::size_t last)
+    {
+        double sum = 0.;
+        for (std::size_t i = first; i < last; ++i)
+            sum += std::sqrt(data[i]) * std::sin(data[i]);
+        partial[first / grain] = sum;
+    });
+    auto elapsed = seconds(bench_clock::now() - start);
+
+    result = 0.;
+    for (double p : partial)
+        result += p;
+    return elapsed;
+}
+
+}
+
+int main(int argc, char ** argv)
+{
+    int count = 100000;
+    unsigned max_workers = job_system::default_workers();
+    bool pin = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string_view option = argv[i];
+        if (option == "--jobs" && i + 1 < argc)
+            count = std::atoi(argv[++i]);
+        else if (option == "--workers" && i + 1 < argc)
+            max_workers = unsigned(std::atoi(argv[++i]));
+        else if (option == "--pin")
+            pin = true;
+        else
+        {
+            std::cerr << "Usage: mixamo_job_bench [--jobs N] [--workers N] [--pin]\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::cout << std::fixed << std::setprecision(1);
+
+    {
+        job_system jobs(max_workers, pin);
+        std::cout << count << " empty jobs, " << jobs.worker_count() << " workers" << (pin ? ", pinned" : "") << '\n';
+
+        // warm up the allocator and wake the workers
+        spawn_from_caller(jobs, count / 10 + 1);
+
+        std::cout << std::left << std::setw(28) << "spawn from caller" << std::right << std::setw(10)
+                  << spawn_from_caller(jobs, count) * 1e9 / count << " ns/job\n";
+        std::cout << std::left << std::setw(28) << "spawn from worker" << std::right << std::setw(10)
+                  << spawn_from_worker(jobs, count) * 1e9 / count << " ns/job\n";
+        std::cout << std::left << std::setw(28) << "continuation chain" << std::right << std::setw(10)
+                  << continuation_chain(jobs, count) * 1e9 / count << " ns/job\n";
+    }
+
+    std::vector<float> data(1 << 22);
+    for (std::size_t i = 0; i < data.size(); ++i)
+        data[i] = float(i % 1000) * 0.01f;
+
+    std::size_t grain = 1 << 14;
+    std::cout << "\nparallel_for over " << data.size() << " items, grain " << grain << '\n';
+    std::cout << std::setw(8) << "threads" << std::setw(12) << "ms" << std::setw(10) << "speedup" << '\n';
+
+    std::vector<unsigned> worker_counts = {0};
+    for (unsigned workers = 1; workers < max_workers; workers *= 2)
+        worker_counts.push_back(workers);
+    if (max_workers > 0)
+        worker_counts.push_back(max_workers);
+
+    double baseline = 0.;
+    for (unsigned workers : worker_counts)
+    {
+        job_system jobs(workers, pin);
+
+        double checksum = 0.;
+        parallel_sum(jobs, data, grain, checksum);
+
+        double best = 1e30;
+        for (int run = 0; run < 5; ++run)
+            best = std::min(best, parallel_sum(jobs, data, grain, checksum));
+        if (workers == 0)
+            baseline = best;
+
+        std::cout << std::setw(8) << workers + 1 << std::setw(12) << best * 1e3
+                  << std::setw(9) << baseline / best << 'x' << '\n';
+    }
+}
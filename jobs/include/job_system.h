@@ -0,0 +1,154 @@
+#ifndef MIXAMORENDERER_JOB_SYSTEM_H
+#define MIXAMORENDERER_JOB_SYSTEM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+namespace detail
+{
+
+struct job
+{
+    std::function<void()> fn;
+    // unfinished dependencies, plus one held by spawn() until it has linked them all
+    std::atomic<int> blockers{1};
+    std::atomic<bool> done{false};
+    // threads inside job_system::wait() on this job, woken when it finishes
+    std::atomic<int> waiters{0};
+    std::exception_ptr error;
+
+    std::mutex mutex;
+    bool finished = false;
+    // the first successor is kept inline, so chains of jobs do not allocate
+    std::shared_ptr<job> successor;
+    std::vector<std::shared_ptr<job>> more_successors;
+};
+
+// Growable ring of jobs. Unlike std::deque it keeps its storage when it
+// drains, so a steady stream of jobs does not allocate.
+class job_ring
+{
+public:
+    bool empty() const { return count_ == 0; }
+
+    void push_back(std::shared_ptr<job> job);
+    std::shared_ptr<job> pop_back();
+    std::shared_ptr<job> pop_front();
+
+private:
+    std::vector<std::shared_ptr<job>> slots_;
+    std::size_t head_ = 0;
+    std::size_t count_ = 0;
+};
+
+}
+
+// A spawned job; empty handles count as finished
+class job_handle
+{
+public:
+    job_handle() = default;
+
+    bool done() const { return !job_ || job_->done.load(std::memory_order_acquire); }
+    explicit operator bool() const { return bool(job_); }
+
+private:
+    friend class job_system;
+
+    explicit job_handle(std::shared_ptr<detail::job> job)
+        : job_(std::move(job))
+    {}
+
+    std::shared_ptr<detail::job> job_;
+};
+
+// Work-stealing scheduler. Every worker owns a deque: it pushes and pops its
+// own jobs at the back (newest first, still warm in cache) and idle workers
+// steal from the front of the others (oldest first, usually the biggest
+// pieces). Jobs spawned from other threads go through a shared queue. A
+// thread waiting on a job runs other jobs meanwhile, so waits nest freely
+// and a pool without workers still makes progress on the waiting thread.
+class job_system
+{
+public:
+    // `workers` threads, by default one less than the hardware threads; with
+    // `pin` worker i is bound to core i + 1 (Linux), leaving core 0 to the caller.
+    // The threads start with the first job, a pool nothing is spawned on has none.
+    explicit job_system(unsigned workers = default_workers(), bool pin = false);
+    ~job_system();
+
+    job_system(job_system const &) = delete;
+    job_system & operator = (job_system const &) = delete;
+
+    static unsigned default_workers();
+
+    unsigned worker_count() const { return unsigned(workers_.size()); }
+
+    // Runs `fn` once every job in `after` has finished
+    job_handle spawn(std::function<void()> fn, std::span<job_handle const> after = {});
+    job_handle spawn(std::function<void()> fn, std::initializer_list<job_handle> after)
+    {
+        return spawn(std::move(fn), std::span<job_handle const>(after.begin(), after.size()));
+    }
+
+    // Continuation: runs `fn` after `job`
+    job_handle then(job_handle const & job, std::function<void()> fn) { return spawn(std::move(fn), {job}); }
+
+    // Blocks until `job` has finished, running other jobs meanwhile; rethrows what the job threw
+    void wait(job_handle const & job);
+
+    // Calls body(first, last) over [begin, end) in chunks of about `grain`
+    // items, on the calling thread and every worker, and returns when all are done
+    template <typename Body>
+    void parallel_for(std::size_t begin, std::size_t end, std::size_t grain, Body && body)
+    {
+        for_ranges(begin, end, grain, std::function<void(std::size_t, std::size_t)>(std::ref(body)));
+    }
+
+private:
+    struct worker
+    {
+        std::mutex mutex;
+        detail::job_ring jobs;
+    };
+
+    struct range_loop;
+
+    void for_ranges(std::size_t begin, std::size_t end, std::size_t grain,
+                    std::function<void(std::size_t, std::size_t)> const & body);
+
+    // Runs jobs on the calling thread until done() holds, sleeping when there are none
+    template <typename Done>
+    void help_until(Done done);
+
+    void start_workers();
+    void run_worker(unsigned index);
+    void push(std::shared_ptr<detail::job> job);
+    std::shared_ptr<detail::job> find_job(int self);
+    void execute(std::shared_ptr<detail::job> const & job);
+    void release(std::shared_ptr<detail::job> const & job);
+
+    std::vector<std::unique_ptr<worker>> workers_;
+    std::vector<std::thread> threads_;
+    std::once_flag started_;
+    bool pin_;
+
+    std::mutex injected_mutex_;
+    detail::job_ring injected_;
+
+    // bumped whenever work arrives, idle workers sleep on it
+    std::atomic<std::uint32_t> epoch_{0};
+    std::atomic<unsigned> sleeping_{0};
+    std::atomic<bool> stopping_{false};
+};
+
+#endif //MIXAMORENDERER_JOB_SYSTEM_H
@@ -0,0 +1,409 @@
+#include "job_system.h"
+
+#include <algorithm>
+#include <utility>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+
+// the pool the current thread works for and its index there, -1 off the pool
+thread_local job_system const * current_system = nullptr;
+thread_local int current_worker = -1;
+
+// Finished jobs leave their blocks (the job and its shared_ptr control block,
+// allocated together) on a free list for the next spawn
+struct block_list
+{
+    struct node
+    {
+        node * next;
+    };
+
+    std::mutex mutex;
+    node * head = nullptr;
+
+    ~block_list()
+    {
+        while (head)
+            ::operator delete(std::exchange(head, head->next));
+    }
+};
+
+template <typename T>
+struct recycling_allocator
+{
+    using value_type = T;
+
+    static_assert(sizeof(T) >= sizeof(block_list::node));
+
+    recycling_allocator() = default;
+
+    template <typename U>
+    recycling_allocator(recycling_allocator<U> const &)
+    {}
+
+    static block_list & blocks()
+    {
+        static block_list list;
+        return list;
+    }
+
+    T * allocate(std::size_t count)
+    {
+        if (count == 1)
+        {
+            auto & list = blocks();
+            std::lock_guard lock(list.mutex);
+            if (list.head)
+                return reinterpret_cast<T *>(std::exchange(list.head, list.head->next));
+        }
+        return static_cast<T *>(::operator new(count * sizeof(T)));
+    }
+
+    void deallocate(T * data, std::size_t count)
+    {
+        if (count != 1)
+        {
+            ::operator delete(data);
+            return;
+        }
+
+        auto & list = blocks();
+        auto block = reinterpret_cast<block_list::node *>(data);
+        std::lock_guard lock(list.mutex);
+        block->next = list.head;
+        list.head = block;
+    }
+
+    template <typename U>
+    bool operator == (recycling_allocator<U> const &) const { return true; }
+};
+
+void pin_to_core(unsigned core)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void) core;
+#endif
+}
+
+}
+
+namespace detail
+{
+
+void job_ring::push_back(std::shared_ptr<job> job)
+{
+    if (count_ == slots_.size())
+    {
+        std::vector<std::shared_ptr<detail::job>> grown(std::max<std::size_t>(16, 2 * slots_.size()));
+        for (std::size_t i = 0; i < count_; ++i)
+            grown[i] = std::move(slots_[(head_ + i) % slots_.size()]);
+        slots_.swap(grown);
+        head_ = 0;
+    }
+    slots_[(head_ + count_) % slots_.size()] = std::move(job);
+    ++count_;
+}
+
+std::shared_ptr<job> job_ring::pop_back()
+{
+    --count_;
+    return std::move(slots_[(head_ + count_) % slots_.size()]);
+}
+
+std::shared_ptr<job> job_ring::pop_front()
+{
+    auto job = std::move(slots_[head_]);
+    head_ = (head_ + 1) % slots_.size();
+    --count_;
+    return job;
+}
+
+}
+
+// State of one parallel_for, on the stack of the calling thread
+struct job_system::range_loop
+{
+    std::size_t begin;
+    std::size_t end;
+    std::size_t grain;
+    std::size_t chunks;
+    std::function<void(std::size_t, std::size_t)> const & body;
+
+    std::atomic<std::size_t> next{0};
+    std::atomic<std::size_t> helpers{0};
+
+    std::mutex error_mutex{};
+    std::exception_ptr error{};
+
+    // chunks are claimed from a shared counter, so a slow chunk never holds up the others;
+    // a failing chunk ends the loop for everyone
+    void run()
+    {
+        try
+        {
+            for (std::size_t chunk; (chunk = next.fetch_add(1)) < chunks;)
+            {
+                std::size_t first = begin + chunk * grain;
+                body(first, std::min(end, first + grain));
+            }
+        }
+        catch (...)
+        {
+            next.store(chunks);
+            std::lock_guard lock(error_mutex);
+            if (!error)
+                error = std::current_exception();
+        }
+    }
+};
+
+unsigned job_system::default_workers()
+{
+    unsigned threads = std::thread::hardware_concurrency();
+    return threads > 1 ? threads - 1 : 0;
+}
+
+job_system::job_system(unsigned workers, bool pin)
+    : pin_(pin)
+{
+    for (unsigned i = 0; i < workers; ++i)
+        workers_.push_back(std::make_unique<worker>());
+}
+
+void job_system::start_workers()
+{
+    std::call_once(started_, [this]
+    {
+        for (unsigned i = 0; i < worker_count(); ++i)
+            threads_.emplace_back([this, i] { run_worker(i); });
+    });
+}
+
+job_system::~job_system()
+{
+    stopping_.store(true);
+    epoch_.fetch_add(1);
+    epoch_.notify_all();
+    for (auto & thread : threads_)
+        thread.join();
+}
+
+job_handle job_system::spawn(std::function<void()> fn, std::span<job_handle const> after)
+{
+    auto job = std::allocate_shared<detail::job>(recycling_allocator<detail::job>());
+    job->fn = std::move(fn);
+
+    // a dependency that finishes while it is being linked releases the job under its own lock,
+    // after the count was raised, so the job cannot start early
+    for (auto const & handle : after)
+    {
+        if (!handle.job_)
+            continue;
+        std::lock_guard lock(handle.job_->mutex);
+        if (handle.job_->finished)
+            continue;
+        job->blockers.fetch_add(1);
+        if (!handle.job_->successor)
+            handle.job_->successor = job;
+        else
+            handle.job_->more_successors.push_back(job);
+    }
+
+    release(job);
+    return job_handle(std::move(job));
+}
+
+void job_system::wait(job_handle const & handle)
+{
+    auto const & job = handle.job_;
+    if (!job)
+        return;
+
+    job->waiters.fetch_add(1);
+    help_until([&] { return job->done.load(); });
+    job->waiters.fetch_sub(1);
+
+    if (job->error)
+        std::rethrow_exception(job->error);
+}
+
+template <typename Done>
+void job_system::help_until(Done done)
+{
+    int self = current_system == this ? current_worker : -1;
+
+    while (!done())
+    {
+        std::uint32_t seen = epoch_.load();
+        if (auto other = find_job(self))
+        {
+            execute(other);
+            continue;
+        }
+        if (done())
+            break;
+
+        sleeping_.fetch_add(1);
+        epoch_.wait(seen);
+        sleeping_.fetch_sub(1);
+    }
+}
+
+void job_system::for_ranges(std::size_t begin, std::size_t end, std::size_t grain,
+                            std::function<void(std::size_t, std::size_t)> const & body)
+{
+    if (begin >= end)
+        return;
+
+    grain = std::max<std::size_t>(grain, 1);
+    range_loop loop{begin, end, grain, (end - begin + grain - 1) / grain, body};
+
+    // helpers capture two pointers, which std::function keeps inline: spawning them does not
+    // allocate beyond the recycled job blocks
+    std::size_t helper_count = std::min<std::size_t>(worker_count(), loop.chunks - 1);
+    loop.helpers.store(helper_count);
+    for (std::size_t i = 0; i < helper_count; ++i)
+        spawn([this, state = &loop]
+        {
+            state->run();
+            if (state->helpers.fetch_sub(1) == 1)
+            {
+                epoch_.fetch_add(1);
+                epoch_.notify_all();
+            }
+        });
+
+    loop.run();
+
+    // the helpers reference this frame, all of them have to finish before it unwinds
+    help_until([&] { return loop.helpers.load() == 0; });
+
+    if (loop.error)
+        std::rethrow_exception(loop.error);
+}
+
+void job_system::run_worker(unsigned index)
+{
+    current_system = this;
+    current_worker = int(index);
+
+    if (pin_)
+        if (unsigned cores = std::thread::hardware_concurrency(); cores > 0)
+            pin_to_core((index + 1) % cores);
+
+    while (!stopping_.load())
+    {
+        std::uint32_t seen = epoch_.load();
+        if (auto job = find_job(int(index)))
+        {
+            execute(job);
+            continue;
+        }
+
+        sleeping_.fetch_add(1);
+        if (!stopping_.load())
+            epoch_.wait(seen);
+        sleeping_.fetch_sub(1);
+    }
+}
+
+void job_system::push(std::shared_ptr<detail::job> job)
+{
+    if (current_system == this)
+    {
+        auto & own = *workers_[current_worker];
+        std::lock_guard lock(own.mutex);
+        own.jobs.push_back(std::move(job));
+    }
+    else
+    {
+        start_workers();
+        std::lock_guard lock(injected_mutex_);
+        injected_.push_back(std::move(job));
+    }
+
+    // a thread that read the epoch before this bump either sees the job or wakes up
+    epoch_.fetch_add(1);
+    if (sleeping_.load())
+        epoch_.notify_one();
+}
+
+std::shared_ptr<detail::job> job_system::find_job(int self)
+{
+    if (self >= 0)
+    {
+        auto & own = *workers_[self];
+        std::lock_guard lock(own.mutex);
+        if (!own.jobs.empty())
+            return own.jobs.pop_back();
+    }
+
+    {
+        std::lock_guard lock(injected_mutex_);
+        if (!injected_.empty())
+            return injected_.pop_front();
+    }
+
+    std::size_t count = workers_.size();
+    for (std::size_t i = 1; i <= count; ++i)
+    {
+        auto & victim = *workers_[(std::size_t(self + 1) + i - 1) % count];
+        std::lock_guard lock(victim.mutex);
+        if (!victim.jobs.empty())
+            return victim.jobs.pop_front();
+    }
+
+    return nullptr;
+}
+
+void job_system::execute(std::shared_ptr<detail::job> const & job)
+{
+    try
+    {
+        job->fn();
+    }
+    catch (...)
+    {
+        job->error = std::current_exception();
+    }
+    job->fn = nullptr;
+
+    std::shared_ptr<detail::job> successor;
+    std::vector<std::shared_ptr<detail::job>> more_successors;
+    {
+        std::lock_guard lock(job->mutex);
+        job->finished = true;
+        successor.swap(job->successor);
+        more_successors.swap(job->more_successors);
+    }
+
+    job->done.store(true);
+    if (job->waiters.load())
+    {
+        epoch_.fetch_add(1);
+        epoch_.notify_all();
+    }
+
+    // successors run even when this job threw; its error is reported to whoever waits on it
+    if (successor)
+        release(successor);
+    for (auto const & other : more_successors)
+        release(other);
+}
+
+void job_system::release(std::shared_ptr<detail::job> const & job)
+{
+    if (job->blockers.fetch_sub(1) == 1)
+        push(job);
+}
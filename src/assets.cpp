@@ -0,0 +1,333 @@
+#include "assets.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "memory_stats.h"
+
+static std::ifstream open_asset(std::string const & path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        throw std::runtime_error("Cannot open " + path);
+    return file;
+}
+
+static constexpr char mesh_file_magic[4] = {'M', 'X', 'M', 'S'};
+// version 1 had no index_size and always stored 32-bit indices, version 2 had no levels of detail,
+// version 3 no meshlets, version 4 always stored two 8-bit bone ids per vertex and 8-bit meshlet bones
+static constexpr std::uint32_t mesh_file_version = 5;
+
+struct mesh_file_header
+{
+    char magic[4];
+    std::uint32_t version;
+    vertex_format format;
+    std::uint32_t vertex_count;
+    std::uint32_t index_count;
+    float bounds_min[3];
+    float bounds_max[3];
+    std::uint32_t index_size;
+    std::uint32_t lod_count;
+    std::uint32_t meshlet_count;
+    std::uint32_t meshlet_bone_count;
+    std::uint32_t bone_influences;
+    std::uint32_t bone_id_size;
+};
+
+static_assert(sizeof(mesh_file_header) == 68);
+
+static_assert(sizeof(mesh_lod) == 12);
+static_assert(sizeof(meshlet) == 48);
+
+static void read_asset(std::ifstream & file, std::string const & path, void * data, std::size_t size)
+{
+    if (!file.read(static_cast<char *>(data), std::streamsize(size)))
+        throw std::runtime_error("Truncated asset " + path);
+}
+
+mesh_data load_mesh(std::string const & path)
+{
+    memory_scope scope(memory_category::assets);
+    auto file = open_asset(path);
+
+    std::uint32_t vertex_count;
+    std::uint32_t index_count;
+    read_asset(file, path, &vertex_count, sizeof(vertex_count));
+    read_asset(file, path, &index_count, sizeof(index_count));
+
+    mesh_data mesh;
+    mesh.layout = legacy_vertex_layout(vertex_format::full);
+    mesh.packed_vertices.resize(std::size_t(vertex_count) * mesh.layout.stride());
+    mesh.indices.resize(index_count);
+    read_asset(file, path, mesh.packed_vertices.data(), mesh.packed_vertices.size());
+    read_asset(file, path, mesh.indices.data(), mesh.indices.size() * sizeof(mesh.indices[0]));
+
+    mesh.vertices = unpack_vertices(mesh.packed_vertices.data(), vertex_count, mesh.layout, {});
+    mesh.bounds = compute_bounds(mesh.vertices);
+    mesh.lods.push_back({0, index_count, 0.f});
+    return mesh;
+}
+
+std::size_t mesh_data::vertex_bytes() const
+{
+    return packed_vertices.size();
+}
+
+std::size_t mesh_data::index_size() const
+{
+    return vertices.size() <= 65536 ? sizeof(std::uint16_t) : sizeof(std::uint32_t);
+}
+
+std::size_t mesh_data::index_bytes() const
+{
+    return indices.size() * index_size();
+}
+
+mesh_data load_mesh_file(std::string const & path)
+{
+    memory_scope scope(memory_category::assets);
+    mesh_data mesh;
+
+    {
+        auto file = open_asset(path);
+        mesh_file_header header;
+        if (!file.read(reinterpret_cast<char *>(&header), sizeof(header))
+            || std::memcmp(header.magic, mesh_file_magic, sizeof(mesh_file_magic)) != 0)
+        {
+            file.close();
+            return load_mesh(path);
+        }
+
+        if (header.version == 0 || header.version > mesh_file_version)
+            throw std::runtime_error("Unsupported mesh file version " + std::to_string(header.version) + " in " + path);
+        if (header.version < 5)
+        {
+            header.bone_influences = 2;
+            header.bone_id_size = 1;
+            file.seekg(offsetof(mesh_file_header, bone_influences));
+        }
+        if (header.version < 4)
+        {
+            header.meshlet_count = 0;
+            header.meshlet_bone_count = 0;
+            file.seekg(offsetof(mesh_file_header, meshlet_count));
+        }
+        if (header.version < 3)
+        {
+            header.lod_count = 0;
+            file.seekg(offsetof(mesh_file_header, lod_count));
+        }
+        if (header.version < 2)
+        {
+            header.index_size = sizeof(std::uint32_t);
+            file.seekg(offsetof(mesh_file_header, index_size));
+        }
+        if (header.index_size != sizeof(std::uint16_t) && header.index_size != sizeof(std::uint32_t))
+            throw std::runtime_error("Invalid index size in " + path);
+        if (header.format != vertex_format::full && header.format != vertex_format::compact)
+            throw std::runtime_error("Unknown vertex format in " + path);
+        if ((header.bone_influences != 2 && header.bone_influences != 4) || (header.bone_id_size != 1 && header.bone_id_size != 2))
+            throw std::runtime_error("Invalid bone influences in " + path);
+
+        mesh.layout = {header.format, header.bone_influences, header.bone_id_size};
+        mesh.bounds.min = glm::vec3(header.bounds_min[0], header.bounds_min[1], header.bounds_min[2]);
+        mesh.bounds.max = glm::vec3(header.bounds_max[0], header.bounds_max[1], header.bounds_max[2]);
+        mesh.indices.resize(header.index_count);
+
+        mesh.packed_vertices.resize(std::size_t(header.vertex_count) * mesh.layout.stride());
+        read_asset(file, path, mesh.packed_vertices.data(), mesh.packed_vertices.size());
+        mesh.vertices = unpack_vertices(mesh.packed_vertices.data(), header.vertex_count, mesh.layout, mesh.bounds);
+
+        if (header.index_size == sizeof(std::uint16_t))
+        {
+            std::vector<std::uint16_t> narrow(header.index_count);
+            read_asset(file, path, narrow.data(), narrow.size() * sizeof(narrow[0]));
+            std::copy(narrow.begin(), narrow.end(), mesh.indices.begin());
+        }
+        else
+            read_asset(file, path, mesh.indices.data(), mesh.indices.size() * sizeof(mesh.indices[0]));
+
+        mesh.lods.resize(header.lod_count);
+        read_asset(file, path, mesh.lods.data(), mesh.lods.size() * sizeof(mesh_lod));
+        if (mesh.lods.empty())
+            mesh.lods.push_back({0, header.index_count, 0.f});
+
+        mesh.meshlets.resize(header.meshlet_count);
+        read_asset(file, path, mesh.meshlets.data(), mesh.meshlets.size() * sizeof(meshlet));
+        if (header.version < 5)
+        {
+            std::vector<std::uint8_t> narrow(header.meshlet_bone_count);
+            read_asset(file, path, narrow.data(), narrow.size());
+            mesh.meshlet_bones.assign(narrow.begin(), narrow.end());
+        }
+        else
+        {
+            mesh.meshlet_bones.resize(header.meshlet_bone_count);
+            read_asset(file, path, mesh.meshlet_bones.data(), mesh.meshlet_bones.size() * sizeof(mesh.meshlet_bones[0]));
+        }
+    }
+
+    for (auto index : mesh.indices)
+        if (index >= mesh.vertices.size())
+            throw std::runtime_error("Vertex index out of range in " + path);
+    for (auto const & lod : mesh.lods)
+        if (lod.first_index > mesh.indices.size() || lod.index_count > mesh.indices.size() - lod.first_index)
+            throw std::runtime_error("Level of detail out of range in " + path);
+    for (std::size_t i = 0; i < mesh.meshlets.size(); ++i)
+    {
+        auto const & m = mesh.meshlets[i];
+        if (m.first_index > mesh.indices.size() || m.index_count > mesh.indices.size() - m.first_index
+            || m.first_bone > mesh.meshlet_bones.size() || m.bone_count > mesh.meshlet_bones.size() - m.first_bone
+            || (i > 0 && m.first_index < mesh.meshlets[i - 1].first_index))
+            throw std::runtime_error("Meshlet out of range in " + path);
+    }
+
+    return mesh;
+}
+
+void save_mesh_file(std::string const & path, mesh_data const & mesh)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        throw std::runtime_error("Cannot write " + path);
+
+    mesh_file_header header{};
+    std::memcpy(header.magic, mesh_file_magic, sizeof(mesh_file_magic));
+    header.version = mesh_file_version;
+    header.format = mesh.layout.format;
+    header.vertex_count = std::uint32_t(mesh.vertices.size());
+    header.index_count = std::uint32_t(mesh.indices.size());
+    header.index_size = std::uint32_t(mesh.index_size());
+    header.lod_count = std::uint32_t(mesh.lods.size());
+    header.meshlet_count = std::uint32_t(mesh.meshlets.size());
+    header.meshlet_bone_count = std::uint32_t(mesh.meshlet_bones.size());
+    header.bone_influences = mesh.layout.influences;
+    header.bone_id_size = mesh.layout.bone_id_size;
+    for (int i = 0; i < 3; ++i)
+    {
+        header.bounds_min[i] = mesh.bounds.min[i];
+        header.bounds_max[i] = mesh.bounds.max[i];
+    }
+
+    if (mesh.packed_vertices.size() != mesh.vertices.size() * mesh.layout.stride())
+        throw std::runtime_error("Vertices not packed in their layout for " + path);
+
+    file.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    file.write(reinterpret_cast<char const *>(mesh.packed_vertices.data()), std::streamsize(mesh.vertex_bytes()));
+    if (header.index_size == sizeof(std::uint16_t))
+    {
+        std::vector<std::uint16_t> narrow(mesh.indices.begin(), mesh.indices.end());
+        file.write(reinterpret_cast<char const *>(narrow.data()), std::streamsize(mesh.index_bytes()));
+    }
+    else
+        file.write(reinterpret_cast<char const *>(mesh.indices.data()), std::streamsize(mesh.index_bytes()));
+    file.write(reinterpret_cast<char const *>(mesh.lods.data()), std::streamsize(mesh.lods.size() * sizeof(mesh_lod)));
+    file.write(reinterpret_cast<char const *>(mesh.meshlets.data()), std::streamsize(mesh.meshlets.size() * sizeof(meshlet)));
+    file.write(reinterpret_cast<char const *>(mesh.meshlet_bones.data()),
+               std::streamsize(mesh.meshlet_bones.size() * sizeof(mesh.meshlet_bones[0])));
+
+    if (!file)
+        throw std::runtime_error("Cannot write " + path);
+}
+
+std::vector<bone> load_bones(std::string const & path)
+{
+    memory_scope scope(memory_category::assets);
+    auto file = open_asset(path);
+
+    std::uint32_t bone_count;
+    read_asset(file, path, &bone_count, sizeof(bone_count));
+
+    std::vector<bone> bones(bone_count);
+    read_asset(file, path, bones.data(), bones.size() * sizeof(bones[0]));
+    return bones;
+}
+
+std::vector<bone_pose> load_pose(std::string const & path, std::size_t bone_count)
+{
+    memory_scope scope(memory_category::clips);
+    auto file = open_asset(path);
+
+    std::vector<bone_pose> pose(bone_count);
+    read_asset(file, path, pose.data(), pose.size() * sizeof(pose[0]));
+    return pose;
+}
+
+// Points the vertices, packed ones included, and the meshlets at the bones'
+// new ids; ids past the skeleton stay. A new id can need more bits than the
+// layout the file was packed in, which then widens and is packed again.
+static void renumber_bones(mesh_data & mesh, bone_order const & order)
+{
+    std::vector<std::uint16_t> new_ids(order.source_ids.size());
+    for (std::size_t i = 0; i < order.source_ids.size(); ++i)
+        new_ids[order.source_ids[i]] = std::uint16_t(i);
+    auto new_id = [&](std::uint16_t id) { return id < new_ids.size() ? new_ids[id] : id; };
+
+    for (auto & v : mesh.vertices)
+        for (auto & id : v.bone_ids)
+            id = new_id(id);
+
+    for (auto & id : mesh.meshlet_bones)
+        id = new_id(id);
+
+    vertex_layout fitted = fit_vertex_layout(mesh.layout.format, mesh.vertices);
+    fitted.influences = std::max(fitted.influences, mesh.layout.influences);
+    fitted.bone_id_size = std::max(fitted.bone_id_size, mesh.layout.bone_id_size);
+    if (fitted != mesh.layout)
+    {
+        mesh.layout = fitted;
+        mesh.packed_vertices = pack_vertices(mesh.vertices, mesh.layout, mesh.bounds);
+        return;
+    }
+
+    std::size_t stride = mesh.layout.stride();
+    for (std::size_t i = 0; i < mesh.vertices.size(); ++i)
+    {
+        std::uint8_t * ids = mesh.packed_vertices.data() + i * stride + mesh.layout.bone_ids_offset();
+        for (std::uint32_t k = 0; k < mesh.layout.influences; ++k)
+        {
+            std::uint16_t id = mesh.vertices[i].bone_ids[k];
+            if (mesh.layout.bone_id_size == 2)
+                std::memcpy(ids + 2 * k, &id, sizeof(id));
+            else
+                ids[k] = std::uint8_t(id);
+        }
+    }
+}
+
+character_assets load_character(std::string const & directory, std::string const & mesh_path)
+{
+    character_assets character;
+    character.mesh = load_mesh_file(mesh_path.empty() ? directory + "/human.bin" : mesh_path);
+    character.bones = load_bones(directory + "/bones.bin");
+
+    bone_order order = sort_bones_breadth_first(character.bones);
+
+    {
+        memory_scope scope(memory_category::clips);
+        for (int i = 0; i < character_pose_count; ++i)
+        {
+            auto source = load_pose(directory + "/pose_" + std::to_string(i) + ".bin", character.bones.size());
+            auto & pose = character.poses.emplace_back(source.size());
+            for (std::size_t b = 0; b < order.source_ids.size(); ++b)
+                pose[b] = source[order.source_ids[b]];
+        }
+    }
+
+    memory_scope scope(memory_category::assets);
+    character.bones = reorder_bones(character.bones, order);
+    renumber_bones(character.mesh, order);
+
+    character.palette_size = character.bones.size();
+    for (auto const & v : character.mesh.vertices)
+        for (std::uint32_t k = 0; k < character.mesh.layout.influences; ++k)
+            character.palette_size = std::max(character.palette_size, std::size_t(v.bone_ids[k]) + 1);
+    character.bone_levels = std::move(order.level_starts);
+    character.source_bone_ids = std::move(order.source_ids);
+
+    return character;
+}
@@ -0,0 +1,90 @@
+#include "aux_output.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include "stb_image_write.h"
+
+#include "frame_memory.h"
+
+frame_format aux_frame_format(int target)
+{
+    switch (target)
+    {
+        case aux_depth:
+            return frame_format::r32f;
+        case aux_normals:
+            return frame_format::rgb8;
+        default:
+            return frame_format::r8;
+    }
+}
+
+// Converts to the aux frame format with top-down rows
+static std::vector<char> aux_frame(int target, int width, int height, std::vector<char> const & pixels)
+{
+    std::size_t src_row = std::size_t(width) * aux_spec(target).pixel_size;
+    std::size_t dst_row = std::size_t(width) * frame_format_pixel_size(aux_frame_format(target));
+
+    auto frame = pixel_buffers().acquire(dst_row * height);
+    for (int y = 0; y < height; ++y)
+    {
+        char const * src = pixels.data() + std::size_t(height - 1 - y) * src_row;
+        char * dst = frame.data() + y * dst_row;
+
+        if (target != aux_normals)
+        {
+            std::memcpy(dst, src, dst_row);
+            continue;
+        }
+
+        // GL_UNSIGNED_INT_2_10_10_10_REV keeps red in the low bits
+        for (int x = 0; x < width; ++x)
+        {
+            std::uint32_t packed;
+            std::memcpy(&packed, src + 4 * x, 4);
+            dst[3 * x + 0] = char((packed >> 2) & 0xff);
+            dst[3 * x + 1] = char((packed >> 12) & 0xff);
+            dst[3 * x + 2] = char((packed >> 22) & 0xff);
+        }
+    }
+    return frame;
+}
+
+void save_aux_image(int target, std::string const & filename_base, int width, int height, std::vector<char> const & pixels)
+{
+    std::string filename;
+
+    if (target == aux_depth)
+    {
+        // PFM stores rows bottom-up like GL, a negative scale marks little endian
+        filename = filename_base + ".pfm";
+        std::ofstream file(filename, std::ios::binary);
+        file << "Pf\n" << width << ' ' << height << "\n-1.0\n";
+        file.write(pixels.data(), pixels.size());
+        if (!file)
+            throw std::runtime_error("Cannot write " + filename);
+    }
+    else
+    {
+        filename = filename_base + ".png";
+        auto frame = aux_frame(target, width, height, pixels);
+        int channels = frame_format_channels(aux_frame_format(target));
+        // stb allocates from the thread arena
+        arena_scope scope;
+        stbi_write_png(filename.c_str(), width, height, channels, frame.data(), width * channels);
+        pixel_buffers().release(std::move(frame));
+    }
+
+    std::cout << "Texture wrote " << filename << '\n';
+}
+
+void append_aux_image(shard_writer & shard, int target, std::uint64_t frame_id, int width, int height,
+                      std::vector<char> const & pixels, int crop_x, int crop_y)
+{
+    auto frame = aux_frame(target, width, height, pixels);
+    shard.append(frame_id, width, height, aux_frame_format(target), frame.data(), frame.size(), crop_x, crop_y);
+    pixel_buffers().release(std::move(frame));
+}
@@ -0,0 +1,67 @@
+#include "crop.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/geometric.hpp>
+
+std::vector<float> bone_radii(std::vector<vertex> const & vertices, std::vector<bone> const & bones)
+{
+    std::vector<float> radii(bones.size(), 0.f);
+
+    for (auto const & v : vertices)
+        for (int k = 0; k < max_bone_influences; ++k)
+            if (v.bone_weights[k] > 0 && v.bone_ids[k] < bones.size())
+                radii[v.bone_ids[k]] = std::max(radii[v.bone_ids[k]], glm::distance(v.position, bones[v.bone_ids[k]].offset));
+
+    return radii;
+}
+
+pixel_rect skinned_bounds(joint_batch const & joints, std::vector<float> const & radii,
+                          std::vector<bone_pose> const & bone_transforms, glm::mat4 const & view,
+                          glm::mat4 const & projection, int width, int height, int margin)
+{
+    pixel_rect full{0, 0, width, height};
+
+    // near plane distance of a glm::perspective matrix
+    float near = projection[3][2] / (projection[2][2] - 1.f);
+
+    float min_x = 1.f, max_x = -1.f, min_y = 1.f, max_y = -1.f;
+
+    for (std::size_t i = 0; i < joints.count; ++i)
+    {
+        float r = radii[i] * bone_transforms[i].scale;
+        if (r <= 0.f)
+            continue;
+
+        glm::vec4 c = view * glm::vec4(joints.x[i], joints.y[i], joints.z[i], 1.f);
+        float depth = -c.z;
+        if (depth - r <= near)
+            return full;
+
+        // every point of the sphere has |x| offset <= r and depth >= depth - r,
+        // so these bound x / depth from both sides (same for y)
+        auto upper = [&](float n) { return n / (n >= 0.f ? depth - r : depth + r); };
+        auto lower = [&](float n) { return n / (n >= 0.f ? depth + r : depth - r); };
+
+        min_x = std::min(min_x, projection[0][0] * lower(c.x - r));
+        max_x = std::max(max_x, projection[0][0] * upper(c.x + r));
+        min_y = std::min(min_y, projection[1][1] * lower(c.y - r));
+        max_y = std::max(max_y, projection[1][1] * upper(c.y + r));
+    }
+
+    if (min_x > max_x || min_y > max_y)
+        return {0, 0, 1, 1};
+
+    int x0 = (int)std::floor((min_x + 1.f) * 0.5f * width) - margin;
+    int x1 = (int)std::ceil((max_x + 1.f) * 0.5f * width) + margin;
+    int y0 = (int)std::floor((1.f - max_y) * 0.5f * height) - margin;
+    int y1 = (int)std::ceil((1.f - min_y) * 0.5f * height) + margin;
+
+    x0 = std::clamp(x0, 0, width - 1);
+    y0 = std::clamp(y0, 0, height - 1);
+    x1 = std::clamp(x1, x0 + 1, width);
+    y1 = std::clamp(y1, y0 + 1, height);
+
+    return {x0, y0, x1 - x0, y1 - y0};
+}
@@ -0,0 +1,170 @@
+#include "frame_memory.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+#include "memory_stats.h"
+
+frame_arena::frame_arena(std::size_t chunk_size)
+    : chunk_size_(chunk_size)
+{}
+
+void * frame_arena::allocate(std::size_t size, std::size_t alignment)
+{
+    for (;;)
+    {
+        if (current_ < chunks_.size())
+        {
+            auto & c = chunks_[current_];
+            auto base = reinterpret_cast<std::uintptr_t>(c.data.get());
+            std::size_t start = ((base + offset_ + alignment - 1) & ~std::uintptr_t(alignment - 1)) - base;
+            if (start + size <= c.size)
+            {
+                offset_ = start + size;
+                last_ = c.data.get() + start;
+                return last_;
+            }
+
+            // later chunks are kept from earlier frames, the first one large enough is used
+            ++current_;
+            offset_ = 0;
+            continue;
+        }
+
+        std::size_t size_needed = size + alignment;
+        std::size_t grown = chunks_.empty() ? chunk_size_ : chunks_.back().size * 2;
+        std::size_t chunk_size = std::max(size_needed, grown);
+        memory_scope scope(memory_category::arenas);
+        chunks_.push_back({std::unique_ptr<std::byte[]>(new std::byte[chunk_size]), chunk_size});
+        current_ = chunks_.size() - 1;
+        offset_ = 0;
+    }
+}
+
+void * frame_arena::reallocate(void * data, std::size_t old_size, std::size_t new_size)
+{
+    if (!data)
+        return allocate(new_size);
+
+    if (data == last_)
+    {
+        auto & c = chunks_[current_];
+        std::size_t start = static_cast<std::byte *>(data) - c.data.get();
+        if (start + new_size <= c.size)
+        {
+            offset_ = start + new_size;
+            return data;
+        }
+    }
+
+    void * moved = allocate(new_size);
+    std::memcpy(moved, data, std::min(old_size, new_size));
+    return moved;
+}
+
+char const * frame_arena::print(char const * format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    va_list copy;
+    va_copy(copy, args);
+    int length = std::vsnprintf(nullptr, 0, format, copy);
+    va_end(copy);
+
+    auto text = static_cast<char *>(allocate(std::size_t(std::max(length, 0)) + 1, 1));
+    std::vsnprintf(text, std::size_t(std::max(length, 0)) + 1, format, args);
+    va_end(args);
+    return text;
+}
+
+void frame_arena::rewind(marker m)
+{
+    current_ = m.chunk;
+    offset_ = m.offset;
+    last_ = nullptr;
+
+    // nothing is live anymore: merge the chunks so the next frame fits into one
+    if (m.chunk == 0 && m.offset == 0 && chunks_.size() > 1)
+    {
+        std::size_t total = capacity();
+        memory_scope scope(memory_category::arenas);
+        chunks_.clear();
+        chunks_.push_back({std::unique_ptr<std::byte[]>(new std::byte[total]), total});
+    }
+}
+
+std::size_t frame_arena::capacity() const
+{
+    std::size_t total = 0;
+    for (auto const & c : chunks_)
+        total += c.size;
+    return total;
+}
+
+frame_arena & thread_arena()
+{
+    thread_local frame_arena arena;
+    return arena;
+}
+
+pixel_buffer_pool::pixel_buffer_pool(std::size_t max_buffers)
+    : max_buffers_(max_buffers)
+{
+    free_.reserve(max_buffers);
+}
+
+std::vector<char> pixel_buffer_pool::acquire(std::size_t size)
+{
+    std::vector<char> buffer;
+    {
+        std::lock_guard lock(mutex_);
+        std::size_t best = free_.size();
+        for (std::size_t i = 0; i < free_.size(); ++i)
+            if (free_[i].capacity() >= size && (best == free_.size() || free_[i].capacity() < free_[best].capacity()))
+                best = i;
+
+        if (best != free_.size())
+        {
+            buffer = std::move(free_[best]);
+            free_[best] = std::move(free_.back());
+            free_.pop_back();
+        }
+    }
+
+    memory_scope scope(memory_category::pixel_buffers);
+    buffer.resize(size);
+    return buffer;
+}
+
+void pixel_buffer_pool::release(std::vector<char> && buffer)
+{
+    if (buffer.capacity() == 0)
+        return;
+
+    std::lock_guard lock(mutex_);
+    if (free_.size() < max_buffers_)
+    {
+        free_.push_back(std::move(buffer));
+        return;
+    }
+
+    // full: keep the larger of the incoming buffer and the smallest kept one, the caller frees the other
+    auto smallest = std::min_element(free_.begin(), free_.end(),
+                                     [](auto const & a, auto const & b) { return a.capacity() < b.capacity(); });
+    if (smallest->capacity() < buffer.capacity())
+        std::swap(*smallest, buffer);
+}
+
+std::size_t pixel_buffer_pool::free_count() const
+{
+    std::lock_guard lock(mutex_);
+    return free_.size();
+}
+
+pixel_buffer_pool & pixel_buffers()
+{
+    static pixel_buffer_pool pool;
+    return pool;
+}
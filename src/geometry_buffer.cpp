@@ -0,0 +1,161 @@
+#include "geometry_buffer.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "frame_memory.h"
+#include "memory_stats.h"
+
+mesh_range sub_range(mesh_range const & range, std::uint32_t first, std::uint32_t count)
+{
+    mesh_range sub = range;
+    sub.index_offset += first * (range.index_type == GL_UNSIGNED_SHORT ? sizeof(std::uint16_t) : sizeof(std::uint32_t));
+    sub.index_count = GLsizei(count);
+    return sub;
+}
+
+geometry_buffer::geometry_buffer(vertex_layout const & layout)
+    : layout_(layout)
+{
+    glGenVertexArrays(1, &vao_);
+}
+
+geometry_buffer::~geometry_buffer()
+{
+    GLuint buffers[] = {vertex_buffer_, index_buffer_};
+    forget_gl_objects(gl_object_kind::buffer, 2, buffers);
+    glDeleteBuffers(2, buffers);
+    glDeleteVertexArrays(1, &vao_);
+}
+
+mesh_range geometry_buffer::add(mesh_data const & mesh)
+{
+    if (mesh.layout != layout_)
+        throw std::runtime_error(std::string("Cannot add ") + vertex_format_name(mesh.layout.format) + " vertices with "
+                                 + std::to_string(mesh.layout.influences) + " influences to a buffer of "
+                                 + vertex_format_name(layout_.format) + " vertices with "
+                                 + std::to_string(layout_.influences) + " influences");
+
+    mesh_range range;
+    range.index_count = GLsizei(mesh.indices.size());
+    range.base_vertex = GLint(vertex_count_);
+    range.bounds = mesh.bounds;
+
+    glBindVertexArray(vao_);
+
+    write(vertex_buffer_, vertex_capacity_, vertex_bytes_, mesh.packed_vertices.data(), mesh.vertex_bytes());
+    vertex_bytes_ += mesh.vertex_bytes();
+    vertex_count_ += mesh.vertices.size();
+
+    // 32-bit ranges start 4-byte aligned behind 16-bit ones
+    index_bytes_ = (index_bytes_ + mesh.index_size() - 1) / mesh.index_size() * mesh.index_size();
+    range.index_offset = index_bytes_;
+    if (mesh.index_size() == sizeof(std::uint16_t))
+    {
+        arena_scope scope;
+        arena_vector<std::uint16_t> narrow(mesh.indices.begin(), mesh.indices.end());
+        range.index_type = GL_UNSIGNED_SHORT;
+        write(index_buffer_, index_capacity_, index_bytes_, narrow.data(), mesh.index_bytes());
+    }
+    else
+    {
+        range.index_type = GL_UNSIGNED_INT;
+        write(index_buffer_, index_capacity_, index_bytes_, mesh.indices.data(), mesh.index_bytes());
+    }
+    index_bytes_ += mesh.index_bytes();
+
+    return range;
+}
+
+void geometry_buffer::bind() const
+{
+    glBindVertexArray(vao_);
+}
+
+void geometry_buffer::draw(mesh_range const & range) const
+{
+    glDrawElementsBaseVertex(GL_TRIANGLES, range.index_count, range.index_type, (void*)(range.index_offset), range.base_vertex);
+}
+
+void geometry_buffer::draw(mesh_range const & range, std::vector<meshlet> const & meshlets,
+                           std::span<std::uint32_t const> listed) const
+{
+    if (listed.empty())
+        return;
+
+    std::size_t index_size = range.index_type == GL_UNSIGNED_SHORT ? sizeof(std::uint16_t) : sizeof(std::uint32_t);
+
+    arena_scope scope;
+    arena_vector<GLsizei> counts(listed.size());
+    arena_vector<void const *> offsets(listed.size());
+    arena_vector<GLint> base_vertices(listed.size(), range.base_vertex);
+    for (std::size_t i = 0; i < listed.size(); ++i)
+    {
+        meshlet const & m = meshlets[listed[i]];
+        counts[i] = GLsizei(m.index_count);
+        offsets[i] = (void const *)(range.index_offset + m.first_index * index_size);
+    }
+
+    glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), range.index_type, offsets.data(), GLsizei(listed.size()),
+                                  base_vertices.data());
+}
+
+void geometry_buffer::write(GLuint & buffer, std::size_t & capacity, std::size_t offset, void const * data, std::size_t size)
+{
+    if (offset + size > capacity)
+    {
+        std::size_t grown = std::max(offset + size, 2 * capacity);
+
+        GLuint replacement;
+        glGenBuffers(1, &replacement);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, replacement);
+        glBufferData(GL_COPY_WRITE_BUFFER, grown, nullptr, GL_STATIC_DRAW);
+        track_gl_object(gl_object_kind::buffer, replacement, grown);
+        if (buffer)
+        {
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, offset);
+            forget_gl_objects(gl_object_kind::buffer, 1, &buffer);
+            glDeleteBuffers(1, &buffer);
+        }
+
+        buffer = replacement;
+        capacity = grown;
+        set_vertex_layout();
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+}
+
+void geometry_buffer::set_vertex_layout()
+{
+    glBindVertexArray(vao_);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_);
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
+    if (!vertex_buffer_)
+        return;
+
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+    glEnableVertexAttribArray(3);
+    GLsizei stride = GLsizei(layout_.stride());
+    if (layout_.format == vertex_format::compact)
+    {
+        // the shader scales positions into the bounds and unfolds the normals
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)(0));
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride, (void*)(8));
+    }
+    else
+    {
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)(0));
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(12));
+    }
+
+    GLint influences = GLint(layout_.influences);
+    GLenum id_type = layout_.bone_id_size == sizeof(std::uint16_t) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+    glVertexAttribIPointer(2, influences, id_type, stride, (void*)(layout_.bone_ids_offset()));
+    glVertexAttribPointer(3, influences, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)(layout_.bone_weights_offset()));
+}
@@ -0,0 +1,134 @@
+#include "keypoints.h"
+
+#include <charconv>
+
+#include "frame_memory.h"
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+void posed_joints(std::vector<bone_pose> const & bone_transforms, std::vector<bone> const & bones,
+                  glm::mat4 const & model, joint_batch & joints)
+{
+    joints.count = bones.size();
+    std::size_t padded = (joints.count + 3) / 4 * 4;
+    joints.x.assign(padded, 0.f);
+    joints.y.assign(padded, 0.f);
+    joints.z.assign(padded, 0.f);
+
+    for (std::size_t i = 0; i < joints.count; ++i)
+    {
+        glm::vec3 p = glm::vec3(model * glm::vec4(bone_transforms[i] * bones[i].offset, 1.f));
+        joints.x[i] = p.x;
+        joints.y[i] = p.y;
+        joints.z[i] = p.z;
+    }
+}
+
+void project_keypoints(joint_batch const & joints, std::span<glm::mat4 const> view_projections,
+                       int width, int height, std::vector<keypoint> & result)
+{
+    std::size_t padded = joints.x.size();
+    result.resize(view_projections.size() * joints.count);
+
+    float half_width = 0.5f * width;
+    float half_height = 0.5f * height;
+
+    // per-call scratch lives in the thread arena
+    arena_scope scope;
+    arena_vector<float> u(padded), v(padded), w(padded);
+
+    for (std::size_t c = 0; c < view_projections.size(); ++c)
+    {
+        // glm matrices are column-major: m[column][row]
+        glm::mat4 const & m = view_projections[c];
+
+        std::size_t i = 0;
+#ifdef __SSE__
+        for (; i < padded; i += 4)
+        {
+            __m128 x = _mm_loadu_ps(&joints.x[i]);
+            __m128 y = _mm_loadu_ps(&joints.y[i]);
+            __m128 z = _mm_loadu_ps(&joints.z[i]);
+
+            auto row = [&](int r) {
+                return _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[0][r]), x), _mm_mul_ps(_mm_set1_ps(m[1][r]), y)),
+                                  _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[2][r]), z), _mm_set1_ps(m[3][r])));
+            };
+
+            __m128 cw = row(3);
+            __m128 inv_w = _mm_div_ps(_mm_set1_ps(1.f), cw);
+
+            // u = (x / w + 1) * width / 2, v = (1 - y / w) * height / 2
+            __m128 hw = _mm_set1_ps(half_width);
+            __m128 hh = _mm_set1_ps(half_height);
+            _mm_storeu_ps(&u[i], _mm_add_ps(_mm_mul_ps(_mm_mul_ps(row(0), inv_w), hw), hw));
+            _mm_storeu_ps(&v[i], _mm_sub_ps(hh, _mm_mul_ps(_mm_mul_ps(row(1), inv_w), hh)));
+            _mm_storeu_ps(&w[i], cw);
+        }
+#endif
+        for (; i < padded; ++i)
+        {
+            float x = joints.x[i], y = joints.y[i], z = joints.z[i];
+            float cx = m[0][0] * x + m[1][0] * y + m[2][0] * z + m[3][0];
+            float cy = m[0][1] * x + m[1][1] * y + m[2][1] * z + m[3][1];
+            float cw = m[0][3] * x + m[1][3] * y + m[2][3] * z + m[3][3];
+            u[i] = cx / cw * half_width + half_width;
+            v[i] = half_height - cy / cw * half_height;
+            w[i] = cw;
+        }
+
+        // for a perspective projection clip w is the distance in front of the camera
+        keypoint * out = result.data() + c * joints.count;
+        for (std::size_t j = 0; j < joints.count; ++j)
+            out[j] = {u[j], v[j], w[j]};
+    }
+}
+
+static void append_float(std::string & out, float value)
+{
+    char buffer[32];
+    auto end = std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::general, 6).ptr;
+    out.append(buffer, end);
+}
+
+void format_keypoints(std::string & out, std::uint64_t frame_id, joint_batch const & joints,
+                      std::vector<keypoint> const & keypoints, std::span<std::uint32_t const> order)
+{
+    out += "{\"frame\":";
+    out += std::to_string(frame_id);
+
+    out += ",\"joints\":[";
+    for (std::size_t k = 0; k < joints.count; ++k)
+    {
+        std::uint32_t j = order[k];
+        out += k ? ",[" : "[";
+        append_float(out, joints.x[j]);
+        out += ',';
+        append_float(out, joints.y[j]);
+        out += ',';
+        append_float(out, joints.z[j]);
+        out += ']';
+    }
+
+    out += "],\"views\":[";
+    std::size_t views = joints.count ? keypoints.size() / joints.count : 0;
+    for (std::size_t c = 0; c < views; ++c)
+    {
+        out += c ? ",[" : "[";
+        for (std::size_t k = 0; k < joints.count; ++k)
+        {
+            auto const & point = keypoints[c * joints.count + order[k]];
+            out += k ? ",[" : "[";
+            append_float(out, point.u);
+            out += ',';
+            append_float(out, point.v);
+            out += ',';
+            append_float(out, point.depth);
+            out += ']';
+        }
+        out += ']';
+    }
+    out += "]}";
+}
@@ -0,0 +1,46 @@
+#include "lod.h"
+
+#include <algorithm>
+#include <limits>
+
+#include <glm/geometric.hpp>
+
+lod_selector::lod_selector(std::vector<mesh_lod> const & lods, mesh_bounds const & bounds, float max_error_pixels)
+    : center_((bounds.min + bounds.max) * 0.5f)
+    , radius_(glm::length(bounds.extent()) * 0.5f)
+    , max_error_pixels_(max_error_pixels)
+{
+    for (auto const & lod : lods)
+        errors_.push_back(lod.error);
+}
+
+int lod_selector::select(float radius_pixels) const
+{
+    if (max_error_pixels_ <= 0.f || radius_ <= 0.f)
+        return 0;
+
+    int level = 0;
+    for (std::size_t i = 1; i < errors_.size(); ++i)
+        if (errors_[i] / radius_ * radius_pixels <= max_error_pixels_)
+            level = int(i);
+    return level;
+}
+
+int lod_selector::select(glm::mat4 const & model, std::vector<glm::mat4> const & views, glm::mat4 const & projection,
+                         int viewport_height) const
+{
+    if (errors_.size() < 2 || max_error_pixels_ <= 0.f)
+        return 0;
+
+    // a sphere at distance d covers about radius * projection[1][1] / d of the half viewport height
+    float radius_pixels = 0.f;
+    for (auto const & view : views)
+    {
+        glm::vec4 center = view * model * glm::vec4(center_, 1.f);
+        float distance = -center.z;
+        if (distance <= radius_)
+            return 0;
+        radius_pixels = std::max(radius_pixels, radius_ * projection[1][1] * 0.5f * float(viewport_height) / distance);
+    }
+    return select(radius_pixels);
+}
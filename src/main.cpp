@@ -16,15 +16,46 @@
 #include <cmath>
 #include <fstream>
 #include <sstream>
+#include <memory>
+#include <array>
+#include <bit>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
 
 #include "shader_sources.h"
 #include "shader.h"
 #include "utils.h"
 #include "errors.h"
+#include "options.h"
+#include "shard_writer.h"
+#include "video_stream.h"
+#include "multiview.h"
+#include "render_target.h"
+#include "readback.h"
+#include "aux_output.h"
+#include "mesh.h"
+#include "assets.h"
+#include "geometry_buffer.h"
+#include "meshlet_culling.h"
+#include "skeleton.h"
+#include "keypoints.h"
+#include "crop.h"
+#include "pixel_convert.h"
+#include "readback_bench.h"
+#include "frame_state.h"
+#include "post_chain.h"
+#include "pipeline.h"
+#include "job_system.h"
+#include "frame_memory.h"
+#include "render_bench.h"
+#include "memory_stats.h"
 
 #define GLM_FORCE_SWIZZLE
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
 #include <glm/mat4x4.hpp>
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/ext/matrix_clip_space.hpp>
@@ -32,56 +63,16 @@
 #include <glm/gtx/quaternion.hpp>
 #include <glm/gtx/string_cast.hpp>
 
-struct vertex
+int main(int argc, char ** argv) try
 {
-    glm::vec3 position;
-    glm::vec3 normal;
-    std::uint8_t bone_ids[2];
-    std::uint8_t bone_weights[2];
-};
+    render_options options = parse_options(argc, argv);
+    if (options.memory_stats >= 0.f)
+        track_memory_peaks();
 
-struct bone
-{
-    std::int32_t parent_id;
-    glm::vec3 offset;
-    glm::quat rotation;
-};
-
-struct bone_pose
-{
-    glm::quat rotation = glm::quat(1.f, 0.f, 0.f, 0.f);
-    float scale = 1.f;
-    glm::vec3 translation = glm::vec3(0.f, 0.f, 0.f);
-};
-
-bone_pose operator * (bone_pose const & p1, bone_pose const & p2)
-{
-    return {p1.rotation * p2.rotation, p1.scale * p2.scale, p1.scale * glm::rotate(p1.rotation, p2.translation) + p1.translation};
-}
-
-void eval_bone_transforms(std::vector<bone_pose> & bp, std::vector<std::vector<bone_pose>> & poses,
-                          std::vector<bone> & bones, int n, float t) {
-
-
-    int n1 = (n+1)%6;
-    bone_pose p0, p1, res;
-    for (int i = 0; i<bones.size(); i++) {
-        if (bones[i].parent_id == -1) {
-            bp[i] = poses[n][i];
-            continue;
-        }
-        p0 = bp[bones[i].parent_id] * poses[n][i];
-        p1 = bp[bones[i].parent_id] * poses[n1][i];
+    // stdout carries the video stream, keep the log out of it
+    if (options.stream_path == "-")
+        std::cout.rdbuf(std::cerr.rdbuf());
 
-        res.rotation = glm::slerp(p0.rotation, p1.rotation, 3 * t * t - 2 * t * t * t);
-        res.translation = glm::mix(p0.translation, p1.translation, 3 * t * t - 2 * t * t * t);
-        res.scale = glm::mix(p0.scale, p1.scale, 3 * t * t - 2 * t * t * t);
-        bp[i] = res;
-    }
-}
-
-int main() try
-{
     if (SDL_Init(SDL_INIT_VIDEO) != 0)
         sdl2_fail("SDL_Init: ");
 
@@ -97,8 +88,10 @@ int main() try
     SDL_Window * window = SDL_CreateWindow("Graphics course practice 10",
                                            SDL_WINDOWPOS_CENTERED,
                                            SDL_WINDOWPOS_CENTERED,
-                                           800, 600,
-                                           SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE | SDL_WINDOW_MAXIMIZED);
+                                           options.width, options.height,
+                                           options.batch()
+                                               ? SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN
+                                               : SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE | SDL_WINDOW_MAXIMIZED);
 
     if (!window)
         sdl2_fail("SDL_CreateWindow: ");
@@ -120,9 +113,57 @@ int main() try
 
     glClearColor(0.8f, 0.8f, 1.f, 0.f);
 
-    auto vertex_shader = create_shader(GL_VERTEX_SHADER, vertex_shader_source);
-    auto fragment_shader = create_shader(GL_FRAGMENT_SHADER, fragment_shader_source);
-    auto program = create_program(vertex_shader, fragment_shader);
+    view_layout views = make_view_layout(options.views, width, height);
+
+    // every view is a tile of one texture, so the atlas has to fit the driver's limit
+    int max_target_size = max_render_target_size();
+    if (views.atlas_width() > max_target_size || views.atlas_height() > max_target_size)
+        throw std::runtime_error(std::to_string(views.count) + " views of " + std::to_string(width) + "x" + std::to_string(height)
+                                 + " need a " + std::to_string(views.atlas_width()) + "x" + std::to_string(views.atlas_height())
+                                 + " atlas, the driver allows at most " + std::to_string(max_target_size) + " pixels per side");
+
+    int max_samples = max_render_target_samples(options.aux_targets);
+    if (options.samples > max_samples)
+        throw std::runtime_error("--samples " + std::to_string(options.samples) + " is more than the driver allows for these targets ("
+                                 + std::to_string(max_samples) + ")");
+
+    GLint max_viewports = 0;
+    if (GLEW_ARB_viewport_array)
+        glGetIntegerv(GL_MAX_VIEWPORTS, &max_viewports);
+
+    // with viewport arrays a geometry shader routes each triangle to every tile in one draw,
+    // otherwise the tiles are drawn one by one
+    bool layered_views = views.count > 1 && !options.view_loop && views.count <= max_viewports;
+
+    character_assets character = load_character(PRACTICE_SOURCE_DIRECTORY, options.mesh_path);
+    auto const & mesh = character.mesh;
+    auto const & vertices = mesh.vertices;
+    auto const & bones = character.bones;
+
+    std::cout << "Loaded " << vertices.size() << " vertices, " << mesh.lods.front().index_count << " indices, "
+              << bones.size() << " bones, " << mesh.lods.size() << (mesh.lods.size() > 1 ? " levels of detail" : " level of detail")
+              << " (" << vertex_format_name(mesh.layout.format) << " vertices with " << mesh.layout.influences << " "
+              << 8 * mesh.layout.bone_id_size << "-bit bone ids, " << 8 * mesh.index_size() << "-bit indices, "
+              << mesh.vertex_bytes() + mesh.index_bytes()
+              << " bytes of geometry)" << std::endl;
+
+    bool compact_mesh = mesh.layout.format == vertex_format::compact;
+
+    std::string shader_defines = "#define BONE_COUNT " + std::to_string(character.palette_size)
+        + "\n#define BONE_INFLUENCES " + std::to_string(mesh.layout.influences) + "\n";
+    if (layered_views)
+        shader_defines += "#define MULTIVIEW\n#define VIEW_COUNT " + std::to_string(views.count)
+            + "\n#define VIEW_VERTEX_COUNT " + std::to_string(3 * views.count) + "\n";
+    if (options.aux_targets)
+        shader_defines += "#define AUX_TARGETS\n";
+    if (compact_mesh)
+        shader_defines += "#define COMPACT_VERTICES\n";
+
+    auto vertex_shader = create_shader(GL_VERTEX_SHADER, vertex_shader_source, shader_defines);
+    auto fragment_shader = create_shader(GL_FRAGMENT_SHADER, fragment_shader_source, shader_defines);
+    auto program = layered_views
+        ? create_program(vertex_shader, create_shader(GL_GEOMETRY_SHADER, multiview_geometry_shader_source, shader_defines), fragment_shader)
+        : create_program(vertex_shader, fragment_shader);
 
     GLuint model_location = glGetUniformLocation(program, "model");
     GLuint view_location = glGetUniformLocation(program, "view");
@@ -130,163 +171,511 @@ int main() try
 
     GLuint camera_position_location = glGetUniformLocation(program, "camera_position");
 
+    GLuint view_projection_location = glGetUniformLocation(program, "view_projection");
+    GLuint view_camera_position_location = glGetUniformLocation(program, "view_camera_position");
+    GLuint view_matrix_location = glGetUniformLocation(program, "view_matrix");
+
     GLuint ambient_location = glGetUniformLocation(program, "ambient");
     GLuint light_direction_location = glGetUniformLocation(program, "light_direction");
     GLuint light_color_location = glGetUniformLocation(program, "light_color");
 
-    std::vector<GLuint> bone_rot_loc(61);
-    std::vector<GLuint> bone_trans_loc(61);
-    std::vector<GLuint> bone_scale_loc(61);
-
-    for (int i = 0; i<61; i++) {
-        bone_rot_loc[i] = glGetUniformLocation(program, ("bone_rotation[" + std::to_string(i) + "]").c_str());
-        bone_trans_loc[i] = glGetUniformLocation(program, ("bone_translation[" + std::to_string(i) + "]").c_str());
-        bone_scale_loc[i] = glGetUniformLocation(program, ("bone_scale[" + std::to_string(i) + "]").c_str());
+    // the palette as the std140 bone_palette block lays it out: rotations, translations with the scale, labels
+    std::size_t palette_size = character.palette_size;
+    std::size_t palette_bytes = 2 * palette_size * sizeof(glm::vec4) + (palette_size + 3) / 4 * sizeof(glm::uvec4);
+    GLint max_block_size = 0;
+    glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &max_block_size);
+    if (palette_bytes > std::size_t(max_block_size))
+        throw std::runtime_error("A palette of " + std::to_string(palette_size) + " bones needs " + std::to_string(palette_bytes)
+                                 + " bytes of uniforms, the driver allows " + std::to_string(max_block_size));
+
+    GLuint palette_buffer;
+    glGenBuffers(1, &palette_buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, palette_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, GLsizeiptr(palette_bytes), nullptr, GL_DYNAMIC_DRAW);
+    track_gl_object(gl_object_kind::buffer, palette_buffer, palette_bytes);
+    {
+        std::vector<GLuint> labels((palette_size + 3) / 4 * 4);
+        for (std::size_t i = 0; i < labels.size(); ++i)
+            labels[i] = GLuint(i < character.source_bone_ids.size() ? character.source_bone_ids[i] : i);
+
+        // the bones target is 8-bit, with 255 for the background
+        if (options.aux_targets & aux_bit(aux_bones))
+            for (std::size_t i = 0; i < palette_size; ++i)
+                if (labels[i] >= 255)
+                    throw std::runtime_error("--aux bones stores bone labels in 8 bits, bone " + std::to_string(labels[i])
+                                             + " does not fit");
+        glBufferSubData(GL_UNIFORM_BUFFER, GLintptr(2 * palette_size * sizeof(glm::vec4)),
+                        GLsizeiptr(labels.size() * sizeof(GLuint)), labels.data());
     }
-
-    std::vector<vertex> vertices;
-    std::vector<std::uint32_t> indices;
-    std::vector<bone> bones;
-    std::vector<std::vector<bone_pose>> poses(6);
-
+    glUniformBlockBinding(program, glGetUniformBlockIndex(program, "bone_palette"), 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, palette_buffer);
+
+    std::vector<float> radii = bone_radii(vertices, bones);
+
+    // shared buffers for every mesh of the layout; the character is the only one so far
+    geometry_buffer geometry(mesh.layout);
+    mesh_range character_range = geometry.add(mesh);
+
+    std::vector<mesh_range> lod_ranges;
+    for (auto const & lod : mesh.lods)
+        lod_ranges.push_back(sub_range(character_range, lod.first_index, lod.index_count));
+    lod_selector lods(mesh.lods, mesh.bounds, options.lod_error);
+    meshlet_culler culler(mesh);
+    // meshlets drawn and meshlets considered, summed over views and frames
+    std::uint64_t meshlets_drawn = 0;
+    std::uint64_t meshlets_total = 0;
+    // bones re-posed and bones in the skeleton, summed over frames
+    std::uint64_t bones_evaluated = 0;
+    std::uint64_t bones_total = 0;
+
+    glUseProgram(program);
+
+    if (compact_mesh)
     {
-        std::ifstream file(PRACTICE_SOURCE_DIRECTORY "/human.bin", std::ios::binary);
-
-        std::uint32_t vertex_count;
-        std::uint32_t index_count;
-        file.read((char*)(&vertex_count), sizeof(vertex_count));
-        file.read((char*)(&index_count), sizeof(index_count));
-        vertices.resize(vertex_count);
-        indices.resize(index_count);
-        file.read((char*)vertices.data(), vertices.size() * sizeof(vertices[0]));
-        file.read((char*)indices.data(), indices.size() * sizeof(indices[0]));
+        glm::vec3 extent = character_range.bounds.extent();
+        glUniform3f(glGetUniformLocation(program, "mesh_bounds_min"), character_range.bounds.min.x,
+                    character_range.bounds.min.y, character_range.bounds.min.z);
+        glUniform3f(glGetUniformLocation(program, "mesh_bounds_extent"), extent.x, extent.y, extent.z);
     }
 
-    {
-        std::ifstream file(PRACTICE_SOURCE_DIRECTORY "/bones.bin", std::ios::binary);
 
-        std::uint32_t bone_count;
-        file.read((char*)(&bone_count), sizeof(bone_count));
-        bones.resize(bone_count);
-        file.read((char*)(bones.data()), bones.size() * sizeof(bones[0]));
-    }
+//    ------------------------------------------
 
-    for (std::size_t i = 0; i < 6; ++i)
-    {
-        std::ifstream file(PRACTICE_SOURCE_DIRECTORY "/pose_" + std::to_string(i) + ".bin", std::ios::binary);
+    // resizes and size changes reuse pooled targets instead of reallocating attachments
+    render_target_pool target_pool(std::size_t(options.target_budget_mb) << 20);
+    render_target target = target_pool.acquire(views.atlas_width(), views.atlas_height(), options.aux_targets, options.samples);
+    // the single-sample copy a multisampled target is read back and shown through
+    render_target resolved;
+
+    // color is read back in the driver's layout, swizzled and flipped on the CPU in one pass
+    read_layout color_layout = native_read_layout();
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+//    -------------------------------------------
+
+    // the displayed image goes through these passes; without any it is blitted or drawn directly
+    post_chain post(options.post_effects);
+
+    auto last_frame_start = std::chrono::high_resolution_clock::now();
+
+    float time = 0.f;
+
+    std::map<SDL_Keycode, bool> button_down;
+
+    float view_angle = 0.f;
+    float camera_distance = 3.f;
+    float camera_height = 1.2f;
+
+    float model_rotation = 0.f;
+
+    bool save = false;
+
+    // interactive viewers only redraw when the frame state changes and sleep in SDL while nothing does;
+    // batch runs and streams produce every frame
+    bool on_demand = !options.batch() && options.stream_path.empty();
+    bool animate = options.batch() || !options.paused;
+    bool redraw = true;
+    frame_state presented;
+
+    // a batch knows how many images its shards will index
+    std::size_t shard_frames = options.batch() ? std::size_t(options.frames) * views.count : 0;
 
-        poses[i].resize(bones.size());
-        file.read((char*)(poses[i].data()), poses[i].size() * sizeof(poses[i][0]));
+    std::unique_ptr<shard_writer> shard;
+    if (!options.shard_path.empty()) {
+        shard = std::make_unique<shard_writer>(options.shard_path);
+        shard->reserve(shard_frames);
     }
 
-    std::cout << "Loaded " << vertices.size() << " vertices, " << indices.size() << " indices, " << bones.size() << " bones" << std::endl;
+    std::unique_ptr<video_stream> stream;
+    if (!options.stream_path.empty())
+        stream = std::make_unique<video_stream>(options.stream_path, options.stream_type,
+                                                views.atlas_width(), views.atlas_height(), options.fps, color_layout.bgra());
+
+    std::uint64_t frame_id = 0;
+
+    // label targets are read back asynchronously and written once their fences signal
+    std::array<async_readback, aux_target_count> aux_readback{async_readback(aux_spec(aux_depth).name),
+                                                               async_readback(aux_spec(aux_normals).name),
+                                                               async_readback(aux_spec(aux_bones).name)};
+    std::array<std::unique_ptr<shard_writer>, aux_target_count> aux_shards;
+    if (shard)
+        for (int i = 0; i < aux_target_count; ++i)
+            if (options.aux_targets & aux_bit(i)) {
+                aux_shards[i] = std::make_unique<shard_writer>(options.shard_path + "." + aux_spec(i).name);
+                aux_shards[i]->reserve(shard_frames);
+            }
 
-    std::vector<bone_pose> bone_transforms(61);
+    // so is color; what each color readback is for waits in `color_jobs`, in the same order
+    struct color_request
+    {
+        std::uint64_t frame_id;
+        int view;
+        bool capture;
+        bool stream;
+    };
+    async_readback color_readback("color");
+    std::vector<color_request> color_jobs;
+    {
+        memory_scope scope(memory_category::queues);
+        color_jobs.reserve(64);
+    }
 
-    GLuint vao, vbo, ebo;
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
+    // file names of a capture: frame_<id>[_<view>] in batches, pict[_<view>] otherwise, built in the thread arena
+    auto capture_name = [&](std::uint64_t frame, int v, char const * suffix) {
+        auto & arena = thread_arena();
+        char const * base = options.batch() ? arena.print("frame_%llu", static_cast<unsigned long long>(frame)) : "pict";
+        return views.count > 1 && v >= 0 ? arena.print("%s_%d%s", base, v, suffix) : arena.print("%s%s", base, suffix);
+    };
 
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vertices[0]), vertices.data(), GL_STATIC_DRAW);
+    auto write_aux_tile = [&](int i, std::uint64_t frame, int v, int w, int h, std::vector<char> const & image, int crop_x, int crop_y) {
+        arena_scope scope;
+        if (aux_shards[i])
+            append_aux_image(*aux_shards[i], i, frame * views.count + v, w, h, image, crop_x, crop_y);
+        else
+            save_aux_image(i, capture_name(frame, v, thread_arena().print("_%s", aux_spec(i).name)), w, h, image);
+    };
 
-    glGenBuffers(1, &ebo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(indices[0]), indices.data(), GL_STATIC_DRAW);
+    auto write_aux = [&](int i, readback_result const & result) {
+        if (options.crop) {
+            // cropped captures read every view on its own, tagged with its shard frame id
+            int v = int(result.tag % views.count);
+            int crop_x = result.x - views.tile_x(v);
+            int crop_y = views.tile_y(v) + views.tile_height - result.y - result.height;
+            write_aux_tile(i, result.tag / views.count, v, result.width, result.height, result.pixels, crop_x, crop_y);
+            return;
+        }
 
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*)(0));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (void*)(12));
-    glEnableVertexAttribArray(2);
-    glVertexAttribIPointer(2, 2, GL_UNSIGNED_BYTE, sizeof(vertex), (void*)(24));
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 2, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(vertex), (void*)(26));
+        view_layout layout = make_view_layout(views.count, result.width / views.columns, result.height / views.rows);
+        std::vector<char> tile;
+        for (int v = 0; v < layout.count; ++v) {
+            if (layout.count > 1)
+                tile = extract_tile(result.pixels, layout, v, aux_spec(i).pixel_size);
+            write_aux_tile(i, result.tag, v, layout.tile_width, layout.tile_height, layout.count > 1 ? tile : result.pixels, 0, 0);
+            pixel_buffers().release(std::move(tile));
+        }
+    };
 
+    // captured images are converted straight to what they are written as: RGB shards drop alpha
+    int capture_channel_count = shard ? capture_channels(options.shard_format) : 4;
+
+    // --bench-render times every frame from its animation to its last written output
+    std::unique_ptr<frame_profiler> profiler;
+    if (options.bench_render > 0)
+        profiler = std::make_unique<frame_profiler>(options.frames);
+    frame_profiler * profile = profiler.get();
+
+    // worker threads for the CPU side of batches: animation, encoding and writing run as jobs
+    job_system jobs(options.workers < 0 ? job_system::default_workers() : unsigned(options.workers), options.pin_threads);
+
+    // captures are encoded on the workers, then written in order by write_color
+    bool png_captures = !shard || options.shard_format == frame_format::png;
+    auto encode_color = [&](int w, int h, std::vector<char> image) {
+        if (!png_captures)
+            return image;
+        auto png = encode_png(w, h, capture_channel_count, image);
+        pixel_buffers().release(std::move(image));
+        return png;
+    };
 
-//    ------------------------------------------
+    // the encoded buffer goes back to the pool once written
+    auto write_color = [&](std::uint64_t frame, int v, int w, int h, std::vector<char> && data, int crop_x, int crop_y) {
+        if (shard)
+            shard->append(frame * views.count + v, w, h, options.shard_format, data.data(), data.size(), crop_x, crop_y);
+        else {
+            arena_scope scope;
+            save_encoded(capture_name(frame, v, ".png"), data);
+        }
+        pixel_buffers().release(std::move(data));
+    };
 
-    GLuint framebuffer;
-    glGenFramebuffers(1, &framebuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    // shards get one JSON line per frame in a sidecar file, PNG captures a file each
+    std::ofstream keypoints_file;
+    if (options.keypoints && shard)
+        keypoints_file.open(options.shard_path + ".keypoints.jsonl");
+
+    // converts and encodes the captures of a color readback; outputs of different frames are encoded
+    // at once, and the tiles of an atlas in parallel
+    auto encode_output = [&](output_job & job) {
+        if (job.kind != output_job::color)
+            return;
+
+        arena_scope scope;
+        auto start = frame_profiler::clock::now();
+        auto const & image = job.image;
+        if (job.view >= 0) {
+            job.encoded.resize(1);
+            job.encoded[0] = encode_color(image.width, image.height,
+                                          convert_region(image.pixels, image.width, 0, 0, image.width, image.height,
+                                                         color_layout.bgra(), capture_channel_count));
+        }
+        else if (job.capture) {
+            // one transfer for all views, split into tiles while converting
+            job.encoded.resize(views.count);
+            jobs.parallel_for(0, views.count, 1, [&](std::size_t first, std::size_t last) {
+                for (int v = int(first); v < int(last); ++v)
+                    job.encoded[v] = encode_color(views.tile_width, views.tile_height,
+                                                  convert_region(image.pixels, image.width, views.tile_x(v), views.tile_y(v),
+                                                                 views.tile_width, views.tile_height, color_layout.bgra(),
+                                                                 capture_channel_count));
+            });
+        }
+        job.encode_time = frame_profiler::clock::now() - start;
+    };
 
-    GLuint renderedTexture;
-    glGenTextures(1, &renderedTexture);
-    glBindTexture(GL_TEXTURE_2D, renderedTexture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    // the only place files, shards and the stream are written: in order, after encode_output
+    auto write_output = [&](output_job & job) {
+        arena_scope scope;
+        switch (job.kind)
+            {
+                case output_job::aux:
+                    timed_stage(profile, job.frame_id, bench_stage::write, [&] { write_aux(job.target, job.image); });
+                    pixel_buffers().release(std::move(job.image.pixels));
+                    break;
+                case output_job::metadata: {
+                    stage_timer timer(profile, job.frame_id, bench_stage::write);
+                    if (!job.keypoints_json.empty()) {
+                        if (keypoints_file.is_open())
+                            keypoints_file << job.keypoints_json;
+                        else
+                            std::ofstream(capture_name(job.frame_id, -1, "_keypoints.json")) << job.keypoints_json;
+                    }
 
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, renderedTexture, 0);
+                    // shards keep the crop offsets in their index, PNG captures get a sidecar file
+                    if (!job.crops.empty()) {
+                        std::ofstream crop_file(capture_name(job.frame_id, -1, "_crop.json"));
+                        crop_file << "{\"frame\":" << job.frame_id << ",\"crops\":[";
+                        for (std::size_t v = 0; v < job.crops.size(); ++v)
+                            crop_file << (v ? "," : "") << '[' << job.crops[v].x << ',' << job.crops[v].y << ','
+                                      << job.crops[v].width << ',' << job.crops[v].height << ']';
+                        crop_file << "]}\n";
+                    }
+                    break;
+                }
+                case output_job::color: {
+                    auto const & image = job.image;
+                    if (profile && (job.view >= 0 || job.capture))
+                        profile->add(job.frame_id, bench_stage::encode, job.encode_time);
+
+                    if (job.view >= 0) {
+                        int v = job.view;
+                        int crop_x = image.x - views.tile_x(v);
+                        int crop_y = views.tile_y(v) + views.tile_height - image.y - image.height;
+                        timed_stage(profile, job.frame_id, bench_stage::write, [&] {
+                            write_color(job.frame_id, v, image.width, image.height, std::move(job.encoded[0]), crop_x, crop_y);
+                        });
+                        pixel_buffers().release(std::move(job.image.pixels));
+                        break;
+                    }
 
-    GLenum DrawBuffers[1] = {GL_COLOR_ATTACHMENT0};
-    glDrawBuffers(1, DrawBuffers);
+                    if (job.capture) {
+                        stage_timer timer(profile, job.frame_id, bench_stage::write);
+                        for (int v = 0; v < views.count; ++v)
+                            write_color(job.frame_id, v, views.tile_width, views.tile_height, std::move(job.encoded[v]), 0, 0);
+                    }
 
-    GLuint depthrenderbuffer;
-    glGenRenderbuffers(1, &depthrenderbuffer);
-    glBindRenderbuffer(GL_RENDERBUFFER, depthrenderbuffer);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width, height);
+                    // the stream gives the pixels back to the pool once it has written them
+                    if (job.stream)
+                        timed_stage(profile, job.frame_id, bench_stage::write, [&] {
+                            stream->push(image.width, image.height, std::move(job.image.pixels));
+                        });
+                    else
+                        pixel_buffers().release(std::move(job.image.pixels));
+                    break;
+                }
+            }
 
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthrenderbuffer);
+        if (profile)
+            profile->finish(job.frame_id);
+    };
 
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        return false;
+    bool running = true;
 
-//    -------------------------------------------
+    if (options.bench_readback > 0) {
+        bench_readback(target, options.bench_readback, std::cout);
+        running = false;
+    }
 
-    GLuint quad_VertexArrayID;
-    glGenVertexArrays(1, &quad_VertexArrayID);
-    glBindVertexArray(quad_VertexArrayID);
-
-    static const GLfloat g_quad_vertex_buffer_data[] = {
-            -1.0f, -1.0f, 0.0f,
-            1.0f, -1.0f, 0.0f,
-            -1.0f,  1.0f, 0.0f,
-            -1.0f,  1.0f, 0.0f,
-            1.0f, -1.0f, 0.0f,
-            1.0f,  1.0f, 0.0f,
+    // batches animate, draw and write at once: frame N+1 is animated and frame N-1 encoded and written
+    // as jobs on the pool while the GL thread draws frame N
+    bool pipelined = options.batch() && options.pipeline_depth > 0;
+    std::size_t pipeline_depth = std::max(options.pipeline_depth, 1);
+
+    frame_simulator simulator(character, radii, lods, culler, options);
+    frame_job inline_job;
+
+    // time the animation, encoding and writing jobs ran
+    stage_clock animate_time;
+    stage_clock encode_time;
+    stage_clock write_time;
+
+    // batches keep the camera they start with
+    camera_state batch_camera{view_angle, camera_distance, camera_height, model_rotation};
+    auto simulate = [&](frame_job & job) {
+        auto start = std::chrono::steady_clock::now();
+        camera_state frame_camera = batch_camera;
+        if (profile) {
+            profile->start(job.frame_id);
+            bench_frame(options.bench_seed, job.frame_id, job.time, frame_camera);
+        }
+        timed_stage(profile, job.frame_id, bench_stage::animation, [&] { simulator.run(job, frame_camera, views); });
+        animate_time.add(std::chrono::steady_clock::now() - start);
     };
 
-    GLuint rect_vao;
-    glGenVertexArrays(1, &rect_vao);
-    glBindVertexArray(rect_vao);
+    // the first error of an encoding or writing job; outputs after it are dropped and the batch stops
+    std::mutex output_error_mutex;
+    std::exception_ptr output_error;
+    std::atomic<bool> output_failed{false};
+    auto fail_output = [&] {
+        std::lock_guard lock(output_error_mutex);
+        if (!output_error)
+            output_error = std::current_exception();
+        output_failed.store(true);
+    };
 
-    GLuint quad_vertexbuffer;
-    glGenBuffers(1, &quad_vertexbuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, quad_vertexbuffer);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(g_quad_vertex_buffer_data), g_quad_vertex_buffer_data, GL_STATIC_DRAW);
+    auto run_encode = [&](output_job & job) {
+        auto start = std::chrono::steady_clock::now();
+        try {
+            if (!output_failed.load())
+                encode_output(job);
+        }
+        catch (...) {
+            fail_output();
+        }
+        encode_time.add(std::chrono::steady_clock::now() - start);
+    };
 
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 3, (void*) 0);
+    auto run_write = [&](output_job & job) {
+        auto start = std::chrono::steady_clock::now();
+        try {
+            if (!output_failed.load())
+                write_output(job);
+        }
+        catch (...) {
+            fail_output();
+        }
+        write_time.add(std::chrono::steady_clock::now() - start);
+    };
 
-    auto rect_vertex_shader = create_shader(GL_VERTEX_SHADER, rect_vertex_shader_source);
-    auto rect_fragment_shader = create_shader(GL_FRAGMENT_SHADER, rect_fragment_shader_source);
-    auto rect_program = create_program(rect_vertex_shader, rect_fragment_shader);
-    GLuint texID = glGetUniformLocation(rect_program, "renderedTexture");
-    GLuint timeID = glGetUniformLocation(rect_program, "time");
+    // a frame leaves the GL thread as color, aux and metadata outputs. The queues outlive none of the
+    // above, their jobs reference it
+    std::size_t outputs_per_frame = 2 + views.count * (1 + std::popcount(options.aux_targets));
+    job_queue<frame_job> frame_queue(jobs, pipeline_depth);
+    job_queue<output_job> output_queue(jobs, pipeline_depth * outputs_per_frame);
+
+    // frames are animated one after the other, the simulator carries the pose over, and each one
+    // is pushed to the GL thread. The frame number and clock belong to the chain of animation jobs
+    std::uint64_t animated_frames = 0;
+    float batch_time = 0.f;
+    auto animate_next = [&] {
+        batch_time += 1.f / options.fps;
+        frame_job & job = *frame_queue.queue().begin_push();
+        job.frame_id = animated_frames++;
+        job.capture = true;
+        job.time = batch_time;
+        simulate(job);
+        frame_queue.queue().end_push();
+    };
 
+    // the GL thread starts a frame's animation once there is room for it in the queue; each job
+    // captures one pointer, which std::function keeps inline
+    job_handle last_frame;
+    auto animate_frame = [&](std::uint64_t frame) {
+        if (frame >= std::uint64_t(options.frames))
+            return;
+        last_frame = jobs.spawn([run = &animate_next] { (*run)(); }, {last_frame});
+        frame_queue.track(frame, last_frame);
+    };
 
-    static_assert(sizeof(vertex) == 28);
+    // `fill` writes the job straight into a slot, reusing the strings and vectors of the job that was
+    // there before. Outputs are encoded as soon as they arrive and written in order; false once an
+    // output has failed, the end of the batch reports why
+    output_job inline_output;
+    std::uint64_t outputs_emitted = 0;
+    job_handle last_write;
+    auto emit = [&](auto && fill) {
+        if (!pipelined) {
+            fill(inline_output);
+            encode_output(inline_output);
+            write_output(inline_output);
+            return true;
+        }
+        if (output_failed.load())
+            return false;
+
+        std::uint64_t n = outputs_emitted++;
+        output_job & job = output_queue.begin_push(n);
+        fill(job);
+        output_queue.end_push();
+        job_handle encoded;
+        if (job.kind == output_job::color)
+            encoded = jobs.spawn([run = &run_encode, job = &job] { (*run)(*job); });
+        // writes pop the outputs in the order they were pushed
+        last_write = jobs.spawn([run = &run_write, queue = &output_queue.queue()] {
+            (*run)(*queue->begin_pop());
+            queue->end_pop();
+        }, {encoded, last_write});
+        output_queue.track(n, last_write);
+        return true;
+    };
 
-    auto last_frame_start = std::chrono::high_resolution_clock::now();
+    // hands finished readbacks on; with `wait` until none is left. Benchmarks charge the polls,
+    // waits included, to the frame whose readback they return
+    auto collect_readbacks = [&](bool wait) {
+        bool open = true;
+        auto poll_start = frame_profiler::clock::now();
+        auto charge_poll = [&](std::uint64_t frame) {
+            if (profile)
+                profile->add(frame, bench_stage::readback, frame_profiler::clock::now() - poll_start);
+        };
+        for (int i = 0; i < aux_target_count; ++i)
+            while (auto result = aux_readback[i].poll(wait)) {
+                std::uint64_t frame = options.crop ? result->tag / views.count : result->tag;
+                charge_poll(frame);
+                open = emit([&](output_job & job) {
+                    job.kind = output_job::aux;
+                    job.frame_id = frame;
+                    job.target = i;
+                    job.image = std::move(*result);
+                }) && open;
+                poll_start = frame_profiler::clock::now();
+            }
+        while (auto result = color_readback.poll(wait)) {
+            color_request request = color_jobs.front();
+            color_jobs.erase(color_jobs.begin());
+            charge_poll(request.frame_id);
+            open = emit([&](output_job & job) {
+                job.kind = output_job::color;
+                job.frame_id = request.frame_id;
+                job.view = request.view;
+                job.capture = request.capture;
+                job.stream = request.stream;
+                job.image = std::move(*result);
+            }) && open;
+            poll_start = frame_profiler::clock::now();
+        }
+        return open;
+    };
 
-    float time = 0.f;
+    // heap use is compared from the frame where the slots, pools and arenas have filled up
+    std::uint64_t warm_frames = std::min<std::uint64_t>(options.frames, 2 * pipeline_depth + 2);
+    heap_counters warm_heap = heap_usage();
 
-    std::map<SDL_Keycode, bool> button_down;
+    auto pipeline_start = std::chrono::steady_clock::now();
 
-    float view_angle = 0.f;
-    float camera_distance = 3.f;
-    float camera_height = 1.2f;
+    // the first frames are animated ahead; each one the GL thread is done with starts another
+    if (pipelined && running)
+        for (std::uint64_t frame = 0; frame < pipeline_depth; ++frame)
+            animate_frame(frame);
 
-    float model_rotation = 0.f;
+    // a window drag sends a stream of resizes, the target follows once the size settles
+    auto const resize_settle = std::chrono::milliseconds(150);
+    auto last_resize = std::chrono::high_resolution_clock::now();
+    bool resize_pending = false;
 
-    bool save = false;
+    auto last_memory_line = std::chrono::high_resolution_clock::now();
 
-    bool running = true;
-    while (running)
-    {
-        for (SDL_Event event; SDL_PollEvent(&event);) switch (event.type)
+    auto handle_event = [&](SDL_Event const & event) {
+        switch (event.type)
             {
                 case SDL_QUIT:
                     running = false;
@@ -297,31 +686,71 @@ int main() try
                             width = event.window.data1;
                             height = event.window.data2;
 
-                            glBindRenderbuffer(GL_RENDERBUFFER, depthrenderbuffer);
-                            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width, height);
-
-                            glBindTexture(GL_TEXTURE_2D, renderedTexture);
-                            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+                            last_resize = std::chrono::high_resolution_clock::now();
+                            resize_pending = true;
 
                             glViewport(0, 0, width, height);
                             break;
+                        case SDL_WINDOWEVENT_EXPOSED:
+                            redraw = true;
+                            break;
                     }
                     break;
                 case SDL_KEYDOWN:
                     button_down[event.key.keysym.sym] = true;
+                    if (event.key.keysym.sym == SDLK_SPACE && !event.key.repeat)
+                        animate = !animate;
                     break;
                 case SDL_KEYUP:
                     button_down[event.key.keysym.sym] = false;
                     break;
             }
+    };
+
+    while (running)
+    {
+        bool input = button_down[SDLK_UP] || button_down[SDLK_DOWN] || button_down[SDLK_LEFT] || button_down[SDLK_RIGHT]
+            || button_down[SDLK_p];
+
+        if (on_demand && !animate && !input && !redraw) {
+            // nothing can change until an event arrives or a pending resize settles; otherwise
+            // the timeout only bounds the sleep. A capture taken just before is written first
+            collect_readbacks(true);
+            auto timeout = std::chrono::milliseconds(250);
+            if (resize_pending)
+                timeout = std::max(std::chrono::milliseconds(0), std::chrono::ceil<std::chrono::milliseconds>(
+                    last_resize + resize_settle - std::chrono::high_resolution_clock::now()));
+            if (SDL_Event event; timeout.count() > 0 && SDL_WaitEventTimeout(&event, int(timeout.count())))
+                handle_event(event);
+            last_frame_start = std::chrono::high_resolution_clock::now();
+        }
+
+        for (SDL_Event event; SDL_PollEvent(&event);)
+            handle_event(event);
 
         if (!running)
             break;
 
         auto now = std::chrono::high_resolution_clock::now();
-        float dt = std::chrono::duration_cast<std::chrono::duration<float>>(now - last_frame_start).count();
+
+        if (options.memory_stats > 0.f && now - last_memory_line >= std::chrono::duration<float>(options.memory_stats)) {
+            print_memory_line(std::cout);
+            last_memory_line = now;
+        }
+
+        if (resize_pending && now - last_resize >= resize_settle) {
+            resize_pending = false;
+            views = make_view_layout(views.count, width, height);
+            target_pool.release(target);
+            target = target_pool.acquire(views.atlas_width(), views.atlas_height(), options.aux_targets, options.samples);
+        }
+
+        float dt = options.batch()
+            ? 1.f / options.fps
+            : std::chrono::duration_cast<std::chrono::duration<float>>(now - last_frame_start).count();
         last_frame_start = now;
-        time += dt;
+        if (animate)
+            time += dt;
 
         if (button_down[SDLK_UP])
             camera_distance -= 3.f * dt;
@@ -337,80 +766,295 @@ int main() try
             save = true;
         }
 
-        glClearColor(0.8f, 0.8f, 1.f, 0.f);
+        frame_state state{view_angle, camera_distance, camera_height, model_rotation, time, width, height};
+        if (on_demand && !save && !redraw && state == presented)
+            continue;
+        presented = state;
+        redraw = false;
+
+        bool capture = save || options.batch();
+
+        frame_job * job = &inline_job;
+        if (pipelined)
+            job = &frame_queue.begin_pop(frame_id);
+        else {
+            inline_job.frame_id = frame_id;
+            inline_job.capture = capture;
+            inline_job.time = time;
+
+            camera_state camera{view_angle, camera_distance, camera_height, model_rotation};
+            if (profile) {
+                profile->start(frame_id);
+                bench_frame(options.bench_seed, frame_id, inline_job.time, camera);
+            }
+            timed_stage(profile, frame_id, bench_stage::animation, [&] { simulator.run(inline_job, camera, views); });
+        }
+
+        // benchmarks charge the GL thread's time between laps to the stages of the frame
+        auto lap_start = frame_profiler::clock::now();
+        auto lap = [&](bench_stage stage) {
+            auto now = frame_profiler::clock::now();
+            if (profile)
+                profile->add(job->frame_id, stage, now - lap_start);
+            lap_start = now;
+        };
 
-        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-        glViewport(0, 0, width, height);
+        // the offscreen target is only needed for readbacks, aux labels, the atlas of several views,
+        // post-processing and multisampling; otherwise the frame is drawn straight into the window
+        bool direct = !options.batch() && !capture && !stream && !target.aux_mask && views.count == 1 && post.empty()
+            && target.samples == 1;
 
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glClearColor(0.8f, 0.8f, 1.f, 0.f);
+
+        if (direct) {
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glViewport(0, 0, width, height);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        }
+        else {
+            glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+            glViewport(0, 0, target.width, target.height);
+            clear_render_target(target);
+        }
         glEnable(GL_DEPTH_TEST);
         glEnable(GL_CULL_FACE);
+        lap(bench_stage::draw);
 
         glUseProgram(program);
 
-        float near = 0.1f;
-        float far = 100.f;
+        {
+            auto const & bone_transforms = job->bone_transforms;
+            arena_scope scope;
+            arena_vector<glm::vec4> palette(2 * palette_size);
+            for (std::size_t i = 0; i < palette_size; ++i)
+            {
+                auto const & pose = bone_transforms[i];
+                palette[i] = glm::vec4(pose.rotation.w, pose.rotation.x, pose.rotation.y, pose.rotation.z);
+                palette[palette_size + i] = glm::vec4(pose.translation, pose.scale);
+            }
+            glBindBuffer(GL_UNIFORM_BUFFER, palette_buffer);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, GLsizeiptr(palette.size() * sizeof(glm::vec4)), palette.data());
+        }
+        bones_evaluated += job->bones_evaluated;
+        bones_total += bones.size();
 
-        glm::mat4 model(1.f);
-        model = glm::rotate(model, model_rotation, {0.f, 1.f, 0.f});
-        model = glm::rotate(model, -glm::pi<float>() / 2.f, {1.f, 0.f, 0.f});
+        glUseProgram(program);
+        glUniformMatrix4fv(model_location, 1, GL_FALSE, reinterpret_cast<float const *>(&job->model));
+        glUniformMatrix4fv(projection_location, 1, GL_FALSE, reinterpret_cast<float const *>(&job->projection));
 
-        glm::mat4 view(1.f);
-        view = glm::translate(view, {0.f, -camera_height, -camera_distance});
-        view = glm::rotate(view, view_angle, {1.f, 0.f, 0.f});
+        glUniform3f(ambient_location, 0.2f, 0.2f, 0.4f);
+        glUniform3f(light_direction_location, 1.f / std::sqrt(3.f), 1.f / std::sqrt(3.f), 1.f / std::sqrt(3.f));
+        glUniform3f(light_color_location, 0.8f, 0.3f, 0.f);
 
-        glm::mat4 projection = glm::perspective(glm::pi<float>() / 2.f, (1.f * width) / height, near, far);
+        geometry.bind();
+        lap(bench_stage::upload);
 
-        glm::vec3 camera_position = (glm::inverse(view) * glm::vec4(0.f, 0.f, 0.f, 1.f)).xyz();
+        auto const & scissors = job->scissors;
 
-        int numpose = (int) floor(time) % 6;
-        float ts = time - floor(time);
+        // levels without meshlets are drawn whole
+        bool meshlets = culler.has_meshlets(job->lod);
+        auto draw_character = [&](std::span<std::uint32_t const> listed) {
+            if (!meshlets) {
+                geometry.draw(lod_ranges[job->lod]);
+                return;
+            }
+            geometry.draw(character_range, mesh.meshlets, listed);
+            meshlets_drawn += listed.size();
+            meshlets_total += culler.meshlet_count(job->lod);
+        };
+
+        // the bounds are conservative, so the scissor never cuts the character
+        if (options.crop)
+            glEnable(GL_SCISSOR_TEST);
+
+        for (int v = 0; v < views.count; ++v) {
+            if (layered_views) {
+                glViewportIndexedf(v, views.tile_x(v), views.tile_y(v), views.tile_width, views.tile_height);
+                if (options.crop)
+                    glScissorIndexed(v, scissors[v].x, scissors[v].y, scissors[v].width, scissors[v].height);
+                continue;
+            }
 
-        eval_bone_transforms(bone_transforms, poses, bones, numpose, ts);
+            glViewport(views.tile_x(v), views.tile_y(v), views.tile_width, views.tile_height);
+            if (options.crop)
+                glScissor(scissors[v].x, scissors[v].y, scissors[v].width, scissors[v].height);
+            glUniformMatrix4fv(view_location, 1, GL_FALSE, reinterpret_cast<float const *>(&job->views[v]));
+            glUniform3fv(camera_position_location, 1, reinterpret_cast<float const *>(&job->camera_positions[v]));
+            draw_character(job->view_meshlets[v]);
+        }
 
-        for (int i = 0; i<bone_transforms.size(); i++) {
-            glUniform1f(bone_scale_loc[i], bone_transforms[i].scale);
-            glUniform3f(bone_trans_loc[i], bone_transforms[i].translation.x, bone_transforms[i].translation.y, bone_transforms[i].translation.z);
-            glUniform4f(bone_rot_loc[i], bone_transforms[i].rotation.w, bone_transforms[i].rotation.x, bone_transforms[i].rotation.y, bone_transforms[i].rotation.z);
+        if (layered_views) {
+            glUniformMatrix4fv(view_projection_location, views.count, GL_FALSE, reinterpret_cast<float const *>(job->view_projections.data()));
+            glUniform3fv(view_camera_position_location, views.count, reinterpret_cast<float const *>(job->camera_positions.data()));
+            glUniformMatrix4fv(view_matrix_location, views.count, GL_FALSE, reinterpret_cast<float const *>(job->views.data()));
+            draw_character(job->meshlets);
         }
 
-        glUseProgram(program);
-        glUniformMatrix4fv(model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
-        glUniformMatrix4fv(view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
-        glUniformMatrix4fv(projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
+        glDisable(GL_SCISSOR_TEST);
 
-        glUniform3fv(camera_position_location, 1, (float*)(&camera_position));
+        if (!direct && target.samples > 1) {
+            if (resolved.storage_width < target.width || resolved.storage_height < target.height) {
+                target_pool.release(resolved);
+                resolved = target_pool.acquire(target.width, target.height, target.aux_mask);
+            }
+            resolve_render_target(target, resolved);
+        }
+        render_target const & readable = target.samples > 1 ? resolved : target;
+        lap(bench_stage::draw);
+
+        if (capture && (options.keypoints || (options.crop && !shard))) {
+            running = emit([&](output_job & metadata) {
+                metadata.kind = output_job::metadata;
+                metadata.frame_id = job->frame_id;
+                metadata.keypoints_json.assign(job->keypoints_json);
+                if (options.crop && !shard)
+                    metadata.crops.assign(job->crops.begin(), job->crops.end());
+                else
+                    metadata.crops.clear();
+            }) && running;
+            // written inline without a pipeline, and timed there
+            lap_start = frame_profiler::clock::now();
+        }
 
-        glUniform3f(ambient_location, 0.2f, 0.2f, 0.4f);
-        glUniform3f(light_direction_location, 1.f / std::sqrt(3.f), 1.f / std::sqrt(3.f), 1.f / std::sqrt(3.f));
-        glUniform3f(light_color_location, 0.8f, 0.3f, 0.f);
+        if (capture && readable.aux_mask) {
+            for (int i = 0; i < aux_target_count; ++i) {
+                if (!readable.aux[i])
+                    continue;
+                auto const & spec = aux_spec(i);
+                glReadBuffer(GL_COLOR_ATTACHMENT1 + i);
+                if (!options.crop) {
+                    aux_readback[i].start(job->frame_id, 0, 0, readable.width, readable.height, spec.format, spec.type, spec.pixel_size);
+                    continue;
+                }
+                for (int v = 0; v < views.count; ++v)
+                    aux_readback[i].start(job->frame_id * views.count + v, scissors[v].x, scissors[v].y, scissors[v].width, scissors[v].height,
+                                          spec.format, spec.type, spec.pixel_size);
+            }
+            glReadBuffer(GL_COLOR_ATTACHMENT0);
+        }
+
+        // color is read in the driver's layout and converted on the output side
+        if (capture && options.crop) {
+            // only the character's rectangle of every view leaves the GPU
+            for (int v = 0; v < views.count; ++v) {
+                color_readback.start(job->frame_id * views.count + v, scissors[v].x, scissors[v].y, scissors[v].width, scissors[v].height,
+                                     color_layout.format, color_layout.type, 4);
+                color_jobs.push_back({job->frame_id, v, false, false});
+            }
+        }
+
+        bool full_capture = capture && !options.crop;
+
+        if (full_capture || stream) {
+            color_readback.start(job->frame_id, 0, 0, readable.width, readable.height, color_layout.format, color_layout.type, 4);
+            color_jobs.push_back({job->frame_id, -1, full_capture, bool(stream)});
+        }
+        lap(bench_stage::readback);
+
+        if (pipelined) {
+            std::uint64_t next = job->frame_id + pipeline_depth;
+            frame_queue.end_pop();
+            animate_frame(next);
+        }
 
-        glBindVertexArray(vao);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, nullptr);
+        if (capture) {
+            ++frame_id;
+            save = false;
+            if (options.batch() && frame_id == warm_frames)
+                warm_heap = heap_usage();
+        }
+
+        // batch windows are hidden, nothing needs to be shown
+        if (!direct && !options.batch()) {
+            if (post.empty()) {
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, readable.framebuffer);
+                glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+                bool scaled = readable.width != width || readable.height != height;
+                glBlitFramebuffer(0, 0, readable.width, readable.height, 0, 0, width, height, GL_COLOR_BUFFER_BIT,
+                                  scaled ? GL_LINEAR : GL_NEAREST);
+            }
+            else
+                post.apply(readable, 0, width, height, time);
+        }
 
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glViewport(0, 0, width, height);
 
-        glClear( GL_DEPTH_BUFFER_BIT);
-        glUseProgram(rect_program);
+        // a GPU that falls this many readbacks behind is waited for instead of queueing more
+        bool backlog = color_readback.in_flight() > (pipeline_depth + 1) * (views.count + 1);
+        running = collect_readbacks(backlog) && running;
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, renderedTexture);
-        glUniform1i(texID, 0);
+        if (options.batch() && frame_id == std::uint64_t(options.frames))
+            running = false;
 
-        glUniform1f(timeID, (float)(time) );
+        if (!options.batch())
+            SDL_GL_SwapWindow(window);
+    }
 
-        glBindVertexArray(rect_vao);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+    collect_readbacks(true);
+
+    if (pipelined) {
+        auto render_elapsed = std::chrono::steady_clock::now() - pipeline_start;
+        // frames animated ahead of a loop that ended early are dropped
+        frame_queue.drain();
+        output_queue.drain();
+        if (output_error)
+            std::rethrow_exception(output_error);
+
+        queue_stats frames = frame_queue.stats();
+        queue_stats outputs = output_queue.stats();
+        stage_report stages[] = {
+            {"animate", animate_time.total(), {}, {}},
+            {"render", render_elapsed, frames.empty_wait, outputs.full_wait},
+            {"encode", encode_time.total(), {}, {}},
+            {"output", write_time.total(), {}, {}},
+        };
+        queue_report queues[] = {
+            {"animate->render", frame_queue.capacity(), frames},
+            {"render->output", output_queue.capacity(), outputs},
+        };
+        print_pipeline_stats(std::cout, frame_id, std::chrono::steady_clock::now() - pipeline_start, stages, queues);
+    }
 
-        if (save) {
-            save_texture(GL_TEXTURE_2D, "pict.png");
-            save = false;
-        }
+    if (options.batch() && frame_id > warm_frames) {
+        heap_counters heap = heap_usage();
+        std::uint64_t steady_frames = frame_id - warm_frames;
+        std::cout << "Heap: " << double(heap.allocations - warm_heap.allocations) / steady_frames << " allocations, "
+                  << (heap.bytes - warm_heap.bytes) / steady_frames << " bytes per frame after the first "
+                  << warm_frames << " frames\n";
+    }
 
-        SDL_GL_SwapWindow(window);
+    if (bones_total > 0)
+        std::cout << "Bones: " << 100. * double(bones_evaluated) / double(bones_total) << "% evaluated per frame\n";
+    if (meshlets_total > 0)
+        std::cout << "Meshlets: " << 100. * double(meshlets_drawn) / double(meshlets_total) << "% drawn after culling\n";
+
+    if (profiler) {
+        render_bench_summary summary = summarize_render_bench(*profiler, options.bench_warmup, views.count);
+        summary.width = views.tile_width;
+        summary.height = views.tile_height;
+        summary.seed = options.bench_seed;
+        print_render_bench(std::cout, summary);
+
+        if (!options.bench_json.empty()) {
+            std::ofstream json(options.bench_json);
+            if (!json)
+                throw std::runtime_error("Cannot write " + options.bench_json);
+            write_render_bench_json(json, summary);
+        }
     }
 
+    for (int i = 0; i < aux_target_count; ++i)
+        if (aux_shards[i])
+            aux_shards[i]->close();
+
+    if (shard)
+        shard->close();
+    if (stream)
+        stream->close();
+
+    if (options.memory_stats >= 0.f)
+        print_memory_summary(std::cout);
+
     SDL_GL_DeleteContext(gl_context);
     SDL_DestroyWindow(window);
 }
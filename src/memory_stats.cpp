@@ -0,0 +1,385 @@
+#include "memory_stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+
+namespace
+{
+
+struct usage_counters
+{
+    std::atomic<std::size_t> live{0};
+    std::atomic<std::size_t> peak{0};
+    std::atomic<std::uint64_t> allocations{0};
+
+    void charge(std::size_t bytes)
+    {
+        std::size_t live_now = live.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        std::size_t peak_now = peak.load(std::memory_order_relaxed);
+        while (live_now > peak_now && !peak.compare_exchange_weak(peak_now, live_now, std::memory_order_relaxed))
+        {}
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release(std::size_t bytes)
+    {
+        live.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+
+    memory_usage load() const
+    {
+        return {live.load(std::memory_order_relaxed), peak.load(std::memory_order_relaxed),
+                allocations.load(std::memory_order_relaxed)};
+    }
+};
+
+// Heap counters of one thread. Only the thread itself writes them, with plain loads and stores
+// of relaxed atomics, so counting costs no shared read-modify-writes; reports sum every thread's.
+// Live bytes are signed, memory may be freed by another thread than the one that took it
+struct thread_counters
+{
+    std::atomic<std::int64_t> live[memory_category_count];
+    std::atomic<std::uint64_t> allocations[memory_category_count];
+    std::atomic<std::uint64_t> bytes;
+    thread_counters * next;
+};
+
+template <typename T>
+void bump(std::atomic<T> & counter, T delta)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+// every thread that ever allocated; blocks outlive their threads, so the sums keep what they counted
+std::atomic<thread_counters *> all_threads{nullptr};
+thread_local thread_counters * this_thread = nullptr;
+
+// The calling thread's block, registered on its first heap call; nullptr when even that fails
+thread_counters * local_counters() noexcept
+{
+    if (!this_thread)
+    {
+        // calloc, not operator new, which is what asks for the block
+        auto block = static_cast<thread_counters *>(std::calloc(1, sizeof(thread_counters)));
+        if (!block)
+            return nullptr;
+        block->next = all_threads.load();
+        while (!all_threads.compare_exchange_weak(block->next, block))
+        {}
+        this_thread = block;
+    }
+    return this_thread;
+}
+
+// constant-initialized: operator new runs before any dynamic initialization. Peaks need one live
+// total, so they are only kept once track_memory_peaks() was called
+std::atomic<bool> peaks_tracked{false};
+usage_counters heap_category_peaks[memory_category_count];
+usage_counters heap_total_peak;
+
+thread_local memory_category current_category = memory_category::other;
+
+// in front of every allocation, so the bytes go back to the category that took them;
+// keeps the alignment operator new guarantees
+struct alignas(std::max_align_t) allocation_header
+{
+    std::size_t size;
+    memory_category category;
+    // charged to the peak counters, which only count what they saw allocated
+    bool peak_tracked;
+};
+
+struct gl_objects
+{
+    std::mutex mutex;
+    std::unordered_map<GLuint, std::size_t> sizes;
+    usage_counters usage;
+};
+
+gl_objects & gl_kind(gl_object_kind kind)
+{
+    static gl_objects objects[gl_object_kind_count];
+    return objects[int(kind)];
+}
+
+double megabytes(std::size_t bytes)
+{
+    return double(bytes) / (1 << 20);
+}
+
+}
+
+// Every C++ heap allocation of the program goes through here: heap_usage() shows which frames
+// still allocate, the categories what the memory is for
+
+// Inlined into the containers of this file, GCC matches the free() below against their
+// operator new[] calls and the header arithmetic against their nodes, and warns about both
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#pragma GCC diagnostic ignored "-Warray-bounds"
+#endif
+
+void * operator new(std::size_t size)
+{
+    auto header = static_cast<allocation_header *>(std::malloc(sizeof(allocation_header) + size));
+    if (!header)
+        throw std::bad_alloc();
+
+    header->size = size;
+    header->category = current_category;
+    header->peak_tracked = peaks_tracked.load(std::memory_order_relaxed);
+
+    if (auto counters = local_counters())
+    {
+        bump(counters->live[int(header->category)], std::int64_t(size));
+        bump(counters->allocations[int(header->category)], std::uint64_t(1));
+        bump(counters->bytes, std::uint64_t(size));
+    }
+
+    if (header->peak_tracked)
+    {
+        heap_category_peaks[int(header->category)].charge(size);
+        heap_total_peak.charge(size);
+    }
+    return header + 1;
+}
+
+void * operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void * data) noexcept
+{
+    if (!data)
+        return;
+
+    auto header = static_cast<allocation_header *>(data) - 1;
+    if (auto counters = local_counters())
+        bump(counters->live[int(header->category)], -std::int64_t(header->size));
+
+    if (header->peak_tracked)
+    {
+        heap_category_peaks[int(header->category)].release(header->size);
+        heap_total_peak.release(header->size);
+    }
+    std::free(header);
+}
+
+void operator delete[](void * data) noexcept
+{
+    operator delete(data);
+}
+
+void operator delete(void * data, std::size_t) noexcept
+{
+    operator delete(data);
+}
+
+void operator delete[](void * data, std::size_t) noexcept
+{
+    operator delete(data);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+char const * memory_category_name(memory_category category)
+{
+    switch (category)
+    {
+        case memory_category::other:
+            return "other";
+        case memory_category::assets:
+            return "assets";
+        case memory_category::clips:
+            return "clips";
+        case memory_category::pixel_buffers:
+            return "pixel buffers";
+        case memory_category::queues:
+            return "queues";
+        case memory_category::arenas:
+            return "arenas";
+    }
+    return "";
+}
+
+memory_scope::memory_scope(memory_category category)
+    : previous_(current_category)
+{
+    current_category = category;
+}
+
+memory_scope::~memory_scope()
+{
+    current_category = previous_;
+}
+
+void track_memory_peaks()
+{
+    peaks_tracked.store(true);
+}
+
+heap_counters heap_usage()
+{
+    heap_counters counters;
+    for (auto block = all_threads.load(); block; block = block->next)
+    {
+        for (auto const & allocations : block->allocations)
+            counters.allocations += allocations.load(std::memory_order_relaxed);
+        counters.bytes += block->bytes.load(std::memory_order_relaxed);
+    }
+    return counters;
+}
+
+memory_usage heap_category_usage(memory_category category)
+{
+    std::int64_t live = 0;
+    memory_usage usage;
+    for (auto block = all_threads.load(); block; block = block->next)
+    {
+        live += block->live[int(category)].load(std::memory_order_relaxed);
+        usage.allocations += block->allocations[int(category)].load(std::memory_order_relaxed);
+    }
+    usage.live_bytes = std::size_t(std::max<std::int64_t>(live, 0));
+    usage.peak_bytes = std::max(usage.live_bytes, heap_category_peaks[int(category)].load().peak_bytes);
+    return usage;
+}
+
+memory_usage heap_total_usage()
+{
+    memory_usage total;
+    for (int c = 0; c < memory_category_count; ++c)
+    {
+        auto usage = heap_category_usage(memory_category(c));
+        total.live_bytes += usage.live_bytes;
+        total.allocations += usage.allocations;
+    }
+    total.peak_bytes = std::max(total.live_bytes, heap_total_peak.load().peak_bytes);
+    return total;
+}
+
+void track_gl_object(gl_object_kind kind, GLuint name, std::size_t bytes)
+{
+    auto & objects = gl_kind(kind);
+    std::lock_guard lock(objects.mutex);
+
+    auto & size = objects.sizes[name];
+    objects.usage.release(size);
+    size = bytes;
+    objects.usage.charge(bytes);
+}
+
+void forget_gl_objects(gl_object_kind kind, GLsizei count, GLuint const * names)
+{
+    auto & objects = gl_kind(kind);
+    std::lock_guard lock(objects.mutex);
+
+    for (GLsizei i = 0; i < count; ++i)
+        if (auto it = objects.sizes.find(names[i]); it != objects.sizes.end())
+        {
+            objects.usage.release(it->second);
+            objects.sizes.erase(it);
+        }
+}
+
+std::size_t gl_format_bytes(GLenum internal_format)
+{
+    switch (internal_format)
+    {
+        case GL_R8:
+        case GL_R8UI:
+            return 1;
+        case GL_RG8:
+        case GL_R16F:
+        case GL_DEPTH_COMPONENT16:
+            return 2;
+        case GL_RGB8:
+            return 3;
+        case GL_RGBA16F:
+        case GL_RG32F:
+            return 8;
+        case GL_RGBA32F:
+            return 16;
+        default:
+            // RGBA8, RGB10_A2, R32F and depth, which drivers pad to 32 bits
+            return 4;
+    }
+}
+
+memory_usage gl_object_usage(gl_object_kind kind)
+{
+    return gl_kind(kind).usage.load();
+}
+
+process_memory read_process_memory()
+{
+    process_memory memory;
+    std::FILE * status = std::fopen("/proc/self/status", "r");
+    if (!status)
+        return memory;
+
+    char line[256];
+    while (std::fgets(line, sizeof(line), status))
+    {
+        unsigned long kilobytes = 0;
+        if (std::sscanf(line, "VmRSS: %lu kB", &kilobytes) == 1)
+            memory.rss_bytes = std::size_t(kilobytes) << 10;
+        else if (std::sscanf(line, "VmHWM: %lu kB", &kilobytes) == 1)
+            memory.peak_rss_bytes = std::size_t(kilobytes) << 10;
+    }
+    std::fclose(status);
+    return memory;
+}
+
+void print_memory_line(std::ostream & out)
+{
+    auto heap = heap_total_usage();
+    std::size_t gl = 0;
+    for (int k = 0; k < gl_object_kind_count; ++k)
+        gl += gl_object_usage(gl_object_kind(k)).live_bytes;
+    auto process = read_process_memory();
+
+    auto precision = out.precision();
+    out << std::fixed << std::setprecision(1) << "memory: heap " << megabytes(heap.live_bytes) << " MB (peak "
+        << megabytes(heap.peak_bytes) << "), pixel buffers "
+        << megabytes(heap_category_usage(memory_category::pixel_buffers).live_bytes) << " MB, gl " << megabytes(gl)
+        << " MB, rss " << megabytes(process.rss_bytes) << " MB (peak " << megabytes(process.peak_rss_bytes) << ")\n";
+    out << std::defaultfloat << std::setprecision(precision);
+}
+
+void print_memory_summary(std::ostream & out)
+{
+    auto precision = out.precision();
+    out << std::fixed << std::setprecision(2);
+
+    auto row = [&](char const * name, memory_usage const & usage) {
+        out << std::left << std::setw(18) << name << std::right << std::setw(12) << megabytes(usage.live_bytes)
+            << std::setw(12) << megabytes(usage.peak_bytes) << std::setw(14) << usage.allocations << '\n';
+    };
+
+    out << std::left << std::setw(18) << "heap" << std::right << std::setw(12) << "live MB" << std::setw(12) << "peak MB"
+        << std::setw(14) << "allocations" << '\n';
+    for (int c = 0; c < memory_category_count; ++c)
+        row(memory_category_name(memory_category(c)), heap_category_usage(memory_category(c)));
+    row("total", heap_total_usage());
+
+    char const * gl_names[gl_object_kind_count] = {"buffers", "textures", "renderbuffers"};
+    out << std::left << std::setw(18) << "gl (estimated)" << std::right << std::setw(12) << "live MB" << std::setw(12)
+        << "peak MB" << std::setw(14) << "allocations" << '\n';
+    for (int k = 0; k < gl_object_kind_count; ++k)
+        row(gl_names[k], gl_object_usage(gl_object_kind(k)));
+
+    auto process = read_process_memory();
+    out << "rss " << megabytes(process.rss_bytes) << " MB, peak " << megabytes(process.peak_rss_bytes) << " MB\n";
+    out << std::defaultfloat << std::setprecision(precision);
+}
@@ -0,0 +1,184 @@
+#include "mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+namespace
+{
+
+std::uint16_t quantize_unorm(float value)
+{
+    return std::uint16_t(std::lround(std::clamp(value, 0.f, 1.f) * 65535.f));
+}
+
+std::int16_t quantize_snorm(float value)
+{
+    return std::int16_t(std::lround(std::clamp(value, -1.f, 1.f) * 32767.f));
+}
+
+// GL 4.2+ snorm conversion, which drivers apply to 3.3 contexts too
+float dequantize_snorm(std::int16_t value)
+{
+    return std::max(value / 32767.f, -1.f);
+}
+
+float sign_not_zero(float value)
+{
+    return value >= 0.f ? 1.f : -1.f;
+}
+
+}
+
+char const * vertex_format_name(vertex_format format)
+{
+    switch (format)
+    {
+        case vertex_format::full:
+            return "full";
+        case vertex_format::compact:
+            return "compact";
+    }
+    return "unknown";
+}
+
+mesh_bounds compute_bounds(std::vector<vertex> const & vertices)
+{
+    if (vertices.empty())
+        return {};
+
+    mesh_bounds bounds{vertices[0].position, vertices[0].position};
+    for (auto const & v : vertices)
+    {
+        bounds.min = glm::min(bounds.min, v.position);
+        bounds.max = glm::max(bounds.max, v.position);
+    }
+    return bounds;
+}
+
+glm::vec2 octahedral_encode(glm::vec3 normal)
+{
+    float norm = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+    if (norm == 0.f)
+        return glm::vec2(0.f);
+
+    normal /= norm;
+    if (normal.z >= 0.f)
+        return glm::vec2(normal.x, normal.y);
+    return glm::vec2((1.f - std::abs(normal.y)) * sign_not_zero(normal.x),
+                     (1.f - std::abs(normal.x)) * sign_not_zero(normal.y));
+}
+
+glm::vec3 octahedral_decode(glm::vec2 encoded)
+{
+    glm::vec3 normal(encoded.x, encoded.y, 1.f - std::abs(encoded.x) - std::abs(encoded.y));
+    float fold = std::max(-normal.z, 0.f);
+    normal.x += normal.x >= 0.f ? -fold : fold;
+    normal.y += normal.y >= 0.f ? -fold : fold;
+    return glm::normalize(normal);
+}
+
+vertex_layout fit_vertex_layout(vertex_format format, std::vector<vertex> const & vertices)
+{
+    vertex_layout layout{format, 2, 1};
+    for (auto const & v : vertices)
+        for (int k = 2; k < max_bone_influences; ++k)
+            if (v.bone_weights[k] > 0)
+                layout.influences = 4;
+
+    for (auto const & v : vertices)
+        for (std::uint32_t k = 0; k < layout.influences; ++k)
+            if (v.bone_ids[k] > 255)
+                layout.bone_id_size = 2;
+    return layout;
+}
+
+std::vector<std::uint8_t> pack_vertices(std::vector<vertex> const & vertices, vertex_layout const & layout,
+                                        mesh_bounds const & bounds)
+{
+    std::size_t stride = layout.stride();
+    std::vector<std::uint8_t> packed(vertices.size() * stride, 0);
+    glm::vec3 extent = bounds.extent();
+
+    for (std::size_t i = 0; i < vertices.size(); ++i)
+    {
+        vertex const & v = vertices[i];
+        std::uint8_t * out = packed.data() + i * stride;
+
+        if (layout.format == vertex_format::compact)
+        {
+            std::uint16_t position[3];
+            for (int c = 0; c < 3; ++c)
+                position[c] = extent[c] > 0.f ? quantize_unorm((v.position[c] - bounds.min[c]) / extent[c]) : 0;
+
+            glm::vec2 encoded = octahedral_encode(v.normal);
+            std::int16_t normal[2] = {quantize_snorm(encoded.x), quantize_snorm(encoded.y)};
+
+            std::memcpy(out, position, sizeof(position));
+            std::memcpy(out + 8, normal, sizeof(normal));
+        }
+        else
+        {
+            std::memcpy(out, &v.position, sizeof(v.position));
+            std::memcpy(out + 12, &v.normal, sizeof(v.normal));
+        }
+
+        std::uint8_t * ids = out + layout.bone_ids_offset();
+        std::uint8_t * weights = out + layout.bone_weights_offset();
+        for (std::uint32_t k = 0; k < layout.influences; ++k)
+        {
+            if (layout.bone_id_size == 2)
+                std::memcpy(ids + 2 * k, &v.bone_ids[k], sizeof(std::uint16_t));
+            else
+                ids[k] = std::uint8_t(v.bone_ids[k]);
+            weights[k] = v.bone_weights[k];
+        }
+    }
+    return packed;
+}
+
+std::vector<vertex> unpack_vertices(std::uint8_t const * data, std::size_t count, vertex_layout const & layout,
+                                    mesh_bounds const & bounds)
+{
+    std::size_t stride = layout.stride();
+    std::vector<vertex> vertices(count, vertex{});
+    glm::vec3 extent = bounds.extent();
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        vertex & v = vertices[i];
+        std::uint8_t const * in = data + i * stride;
+
+        if (layout.format == vertex_format::compact)
+        {
+            std::uint16_t position[3];
+            std::int16_t normal[2];
+            std::memcpy(position, in, sizeof(position));
+            std::memcpy(normal, in + 8, sizeof(normal));
+
+            for (int c = 0; c < 3; ++c)
+                v.position[c] = bounds.min[c] + position[c] / 65535.f * extent[c];
+            v.normal = octahedral_decode(glm::vec2(dequantize_snorm(normal[0]), dequantize_snorm(normal[1])));
+        }
+        else
+        {
+            std::memcpy(&v.position, in, sizeof(v.position));
+            std::memcpy(&v.normal, in + 12, sizeof(v.normal));
+        }
+
+        std::uint8_t const * ids = in + layout.bone_ids_offset();
+        std::uint8_t const * weights = in + layout.bone_weights_offset();
+        for (std::uint32_t k = 0; k < layout.influences; ++k)
+        {
+            if (layout.bone_id_size == 2)
+                std::memcpy(&v.bone_ids[k], ids + 2 * k, sizeof(std::uint16_t));
+            else
+                v.bone_ids[k] = ids[k];
+            v.bone_weights[k] = weights[k];
+        }
+    }
+    return vertices;
+}
@@ -0,0 +1,233 @@
+#include "mesh_cluster.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+#include <glm/geometric.hpp>
+
+#include "mesh_optimize.h"
+
+namespace
+{
+
+// Splits one level's triangles into meshlets: appends their indices to
+// `clustered` and the index count of each to `sizes`
+void cluster_triangles(std::vector<vertex> const & vertices, std::uint32_t const * indices, std::size_t triangle_count,
+                       float cone_weight, std::vector<std::uint32_t> & clustered, std::vector<std::uint32_t> & sizes)
+{
+    std::size_t vertex_count = vertices.size();
+
+    // triangles around each vertex: [first[v], first[v + 1])
+    std::vector<std::uint32_t> first(vertex_count + 1, 0);
+    for (std::size_t i = 0; i < 3 * triangle_count; ++i)
+        ++first[indices[i] + 1];
+    std::partial_sum(first.begin(), first.end(), first.begin());
+
+    std::vector<std::uint32_t> adjacency(3 * triangle_count);
+    std::vector<std::uint32_t> filled(vertex_count, 0);
+    for (std::size_t t = 0; t < triangle_count; ++t)
+        for (int k = 0; k < 3; ++k)
+        {
+            std::uint32_t v = indices[3 * t + k];
+            adjacency[first[v] + filled[v]++] = std::uint32_t(t);
+        }
+
+    std::vector<glm::vec3> centroids(triangle_count);
+    std::vector<glm::vec3> normals(triangle_count);
+    for (std::size_t t = 0; t < triangle_count; ++t)
+    {
+        glm::vec3 a = vertices[indices[3 * t]].position;
+        glm::vec3 b = vertices[indices[3 * t + 1]].position;
+        glm::vec3 c = vertices[indices[3 * t + 2]].position;
+        glm::vec3 n = glm::cross(b - a, c - a);
+        float length = glm::length(n);
+        centroids[t] = (a + b + c) / 3.f;
+        normals[t] = length > 0.f ? n / length : glm::vec3(0.f);
+    }
+
+    std::vector<bool> emitted(triangle_count, false);
+    // the meshlet a vertex was last added to, plus one
+    std::vector<std::uint32_t> owner(vertex_count, 0);
+    std::uint32_t meshlet_id = 0;
+
+    std::vector<std::uint32_t> meshlet_vertices;
+    std::vector<std::uint32_t> meshlet_indices;
+
+    std::size_t next_seed = 0;
+    std::size_t remaining = triangle_count;
+    while (remaining > 0)
+    {
+        ++meshlet_id;
+        meshlet_vertices.clear();
+        meshlet_indices.clear();
+        glm::vec3 centroid_sum(0.f);
+        glm::vec3 normal_sum(0.f);
+
+        auto new_vertices = [&](std::size_t t)
+        {
+            std::uint32_t const * triangle = indices + 3 * t;
+            int count = 0;
+            for (int k = 0; k < 3; ++k)
+                if (owner[triangle[k]] != meshlet_id && (k == 0 || triangle[k] != triangle[0]) && (k < 2 || triangle[2] != triangle[1]))
+                    ++count;
+            return count;
+        };
+
+        auto add = [&](std::size_t t)
+        {
+            emitted[t] = true;
+            --remaining;
+            for (int k = 0; k < 3; ++k)
+            {
+                std::uint32_t v = indices[3 * t + k];
+                meshlet_indices.push_back(v);
+                if (owner[v] != meshlet_id)
+                {
+                    owner[v] = meshlet_id;
+                    meshlet_vertices.push_back(v);
+                }
+            }
+            centroid_sum += centroids[t];
+            normal_sum += normals[t];
+        };
+
+        while (emitted[next_seed])
+            ++next_seed;
+        add(next_seed);
+
+        while (meshlet_indices.size() < 3 * meshlet_max_triangles)
+        {
+            glm::vec3 center = centroid_sum / float(meshlet_indices.size() / 3);
+            float axis_length = glm::length(normal_sum);
+            glm::vec3 axis = axis_length > 0.f ? normal_sum / axis_length : glm::vec3(0.f);
+
+            std::size_t best = triangle_count;
+            int best_new = 4;
+            float best_cost = std::numeric_limits<float>::max();
+            for (auto v : meshlet_vertices)
+                for (std::uint32_t i = first[v]; i < first[v + 1]; ++i)
+                {
+                    std::uint32_t t = adjacency[i];
+                    if (emitted[t])
+                        continue;
+                    int added = new_vertices(t);
+                    if (meshlet_vertices.size() + added > meshlet_max_vertices || added > best_new)
+                        continue;
+                    float cost = glm::distance(centroids[t], center) * (1.f + cone_weight * (1.f - glm::dot(normals[t], axis)));
+                    if (added < best_new || cost < best_cost)
+                    {
+                        best = t;
+                        best_new = added;
+                        best_cost = cost;
+                    }
+                }
+
+            if (best == triangle_count)
+                break;
+            add(best);
+        }
+
+        auto ordered = optimize_vertex_cache(meshlet_indices, vertex_count);
+        clustered.insert(clustered.end(), ordered.begin(), ordered.end());
+        sizes.push_back(std::uint32_t(ordered.size()));
+    }
+}
+
+}
+
+void build_meshlets(mesh_data & mesh, float cone_weight)
+{
+    mesh.meshlets.clear();
+
+    std::vector<std::uint32_t> clustered;
+    std::vector<std::uint32_t> sizes;
+    for (auto const & lod : mesh.lods)
+    {
+        clustered.clear();
+        sizes.clear();
+        cluster_triangles(mesh.vertices, mesh.indices.data() + lod.first_index, lod.index_count / 3, cone_weight, clustered, sizes);
+
+        // the meshlets of the outer shell first, as optimize_overdraw orders its clusters
+        glm::vec3 centre = surface_centre(clustered.data(), clustered.size(), mesh.vertices);
+        std::vector<std::uint32_t> starts(sizes.size());
+        std::exclusive_scan(sizes.begin(), sizes.end(), starts.begin(), 0u);
+        std::vector<float> keys(sizes.size());
+        for (std::size_t c = 0; c < sizes.size(); ++c)
+            keys[c] = overdraw_sort_key(clustered.data() + starts[c], sizes[c], mesh.vertices, centre);
+        std::vector<std::size_t> order(sizes.size());
+        std::iota(order.begin(), order.end(), std::size_t(0));
+        std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return keys[a] > keys[b]; });
+
+        std::uint32_t first_index = lod.first_index;
+        for (auto c : order)
+        {
+            std::copy_n(clustered.begin() + starts[c], sizes[c], mesh.indices.begin() + first_index);
+            meshlet m;
+            m.first_index = first_index;
+            m.index_count = sizes[c];
+            mesh.meshlets.push_back(m);
+            first_index += sizes[c];
+        }
+    }
+
+    std::stable_sort(mesh.meshlets.begin(), mesh.meshlets.end(),
+                     [](meshlet const & a, meshlet const & b) { return a.first_index < b.first_index; });
+    compute_meshlet_bounds(mesh);
+}
+
+void compute_meshlet_bounds(mesh_data & mesh)
+{
+    mesh.meshlet_bones.clear();
+
+    for (auto & m : mesh.meshlets)
+    {
+        std::uint32_t const * indices = mesh.indices.data() + m.first_index;
+        std::uint32_t first_bone = std::uint32_t(mesh.meshlet_bones.size());
+
+        glm::vec3 min(std::numeric_limits<float>::max());
+        glm::vec3 max(std::numeric_limits<float>::lowest());
+        for (std::uint32_t i = 0; i < m.index_count; ++i)
+        {
+            vertex const & v = mesh.vertices[indices[i]];
+            min = glm::min(min, v.position);
+            max = glm::max(max, v.position);
+            for (int k = 0; k < max_bone_influences; ++k)
+                if (v.bone_weights[k] > 0)
+                    mesh.meshlet_bones.push_back(v.bone_ids[k]);
+        }
+
+        // the bones weighting its vertices, sorted
+        auto bones_begin = mesh.meshlet_bones.begin() + first_bone;
+        std::sort(bones_begin, mesh.meshlet_bones.end());
+        mesh.meshlet_bones.erase(std::unique(bones_begin, mesh.meshlet_bones.end()), mesh.meshlet_bones.end());
+        m.first_bone = first_bone;
+        m.bone_count = std::uint32_t(mesh.meshlet_bones.size()) - first_bone;
+
+        m.center = (min + max) * 0.5f;
+        m.radius = 0.f;
+        for (std::uint32_t i = 0; i < m.index_count; ++i)
+            m.radius = std::max(m.radius, glm::distance(m.center, mesh.vertices[indices[i]].position));
+
+        // the axis is the area-weighted mean normal, the cosine that of the triangle furthest from it
+        glm::vec3 normal_sum(0.f);
+        for (std::uint32_t i = 0; i + 2 < m.index_count; i += 3)
+        {
+            glm::vec3 a = mesh.vertices[indices[i]].position;
+            normal_sum += glm::cross(mesh.vertices[indices[i + 1]].position - a, mesh.vertices[indices[i + 2]].position - a);
+        }
+
+        float length = glm::length(normal_sum);
+        m.cone_axis = length > 0.f ? normal_sum / length : glm::vec3(0.f, 0.f, 1.f);
+        m.cone_cosine = length > 0.f ? 1.f : -1.f;
+        for (std::uint32_t i = 0; i + 2 < m.index_count && length > 0.f; i += 3)
+        {
+            glm::vec3 a = mesh.vertices[indices[i]].position;
+            glm::vec3 n = glm::cross(mesh.vertices[indices[i + 1]].position - a, mesh.vertices[indices[i + 2]].position - a);
+            float n_length = glm::length(n);
+            if (n_length > 0.f)
+                m.cone_cosine = std::min(m.cone_cosine, glm::dot(n / n_length, m.cone_axis));
+        }
+    }
+}
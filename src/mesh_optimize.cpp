@@ -0,0 +1,276 @@
+#include "mesh_optimize.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include <glm/geometric.hpp>
+
+namespace
+{
+
+// Forsyth's scoring: the three vertices of the last triangle get a fixed score,
+// older cache entries decay with their position, and vertices with few
+// remaining triangles get a boost so that they are finished off early
+constexpr int scored_cache_size = 32;
+constexpr float last_triangle_score = 0.75f;
+constexpr float cache_decay_power = 1.5f;
+constexpr float valence_boost_scale = 2.f;
+constexpr float valence_boost_power = 0.5f;
+
+float vertex_score(int cache_position, std::uint32_t live_triangles)
+{
+    if (live_triangles == 0)
+        return -1.f;
+
+    float score = 0.f;
+    if (cache_position >= 0)
+    {
+        if (cache_position < 3)
+            score = last_triangle_score;
+        else
+            score = std::pow(1.f - float(cache_position - 3) / (scored_cache_size - 3), cache_decay_power);
+    }
+    return score + valence_boost_scale * std::pow(float(live_triangles), -valence_boost_power);
+}
+
+// FIFO post-transform cache: a vertex stays until `size` newer vertices missed
+class fifo_cache
+{
+public:
+    fifo_cache(std::size_t vertex_count, int size)
+        : added_at_(vertex_count, 0)
+        , size_(std::size_t(size))
+    {}
+
+    // true when the vertex had to be transformed
+    bool miss(std::uint32_t v)
+    {
+        if (added_at_[v] != 0 && misses_ - added_at_[v] < size_)
+            return false;
+        added_at_[v] = ++misses_;
+        return true;
+    }
+
+    std::size_t misses() const { return misses_; }
+
+private:
+    std::vector<std::size_t> added_at_;
+    std::size_t size_;
+    std::size_t misses_ = 0;
+};
+
+}
+
+vertex_cache_stats analyze_vertex_cache(std::vector<std::uint32_t> const & indices, std::size_t vertex_count, int cache_size)
+{
+    vertex_cache_stats stats;
+
+    fifo_cache cache(vertex_count, cache_size);
+    for (auto index : indices)
+        cache.miss(index);
+
+    std::size_t misses = cache.misses();
+    stats.transforms = misses;
+    if (!indices.empty())
+        stats.acmr = double(misses) / double(indices.size() / 3);
+    if (vertex_count > 0)
+        stats.atvr = double(misses) / double(vertex_count);
+    return stats;
+}
+
+std::vector<std::uint32_t> optimize_vertex_cache(std::vector<std::uint32_t> const & indices, std::size_t vertex_count)
+{
+    std::size_t triangle_count = indices.size() / 3;
+
+    // triangles around each vertex, the live ones first: [first[v], first[v] + live[v])
+    std::vector<std::uint32_t> first(vertex_count + 1, 0);
+    for (auto index : indices)
+        ++first[index + 1];
+    std::partial_sum(first.begin(), first.end(), first.begin());
+
+    std::vector<std::uint32_t> adjacency(indices.size());
+    std::vector<std::uint32_t> live(vertex_count, 0);
+    for (std::size_t t = 0; t < triangle_count; ++t)
+        for (int k = 0; k < 3; ++k)
+        {
+            std::uint32_t v = indices[3 * t + k];
+            adjacency[first[v] + live[v]++] = std::uint32_t(t);
+        }
+
+    std::vector<float> scores(vertex_count);
+    for (std::size_t v = 0; v < vertex_count; ++v)
+        scores[v] = vertex_score(-1, live[v]);
+
+    std::vector<float> triangle_scores(triangle_count);
+    std::vector<bool> emitted(triangle_count, false);
+    for (std::size_t t = 0; t < triangle_count; ++t)
+        triangle_scores[t] = scores[indices[3 * t]] + scores[indices[3 * t + 1]] + scores[indices[3 * t + 2]];
+
+    std::vector<std::uint32_t> cache;
+    std::vector<std::uint32_t> next_cache;
+    cache.reserve(scored_cache_size + 3);
+    next_cache.reserve(scored_cache_size + 3);
+
+    std::vector<std::uint32_t> result;
+    result.reserve(indices.size());
+
+    std::size_t next_unemitted = 0;
+    std::size_t best = triangle_count;
+    while (result.size() < triangle_count * 3)
+    {
+        // nothing in the cache has triangles left: continue with the next one in input order
+        if (best == triangle_count)
+        {
+            while (emitted[next_unemitted])
+                ++next_unemitted;
+            best = next_unemitted;
+        }
+
+        emitted[best] = true;
+        std::uint32_t const * triangle = &indices[3 * best];
+        for (int k = 0; k < 3; ++k)
+        {
+            std::uint32_t v = triangle[k];
+            result.push_back(v);
+
+            auto begin = adjacency.begin() + first[v];
+            auto end = begin + live[v];
+            std::iter_swap(std::find(begin, end, std::uint32_t(best)), end - 1);
+            --live[v];
+        }
+
+        // the triangle's vertices move to the front, whatever falls off the end leaves the cache
+        next_cache.assign(triangle, triangle + 3);
+        for (auto v : cache)
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+                next_cache.push_back(v);
+
+        // rescore the vertices that moved or left and pass the change on to their live triangles
+        auto rescore = [&](std::uint32_t v, int position)
+        {
+            float score = vertex_score(position, live[v]);
+            float delta = score - scores[v];
+            scores[v] = score;
+            for (std::uint32_t i = first[v]; i < first[v] + live[v]; ++i)
+                triangle_scores[adjacency[i]] += delta;
+        };
+        for (std::size_t i = 0; i < next_cache.size(); ++i)
+            rescore(next_cache[i], i < scored_cache_size ? int(i) : -1);
+        if (next_cache.size() > scored_cache_size)
+            next_cache.resize(scored_cache_size);
+        cache.swap(next_cache);
+
+        best = triangle_count;
+        float best_score = -1.f;
+        for (auto v : cache)
+            for (std::uint32_t i = first[v]; i < first[v] + live[v]; ++i)
+                if (triangle_scores[adjacency[i]] > best_score)
+                {
+                    best_score = triangle_scores[adjacency[i]];
+                    best = adjacency[i];
+                }
+    }
+
+    return result;
+}
+
+glm::vec3 surface_centre(std::uint32_t const * indices, std::size_t index_count, std::vector<vertex> const & vertices)
+{
+    glm::vec3 centre(0.f);
+    float area = 0.f;
+    for (std::size_t i = 0; i + 2 < index_count; i += 3)
+    {
+        glm::vec3 a = vertices[indices[i]].position;
+        glm::vec3 b = vertices[indices[i + 1]].position;
+        glm::vec3 c = vertices[indices[i + 2]].position;
+        float triangle_area = glm::length(glm::cross(b - a, c - a));
+        centre += triangle_area * (a + b + c) / 3.f;
+        area += triangle_area;
+    }
+    return area > 0.f ? centre / area : centre;
+}
+
+float overdraw_sort_key(std::uint32_t const * indices, std::size_t index_count, std::vector<vertex> const & vertices,
+                        glm::vec3 mesh_centre)
+{
+    glm::vec3 normal(0.f);
+    for (std::size_t i = 0; i + 2 < index_count; i += 3)
+    {
+        glm::vec3 a = vertices[indices[i]].position;
+        normal += glm::cross(vertices[indices[i + 1]].position - a, vertices[indices[i + 2]].position - a);
+    }
+    float length = glm::length(normal);
+    glm::vec3 centre = surface_centre(indices, index_count, vertices);
+    return length > 0.f ? glm::dot(centre - mesh_centre, normal / length) : 0.f;
+}
+
+std::vector<std::uint32_t> optimize_overdraw(std::vector<std::uint32_t> const & indices,
+                                             std::vector<vertex> const & vertices, float threshold)
+{
+    std::size_t triangle_count = indices.size() / 3;
+    if (triangle_count == 0)
+        return indices;
+
+    // cluster boundaries: triangles that miss the cache with all three vertices
+    std::vector<std::size_t> cluster_starts;
+    fifo_cache cache(vertices.size(), 16);
+    for (std::size_t t = 0; t < triangle_count; ++t)
+    {
+        int triangle_misses = cache.miss(indices[3 * t]) + cache.miss(indices[3 * t + 1]) + cache.miss(indices[3 * t + 2]);
+        if (t == 0 || triangle_misses == 3)
+            cluster_starts.push_back(t);
+    }
+    cluster_starts.push_back(triangle_count);
+
+    glm::vec3 mesh_centre = surface_centre(indices.data(), indices.size(), vertices);
+
+    struct cluster
+    {
+        std::size_t begin;
+        std::size_t end;
+        // how far the cluster faces away from the centre: positive for the outer shell
+        float sort_key;
+    };
+    std::vector<cluster> clusters;
+    for (std::size_t c = 0; c + 1 < cluster_starts.size(); ++c)
+    {
+        std::size_t begin = cluster_starts[c];
+        std::size_t end = cluster_starts[c + 1];
+        float key = overdraw_sort_key(indices.data() + 3 * begin, 3 * (end - begin), vertices, mesh_centre);
+        clusters.push_back({begin, end, key});
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end(), [](cluster const & a, cluster const & b) { return a.sort_key > b.sort_key; });
+
+    std::vector<std::uint32_t> result;
+    result.reserve(indices.size());
+    for (auto const & c : clusters)
+        result.insert(result.end(), indices.begin() + 3 * c.begin, indices.begin() + 3 * c.end);
+
+    double before = analyze_vertex_cache(indices, vertices.size()).acmr;
+    double after = analyze_vertex_cache(result, vertices.size()).acmr;
+    return after <= before * threshold ? result : indices;
+}
+
+void optimize_vertex_fetch(std::vector<vertex> & vertices, std::vector<std::uint32_t> & indices)
+{
+    constexpr std::uint32_t unused = ~std::uint32_t(0);
+    std::vector<std::uint32_t> remap(vertices.size(), unused);
+
+    std::uint32_t next = 0;
+    for (auto index : indices)
+        if (remap[index] == unused)
+            remap[index] = next++;
+    for (auto & r : remap)
+        if (r == unused)
+            r = next++;
+
+    std::vector<vertex> reordered(vertices.size());
+    for (std::size_t v = 0; v < vertices.size(); ++v)
+        reordered[remap[v]] = vertices[v];
+    vertices.swap(reordered);
+
+    for (auto & index : indices)
+        index = remap[index];
+}
@@ -0,0 +1,554 @@
+#include "mesh_simplify.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#include "mesh_optimize.h"
+
+namespace
+{
+
+// Sum of squared distances to a set of weighted planes: p^T A p + 2 b.p + c
+struct quadric
+{
+    double a00 = 0., a01 = 0., a02 = 0., a11 = 0., a12 = 0., a22 = 0.;
+    double b0 = 0., b1 = 0., b2 = 0.;
+    double c = 0.;
+    double weight = 0.;
+
+    void add_plane(glm::dvec3 n, double d, double w)
+    {
+        a00 += w * n.x * n.x;
+        a01 += w * n.x * n.y;
+        a02 += w * n.x * n.z;
+        a11 += w * n.y * n.y;
+        a12 += w * n.y * n.z;
+        a22 += w * n.z * n.z;
+        b0 += w * n.x * d;
+        b1 += w * n.y * d;
+        b2 += w * n.z * d;
+        c += w * d * d;
+        weight += w;
+    }
+
+    quadric & operator += (quadric const & q)
+    {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02; a11 += q.a11; a12 += q.a12; a22 += q.a22;
+        b0 += q.b0; b1 += q.b1; b2 += q.b2;
+        c += q.c;
+        weight += q.weight;
+        return *this;
+    }
+
+    // mean squared distance of p to the planes
+    double error(glm::dvec3 p) const
+    {
+        double e = a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z
+            + 2. * (a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z)
+            + 2. * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+        return weight > 0. ? std::max(e, 0.) / weight : 0.;
+    }
+};
+
+struct position_hash
+{
+    std::size_t operator () (glm::vec3 const & p) const
+    {
+        std::uint32_t bits[3];
+        std::memcpy(bits, &p, sizeof(bits));
+        return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+    }
+};
+
+// Sum over all bones of the difference in weight, 0 for the same influences, 2 for disjoint ones
+float skin_distance(vertex const & a, vertex const & b)
+{
+    auto weight = [](vertex const & v, std::uint16_t id)
+    {
+        int sum = 0;
+        for (int k = 0; k < max_bone_influences; ++k)
+            if (v.bone_weights[k] > 0 && v.bone_ids[k] == id)
+                sum += v.bone_weights[k];
+        return sum;
+    };
+
+    float distance = 0.f;
+    for (int i = 0; i < max_bone_influences; ++i)
+        if (a.bone_weights[i] > 0)
+            distance += std::abs(a.bone_weights[i] - weight(b, a.bone_ids[i]));
+    for (int k = 0; k < max_bone_influences; ++k)
+        if (b.bone_weights[k] > 0 && weight(a, b.bone_ids[k]) == 0)
+            distance += b.bone_weights[k];
+    return distance / 255.f;
+}
+
+// Wedges whose normals are further apart than this belong to different sides of a hard edge
+constexpr float wedge_normal_cosine = 0.5f;
+
+constexpr double border_weight = 10.;
+
+// The point of triangle abc closest to p
+glm::dvec3 closest_on_triangle(glm::dvec3 p, glm::dvec3 a, glm::dvec3 b, glm::dvec3 c)
+{
+    glm::dvec3 ab = b - a;
+    glm::dvec3 ac = c - a;
+    glm::dvec3 ap = p - a;
+    double d1 = glm::dot(ab, ap);
+    double d2 = glm::dot(ac, ap);
+    if (d1 <= 0. && d2 <= 0.)
+        return a;
+
+    glm::dvec3 bp = p - b;
+    double d3 = glm::dot(ab, bp);
+    double d4 = glm::dot(ac, bp);
+    if (d3 >= 0. && d4 <= d3)
+        return b;
+
+    double vc = d1 * d4 - d3 * d2;
+    if (vc <= 0. && d1 >= 0. && d3 <= 0.)
+        return a + ab * (d1 / (d1 - d3));
+
+    glm::dvec3 cp = p - c;
+    double d5 = glm::dot(ab, cp);
+    double d6 = glm::dot(ac, cp);
+    if (d6 >= 0. && d5 <= d6)
+        return c;
+
+    double vb = d5 * d2 - d1 * d6;
+    if (vb <= 0. && d2 >= 0. && d6 <= 0.)
+        return a + ac * (d2 / (d2 - d6));
+
+    double va = d3 * d6 - d5 * d4;
+    if (va <= 0. && d4 - d3 >= 0. && d5 - d6 >= 0.)
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+    double denominator = va + vb + vc;
+    if (denominator <= 0.)
+        return a;
+    return a + ab * (vb / denominator) + ac * (vc / denominator);
+}
+
+// Distances to a triangle soup, through a uniform grid of the cells each
+// triangle's bounding box touches
+class surface_distance
+{
+public:
+    surface_distance(std::vector<vertex> const & vertices, std::vector<std::uint32_t> const & triangles)
+        : vertices_(vertices)
+        , triangles_(triangles)
+    {
+        std::size_t count = triangles.size() / 3;
+        if (count == 0)
+            return;
+
+        glm::dvec3 max = min_ = glm::dvec3(vertices[triangles[0]].position);
+        for (auto id : triangles)
+        {
+            min_ = glm::min(min_, glm::dvec3(vertices[id].position));
+            max = glm::max(max, glm::dvec3(vertices[id].position));
+        }
+
+        // about two triangles per cell on a surface
+        glm::dvec3 extent = max - min_;
+        double longest = std::max({extent.x, extent.y, extent.z, 1e-9});
+        int resolution = std::clamp(int(std::sqrt(double(count) / 2.)), 1, 256);
+        cell_ = longest / resolution;
+        for (int k = 0; k < 3; ++k)
+            cells_[k] = std::max(1, int(std::ceil(extent[k] / cell_)));
+
+        std::vector<std::uint32_t> starts(std::size_t(cells_[0]) * cells_[1] * cells_[2] + 1, 0);
+        auto for_cells = [&](std::size_t t, auto && f)
+        {
+            glm::dvec3 lo = glm::dvec3(vertices[triangles[t]].position);
+            glm::dvec3 hi = lo;
+            for (int k = 1; k < 3; ++k)
+            {
+                lo = glm::min(lo, glm::dvec3(vertices[triangles[t + k]].position));
+                hi = glm::max(hi, glm::dvec3(vertices[triangles[t + k]].position));
+            }
+            glm::ivec3 a = cell_of(lo);
+            glm::ivec3 b = cell_of(hi);
+            for (int z = a.z; z <= b.z; ++z)
+                for (int y = a.y; y <= b.y; ++y)
+                    for (int x = a.x; x <= b.x; ++x)
+                        f(index_of({x, y, z}));
+        };
+
+        for (std::size_t t = 0; t < triangles.size(); t += 3)
+            for_cells(t, [&](std::size_t cell) { ++starts[cell + 1]; });
+        for (std::size_t c = 1; c < starts.size(); ++c)
+            starts[c] += starts[c - 1];
+
+        cell_triangles_.resize(starts.back());
+        std::vector<std::uint32_t> next(starts.begin(), starts.end() - 1);
+        for (std::size_t t = 0; t < triangles.size(); t += 3)
+            for_cells(t, [&](std::size_t cell) { cell_triangles_[next[cell]++] = std::uint32_t(t); });
+        cell_starts_ = std::move(starts);
+    }
+
+    // Distance from p to the closest triangle; rings of cells around p's
+    // cell are searched until no triangle further out can be closer
+    double operator () (glm::dvec3 p) const
+    {
+        if (cell_starts_.empty())
+            return 0.;
+
+        glm::ivec3 centre = cell_of(p);
+        int rings = std::max({cells_[0], cells_[1], cells_[2]});
+        double best = std::numeric_limits<double>::max();
+        for (int r = 0; r <= rings; ++r)
+        {
+            // whatever the rings so far missed lies at least r cells away
+            if (best <= double(r - 1) * cell_)
+                break;
+
+            glm::ivec3 lo = glm::max(centre - r, glm::ivec3(0));
+            glm::ivec3 hi = glm::min(centre + r, glm::ivec3(cells_[0] - 1, cells_[1] - 1, cells_[2] - 1));
+            for (int z = lo.z; z <= hi.z; ++z)
+                for (int y = lo.y; y <= hi.y; ++y)
+                    for (int x = lo.x; x <= hi.x; ++x)
+                    {
+                        glm::ivec3 cell(x, y, z);
+                        glm::ivec3 offset = glm::abs(cell - centre);
+                        if (std::max({offset.x, offset.y, offset.z}) != r)
+                            continue;
+
+                        std::size_t index = index_of(cell);
+                        for (std::uint32_t i = cell_starts_[index]; i < cell_starts_[index + 1]; ++i)
+                        {
+                            std::uint32_t t = cell_triangles_[i];
+                            glm::dvec3 q = closest_on_triangle(p, glm::dvec3(vertices_[triangles_[t]].position),
+                                                               glm::dvec3(vertices_[triangles_[t + 1]].position),
+                                                               glm::dvec3(vertices_[triangles_[t + 2]].position));
+                            best = std::min(best, glm::length(p - q));
+                        }
+                    }
+        }
+        return best;
+    }
+
+private:
+    glm::ivec3 cell_of(glm::dvec3 p) const
+    {
+        glm::ivec3 cell;
+        for (int k = 0; k < 3; ++k)
+            cell[k] = std::clamp(int(std::floor((p[k] - min_[k]) / cell_)), 0, cells_[k] - 1);
+        return cell;
+    }
+
+    std::size_t index_of(glm::ivec3 cell) const
+    {
+        return (std::size_t(cell.z) * cells_[1] + cell.y) * cells_[0] + cell.x;
+    }
+
+    std::vector<vertex> const & vertices_;
+    std::vector<std::uint32_t> const & triangles_;
+    glm::dvec3 min_ = glm::dvec3(0.);
+    double cell_ = 1.;
+    int cells_[3] = {1, 1, 1};
+    // the triangles of cell c are cell_triangles_[cell_starts_[c], cell_starts_[c + 1])
+    std::vector<std::uint32_t> cell_starts_;
+    std::vector<std::uint32_t> cell_triangles_;
+};
+
+// Approximate Hausdorff distance between the two surfaces: the full-detail
+// vertices against the simplified triangles, and the corners, edge midpoints
+// and centroids of the simplified triangles against the full-detail ones
+double surface_error(std::vector<vertex> const & vertices, std::vector<std::uint32_t> const & full,
+                     std::vector<std::uint32_t> const & simplified)
+{
+    if (simplified.empty())
+        return 0.;
+
+    double error = 0.;
+    surface_distance to_simplified(vertices, simplified);
+    std::vector<bool> seen(vertices.size());
+    for (auto id : full)
+        if (!seen[id])
+        {
+            seen[id] = true;
+            error = std::max(error, to_simplified(glm::dvec3(vertices[id].position)));
+        }
+
+    surface_distance to_full(vertices, full);
+    for (std::size_t t = 0; t < simplified.size(); t += 3)
+    {
+        glm::dvec3 a(vertices[simplified[t]].position);
+        glm::dvec3 b(vertices[simplified[t + 1]].position);
+        glm::dvec3 c(vertices[simplified[t + 2]].position);
+        for (glm::dvec3 p : {(a + b) / 2., (b + c) / 2., (c + a) / 2., (a + b + c) / 3.})
+            error = std::max(error, to_full(p));
+    }
+    return error;
+}
+
+}
+
+simplify_result simplify_mesh(std::vector<vertex> const & vertices, std::vector<std::uint32_t> const & indices,
+                              std::size_t target_index_count, float skin_weight)
+{
+    simplify_result result;
+
+    // weld the vertices by position: collapses work on positions, the vertices at one are its wedges
+    std::vector<std::uint32_t> position_of(vertices.size());
+    std::vector<glm::dvec3> positions;
+    std::vector<std::vector<std::uint32_t>> wedges;
+    {
+        std::unordered_map<glm::vec3, std::uint32_t, position_hash> ids;
+        for (std::size_t v = 0; v < vertices.size(); ++v)
+        {
+            auto [it, inserted] = ids.try_emplace(vertices[v].position, std::uint32_t(positions.size()));
+            if (inserted)
+            {
+                positions.push_back(glm::dvec3(vertices[v].position));
+                wedges.emplace_back();
+            }
+            position_of[v] = it->second;
+            wedges[it->second].push_back(std::uint32_t(v));
+        }
+    }
+
+    std::vector<std::uint32_t> triangles;
+    triangles.reserve(indices.size());
+    for (std::size_t i = 0; i + 2 < indices.size(); i += 3)
+        if (position_of[indices[i]] != position_of[indices[i + 1]] && position_of[indices[i]] != position_of[indices[i + 2]]
+            && position_of[indices[i + 1]] != position_of[indices[i + 2]])
+            triangles.insert(triangles.end(), indices.begin() + i, indices.begin() + i + 3);
+
+    // triangle planes weighted by area, and planes through border edges at right angles to their triangle
+    auto edge_key = [](std::uint32_t a, std::uint32_t b) { return (std::uint64_t(std::min(a, b)) << 32) | std::max(a, b); };
+
+    std::vector<quadric> quadrics(positions.size());
+    {
+        std::unordered_map<std::uint64_t, int> edge_uses;
+        for (std::size_t t = 0; t < triangles.size(); t += 3)
+            for (int k = 0; k < 3; ++k)
+                ++edge_uses[edge_key(position_of[triangles[t + k]], position_of[triangles[t + (k + 1) % 3]])];
+
+        for (std::size_t t = 0; t < triangles.size(); t += 3)
+        {
+            std::uint32_t p[3] = {position_of[triangles[t]], position_of[triangles[t + 1]], position_of[triangles[t + 2]]};
+            glm::dvec3 normal = glm::cross(positions[p[1]] - positions[p[0]], positions[p[2]] - positions[p[0]]);
+            double area = glm::length(normal);
+            if (area == 0.)
+                continue;
+            normal /= area;
+
+            quadric q;
+            q.add_plane(normal, -glm::dot(normal, positions[p[0]]), area);
+            for (auto id : p)
+                quadrics[id] += q;
+
+            for (int k = 0; k < 3; ++k)
+            {
+                std::uint32_t a = p[k];
+                std::uint32_t b = p[(k + 1) % 3];
+                if (edge_uses[edge_key(a, b)] != 1)
+                    continue;
+
+                glm::dvec3 edge = positions[b] - positions[a];
+                glm::dvec3 side = glm::cross(edge, normal);
+                double length = glm::length(side);
+                if (length == 0.)
+                    continue;
+                side /= length;
+
+                quadric border;
+                border.add_plane(side, -glm::dot(side, positions[a]), border_weight * glm::dot(edge, edge));
+                quadrics[a] += border;
+                quadrics[b] += border;
+            }
+        }
+    }
+
+    mesh_bounds bounds = compute_bounds(vertices);
+    double diagonal = glm::length(bounds.extent());
+    double skin_scale = double(skin_weight) * diagonal;
+
+    std::vector<std::uint32_t> wedge_remap(vertices.size());
+    std::vector<bool> locked(positions.size());
+    std::vector<std::vector<std::uint32_t>> triangles_at(positions.size());
+
+    struct collapse
+    {
+        std::uint32_t from;
+        std::uint32_t to;
+        double cost;
+    };
+    std::vector<collapse> collapses;
+    std::unordered_set<std::uint64_t> edges;
+
+    // the wedge of `to` that each wedge of `from` becomes, false when one has none
+    auto match_wedges = [&](std::uint32_t from, std::uint32_t to, float & skin, bool apply)
+    {
+        skin = 0.f;
+        for (auto a : wedges[from])
+        {
+            std::uint32_t best = 0;
+            float best_distance = 0.f;
+            bool found = false;
+            for (auto b : wedges[to])
+            {
+                float cosine = glm::dot(vertices[a].normal, vertices[b].normal);
+                if (cosine < wedge_normal_cosine)
+                    continue;
+                float distance = (1.f - cosine) + skin_distance(vertices[a], vertices[b]);
+                if (!found || distance < best_distance)
+                {
+                    best = b;
+                    best_distance = distance;
+                    found = true;
+                }
+            }
+            if (!found)
+                return false;
+            skin = std::max(skin, skin_distance(vertices[a], vertices[best]));
+            if (apply)
+                wedge_remap[a] = best;
+        }
+        return true;
+    };
+
+    // moving `from` onto `to` must not turn any remaining triangle around
+    auto flips = [&](std::uint32_t from, std::uint32_t to)
+    {
+        for (auto t : triangles_at[from])
+        {
+            std::uint32_t p[3] = {position_of[triangles[t]], position_of[triangles[t + 1]], position_of[triangles[t + 2]]};
+            if (p[0] == to || p[1] == to || p[2] == to)
+                continue;
+
+            glm::dvec3 before = glm::cross(positions[p[1]] - positions[p[0]], positions[p[2]] - positions[p[0]]);
+            for (auto & id : p)
+                if (id == from)
+                    id = to;
+            glm::dvec3 after = glm::cross(positions[p[1]] - positions[p[0]], positions[p[2]] - positions[p[0]]);
+            if (glm::dot(before, after) <= 0.)
+                return true;
+        }
+        return false;
+    };
+
+    while (triangles.size() > target_index_count)
+    {
+        for (auto & list : triangles_at)
+            list.clear();
+        for (std::size_t t = 0; t < triangles.size(); t += 3)
+            for (int k = 0; k < 3; ++k)
+                triangles_at[position_of[triangles[t + k]]].push_back(std::uint32_t(t));
+
+        // every edge once, in the cheaper of its two directions
+        collapses.clear();
+        edges.clear();
+        for (std::size_t t = 0; t < triangles.size(); t += 3)
+            for (int k = 0; k < 3; ++k)
+            {
+                std::uint32_t a = position_of[triangles[t + k]];
+                std::uint32_t b = position_of[triangles[t + (k + 1) % 3]];
+                if (!edges.insert(edge_key(a, b)).second)
+                    continue;
+
+                quadric q = quadrics[a];
+                q += quadrics[b];
+
+                collapse best{0, 0, -1.};
+                for (auto [from, to] : {std::pair{a, b}, std::pair{b, a}})
+                {
+                    float skin;
+                    if (!match_wedges(from, to, skin, false))
+                        continue;
+                    double cost = q.error(positions[to]) + (skin_scale * skin) * (skin_scale * skin);
+                    if (best.cost < 0. || cost < best.cost)
+                        best = {from, to, cost};
+                }
+                if (best.cost >= 0.)
+                    collapses.push_back(best);
+            }
+        if (collapses.empty())
+            break;
+
+        std::sort(collapses.begin(), collapses.end(), [](collapse const & x, collapse const & y) { return x.cost < y.cost; });
+
+        for (std::size_t v = 0; v < wedge_remap.size(); ++v)
+            wedge_remap[v] = std::uint32_t(v);
+        std::fill(locked.begin(), locked.end(), false);
+
+        // a collapse removes about two triangles; each pass does at most as many as the target allows
+        std::size_t removable = (triangles.size() - target_index_count) / 3;
+        std::size_t removed = 0;
+        std::size_t made = 0;
+        for (auto const & c : collapses)
+        {
+            if (removed >= removable)
+                break;
+            if (locked[c.from] || locked[c.to] || flips(c.from, c.to))
+                continue;
+
+            float skin;
+            match_wedges(c.from, c.to, skin, true);
+            quadrics[c.to] += quadrics[c.from];
+            ++made;
+
+            // the triangles around `from` change, so their corners wait for the next pass
+            for (auto t : triangles_at[c.from])
+            {
+                std::uint32_t p[3] = {position_of[triangles[t]], position_of[triangles[t + 1]], position_of[triangles[t + 2]]};
+                if (p[0] == c.to || p[1] == c.to || p[2] == c.to)
+                    ++removed;
+                for (auto id : p)
+                    locked[id] = true;
+            }
+            locked[c.to] = true;
+        }
+        if (made == 0)
+            break;
+
+        std::size_t kept = 0;
+        for (std::size_t t = 0; t < triangles.size(); t += 3)
+        {
+            std::uint32_t a = wedge_remap[triangles[t]];
+            std::uint32_t b = wedge_remap[triangles[t + 1]];
+            std::uint32_t c = wedge_remap[triangles[t + 2]];
+            if (position_of[a] == position_of[b] || position_of[a] == position_of[c] || position_of[b] == position_of[c])
+                continue;
+            triangles[kept++] = a;
+            triangles[kept++] = b;
+            triangles[kept++] = c;
+        }
+        triangles.resize(kept);
+    }
+
+    result.error = float(surface_error(vertices, indices, triangles));
+    result.indices = std::move(triangles);
+    return result;
+}
+
+void build_lods(mesh_data & mesh, int levels)
+{
+    mesh_lod full = mesh.lods.empty() ? mesh_lod{0, std::uint32_t(mesh.indices.size()), 0.f} : mesh.lods.front();
+    std::vector<std::uint32_t> base(mesh.indices.begin() + full.first_index,
+                                    mesh.indices.begin() + full.first_index + full.index_count);
+
+    mesh.indices = base;
+    mesh.lods.assign(1, {0, std::uint32_t(base.size()), 0.f});
+
+    std::size_t target = base.size();
+    for (int level = 1; level < levels; ++level)
+    {
+        target = target / 6 * 3;
+        simplify_result simplified = simplify_mesh(mesh.vertices, base, target);
+        if (simplified.indices.empty() || simplified.indices.size() >= mesh.lods.back().index_count)
+            break;
+
+        auto optimized = optimize_vertex_cache(simplified.indices, mesh.vertices.size());
+        mesh.lods.push_back({std::uint32_t(mesh.indices.size()), std::uint32_t(optimized.size()), simplified.error});
+        mesh.indices.insert(mesh.indices.end(), optimized.begin(), optimized.end());
+    }
+}
@@ -0,0 +1,143 @@
+#include "meshlet_culling.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <glm/geometric.hpp>
+#include <glm/mat3x3.hpp>
+#include <glm/ext/scalar_constants.hpp>
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/quaternion.hpp>
+
+#include "frame_memory.h"
+
+meshlet_culler::meshlet_culler(mesh_data const & mesh)
+    : meshlets_(mesh.meshlets)
+    , bones_(mesh.meshlet_bones)
+{
+    auto first_at = [&](std::uint32_t index)
+    {
+        auto it = std::lower_bound(meshlets_.begin(), meshlets_.end(), index,
+                                   [](meshlet const & m, std::uint32_t i) { return m.first_index < i; });
+        return std::uint32_t(it - meshlets_.begin());
+    };
+
+    for (auto const & lod : mesh.lods)
+    {
+        level_range range{first_at(lod.first_index), first_at(lod.first_index + lod.index_count)};
+
+        // a level the meshlets do not cover exactly is drawn whole
+        std::uint32_t covered = 0;
+        for (std::uint32_t i = range.begin; i < range.end; ++i)
+            covered += meshlets_[i].index_count;
+        if (covered != lod.index_count)
+            range = {};
+        levels_.push_back(range);
+    }
+}
+
+bool meshlet_culler::has_meshlets(int lod) const
+{
+    return std::size_t(lod) < levels_.size() && levels_[lod].begin < levels_[lod].end;
+}
+
+std::size_t meshlet_culler::meshlet_count(int lod) const
+{
+    return has_meshlets(lod) ? levels_[lod].end - levels_[lod].begin : 0;
+}
+
+void meshlet_culler::cull(int lod, std::vector<bone_pose> const & bone_transforms, glm::mat4 const & model,
+                          std::span<glm::mat4 const> view_projections, std::span<glm::vec3 const> camera_positions,
+                          std::vector<std::uint32_t> & visible, std::vector<std::vector<std::uint32_t>> & views_visible) const
+{
+    std::size_t view_count = view_projections.size();
+    visible.clear();
+    views_visible.resize(view_count);
+    for (auto & list : views_visible)
+        list.clear();
+    if (!has_meshlets(lod))
+        return;
+
+    arena_scope scope;
+
+    // frustum planes of every view, normalized and facing inwards
+    arena_vector<glm::vec4> planes(6 * view_count);
+    for (std::size_t v = 0; v < view_count; ++v)
+    {
+        glm::mat4 const & m = view_projections[v];
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; ++i)
+            rows[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+        for (int i = 0; i < 3; ++i)
+        {
+            planes[6 * v + 2 * i] = rows[3] + rows[i];
+            planes[6 * v + 2 * i + 1] = rows[3] - rows[i];
+        }
+        for (int i = 0; i < 6; ++i)
+            planes[6 * v + i] /= glm::length(glm::vec3(planes[6 * v + i]));
+    }
+
+    glm::mat3 rotation(model);
+    float model_scale = std::max({glm::length(rotation[0]), glm::length(rotation[1]), glm::length(rotation[2])});
+
+    bone_pose const identity;
+    for (std::uint32_t i = levels_[lod].begin; i < levels_[lod].end; ++i)
+    {
+        meshlet const & m = meshlets_[i];
+        std::uint16_t const * bones = bones_.data() + m.first_bone;
+        auto pose = [&](std::uint32_t b) -> bone_pose const &
+        {
+            return m.bone_count == 0 || bones[b] >= bone_transforms.size() ? identity : bone_transforms[bones[b]];
+        };
+        std::uint32_t pose_count = std::max(m.bone_count, 1u);
+
+        // the sphere around every bone's pose of the meshlet's sphere
+        glm::vec3 min(std::numeric_limits<float>::max());
+        glm::vec3 max(std::numeric_limits<float>::lowest());
+        for (std::uint32_t b = 0; b < pose_count; ++b)
+        {
+            glm::vec3 c = pose(b) * m.center;
+            min = glm::min(min, c);
+            max = glm::max(max, c);
+        }
+
+        glm::vec3 center = (min + max) * 0.5f;
+        float radius = 0.f;
+        for (std::uint32_t b = 0; b < pose_count; ++b)
+            radius = std::max(radius, glm::distance(center, pose(b) * m.center) + m.radius * pose(b).scale);
+
+        center = glm::vec3(model * glm::vec4(center, 1.f));
+        radius *= model_scale;
+        glm::vec3 axis = glm::normalize(rotation * glm::rotate(pose(0).rotation, m.cone_axis));
+
+        // the meshlet faces away from every point within 90 degrees minus the cone's half angle around its
+        // axis; blending bones shears the normals by more than any angle between the bones bounds, so only
+        // the meshlets one bone moves rigidly are tested
+        float cone_angle = std::acos(std::clamp(m.cone_cosine, -1.f, 1.f));
+        bool backface_test = m.bone_count <= 1 && cone_angle < glm::pi<float>() / 2.f;
+        float cone_sine = std::sin(cone_angle);
+
+        bool any = false;
+        for (std::size_t v = 0; v < view_count; ++v)
+        {
+            bool inside = true;
+            for (int p = 0; p < 6 && inside; ++p)
+                inside = glm::dot(planes[6 * v + p], glm::vec4(center, 1.f)) >= -radius;
+
+            if (inside && backface_test)
+            {
+                glm::vec3 direction = center - camera_positions[v];
+                inside = glm::dot(direction, axis) < cone_sine * glm::length(direction) + radius;
+            }
+
+            if (inside)
+            {
+                views_visible[v].push_back(i);
+                any = true;
+            }
+        }
+        if (any)
+            visible.push_back(i);
+    }
+}
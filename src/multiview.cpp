@@ -0,0 +1,48 @@
+#include "multiview.h"
+
+#include <cmath>
+#include <cstring>
+
+#include "frame_memory.h"
+
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/ext/scalar_constants.hpp>
+
+view_layout make_view_layout(int count, int tile_width, int tile_height)
+{
+    view_layout layout;
+    layout.count = count;
+    layout.columns = (int)std::ceil(std::sqrt((float)count));
+    layout.rows = (count + layout.columns - 1) / layout.columns;
+    layout.tile_width = tile_width;
+    layout.tile_height = tile_height;
+    return layout;
+}
+
+glm::mat4 camera_view(float view_angle, float camera_distance, float camera_height, float orbit)
+{
+    glm::mat4 view(1.f);
+    view = glm::translate(view, {0.f, -camera_height, -camera_distance});
+    view = glm::rotate(view, view_angle, {1.f, 0.f, 0.f});
+    view = glm::rotate(view, orbit, {0.f, 1.f, 0.f});
+    return view;
+}
+
+float view_orbit(int view, int count)
+{
+    return 2.f * glm::pi<float>() * view / count;
+}
+
+std::vector<char> extract_tile(std::vector<char> const & atlas, view_layout const & layout, int view, std::size_t pixel_size)
+{
+    std::size_t atlas_row = std::size_t(layout.atlas_width()) * pixel_size;
+    std::size_t tile_row = std::size_t(layout.tile_width) * pixel_size;
+
+    auto tile = pixel_buffers().acquire(tile_row * layout.tile_height);
+
+    char const * src = atlas.data() + std::size_t(layout.tile_y(view)) * atlas_row + std::size_t(layout.tile_x(view)) * pixel_size;
+    for (int y = 0; y < layout.tile_height; ++y)
+        std::memcpy(tile.data() + y * tile_row, src + y * atlas_row, tile_row);
+
+    return tile;
+}
@@ -0,0 +1,228 @@
+#include "options.h"
+
+#include <stdexcept>
+#include <string_view>
+
+#include "utils.h"
+#include "post_chain.h"
+
+namespace
+{
+
+std::string_view next_value(int & i, int argc, char ** argv)
+{
+    if (i + 1 >= argc)
+        throw std::runtime_error("Missing value for option " + to_string(argv[i]));
+    return argv[++i];
+}
+
+int parse_int(std::string_view option, std::string_view value)
+{
+    try
+    {
+        return std::stoi(to_string(value));
+    }
+    catch (std::exception const &)
+    {
+        throw std::runtime_error("Invalid value for option " + to_string(option) + ": " + to_string(value));
+    }
+}
+
+float parse_float(std::string_view option, std::string_view value)
+{
+    try
+    {
+        return std::stof(to_string(value));
+    }
+    catch (std::exception const &)
+    {
+        throw std::runtime_error("Invalid value for option " + to_string(option) + ": " + to_string(value));
+    }
+}
+
+frame_format parse_frame_format(std::string_view value)
+{
+    if (value == "png")
+        return frame_format::png;
+    if (value == "rgba")
+        return frame_format::rgba8;
+    if (value == "rgb")
+        return frame_format::rgb8;
+    throw std::runtime_error("Unknown frame format: " + to_string(value));
+}
+
+stream_format parse_stream_format(std::string_view value)
+{
+    if (value == "y4m")
+        return stream_format::y4m;
+    if (value == "rgb")
+        return stream_format::rgb;
+    throw std::runtime_error("Unknown stream format: " + to_string(value));
+}
+
+unsigned parse_aux_targets(std::string_view value)
+{
+    unsigned mask = 0;
+    while (!value.empty())
+    {
+        auto comma = value.find(',');
+        auto name = value.substr(0, comma);
+
+        int target = 0;
+        while (target < aux_target_count && name != aux_spec(target).name)
+            ++target;
+        if (target == aux_target_count)
+            throw std::runtime_error("Unknown aux target: " + to_string(name));
+        mask |= aux_bit(target);
+
+        value = comma == std::string_view::npos ? std::string_view() : value.substr(comma + 1);
+    }
+    return mask;
+}
+
+layer_option parse_layer(std::string_view option, std::string_view value)
+{
+    auto colon = value.find(':');
+    if (colon == std::string_view::npos)
+        throw std::runtime_error("Expected BONE:OFFSET[:WEIGHT] for " + to_string(option) + ": " + to_string(value));
+
+    layer_option layer;
+    int bone = parse_int(option, value.substr(0, colon));
+    if (bone < 0)
+        throw std::runtime_error("Invalid bone for " + to_string(option) + ": " + to_string(value));
+    layer.bone = std::uint32_t(bone);
+
+    auto rest = value.substr(colon + 1);
+    auto weight = rest.find(':');
+    layer.time_offset = parse_float(option, rest.substr(0, weight));
+    if (weight != std::string_view::npos)
+        layer.weight = parse_float(option, rest.substr(weight + 1));
+    if (!(layer.weight >= 0.f && layer.weight <= 1.f))
+        throw std::runtime_error("Layer weights must be between 0 and 1: " + to_string(value));
+    return layer;
+}
+
+std::vector<std::string> parse_post_effects(std::string_view value)
+{
+    std::vector<std::string> effects;
+    while (!value.empty())
+    {
+        auto comma = value.find(',');
+        auto name = value.substr(0, comma);
+        if (!find_post_effect(name))
+            throw std::runtime_error("Unknown post effect: " + to_string(name));
+        effects.push_back(to_string(name));
+
+        value = comma == std::string_view::npos ? std::string_view() : value.substr(comma + 1);
+    }
+    return effects;
+}
+
+}
+
+render_options parse_options(int argc, char ** argv)
+{
+    render_options options;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string_view option = argv[i];
+
+        if (option == "--size")
+        {
+            auto value = next_value(i, argc, argv);
+            auto x = value.find('x');
+            if (x == std::string_view::npos)
+                throw std::runtime_error("Expected WIDTHxHEIGHT for --size: " + to_string(value));
+            options.width = parse_int(option, value.substr(0, x));
+            options.height = parse_int(option, value.substr(x + 1));
+        }
+        else if (option == "--frames")
+            options.frames = parse_int(option, next_value(i, argc, argv));
+        else if (option == "--fps")
+            options.fps = parse_float(option, next_value(i, argc, argv));
+        else if (option == "--mesh")
+            options.mesh_path = next_value(i, argc, argv);
+        else if (option == "--lod-error")
+            options.lod_error = parse_float(option, next_value(i, argc, argv));
+        else if (option == "--views")
+            options.views = parse_int(option, next_value(i, argc, argv));
+        else if (option == "--view-loop")
+            options.view_loop = true;
+        else if (option == "--aux")
+            options.aux_targets = parse_aux_targets(next_value(i, argc, argv));
+        else if (option == "--keypoints")
+            options.keypoints = true;
+        else if (option == "--crop")
+            options.crop = true;
+        else if (option == "--crop-margin")
+            options.crop_margin = parse_int(option, next_value(i, argc, argv));
+        else if (option == "--shard")
+            options.shard_path = next_value(i, argc, argv);
+        else if (option == "--shard-format")
+            options.shard_format = parse_frame_format(next_value(i, argc, argv));
+        else if (option == "--samples")
+            options.samples = parse_int(option, next_value(i, argc, argv));
+        else if (option == "--target-budget")
+            options.target_budget_mb = parse_int(option, next_value(i, argc, argv));
+        else if (option == "--post")
+            options.post_effects = parse_post_effects(next_value(i, argc, argv));
+        else if (option == "--layer")
+            options.layers.push_back(parse_layer(option, next_value(i, argc, argv)));
+        else if (option == "--paused")
+            options.paused = true;
+        else if (option == "--memory-stats")
+            options.memory_stats = parse_float(option, next_value(i, argc, argv));
+        else if (option == "--workers")
+            options.workers = parse_int(option, next_value(i, argc, argv));
+        else if (option == "--pin-threads")
+            options.pin_threads = true;
+        else if (option == "--pipeline-depth")
+            options.pipeline_depth = parse_int(option, next_value(i, argc, argv));
+        else if (option == "--bench-readback")
+            options.bench_readback = parse_int(option, next_value(i, argc, argv));
+        else if (option == "--bench-render")
+            options.bench_render = parse_int(option, next_value(i, argc, argv));
+        else if (option == "--bench-warmup")
+            options.bench_warmup = parse_int(option, next_value(i, argc, argv));
+        else if (option == "--bench-seed")
+            options.bench_seed = std::uint32_t(parse_int(option, next_value(i, argc, argv)));
+        else if (option == "--bench-json")
+            options.bench_json = next_value(i, argc, argv);
+        else if (option == "--stream")
+            options.stream_path = next_value(i, argc, argv);
+        else if (option == "--stream-format")
+            options.stream_type = parse_stream_format(next_value(i, argc, argv));
+        else
+            throw std::runtime_error("Unknown option: " + to_string(option));
+    }
+
+    if (options.width <= 0 || options.height <= 0)
+        throw std::runtime_error("Window size must be positive");
+    if (options.views < 1)
+        throw std::runtime_error("--views must be at least 1");
+    if (options.fps <= 0.f)
+        throw std::runtime_error("--fps must be positive");
+    if (options.samples < 1)
+        throw std::runtime_error("--samples must be at least 1");
+    if (options.target_budget_mb < 0)
+        throw std::runtime_error("--target-budget must not be negative");
+    if (options.workers < -1)
+        throw std::runtime_error("--workers must be -1 (automatic) or more");
+    if (options.pipeline_depth < 0)
+        throw std::runtime_error("--pipeline-depth must not be negative");
+    if (options.lod_error < 0.f)
+        throw std::runtime_error("--lod-error must not be negative");
+    if (options.crop_margin < 0)
+        throw std::runtime_error("--crop-margin must not be negative");
+    if (options.bench_render < 0)
+        throw std::runtime_error("--bench-render must not be negative");
+
+    // the benchmark is a batch of its frames
+    if (options.bench_render > 0)
+        options.frames = options.bench_render;
+    if (options.bench_warmup < 0)
+        options.bench_warmup = options.bench_render / 10;
+
+    return options;
+}
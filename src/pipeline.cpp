@@ -0,0 +1,136 @@
+#include "pipeline.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <stdexcept>
+#include <string>
+
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/scalar_constants.hpp>
+
+namespace
+{
+
+double seconds(std::chrono::steady_clock::duration d)
+{
+    return std::chrono::duration<double>(d).count();
+}
+
+}
+
+frame_simulator::frame_simulator(character_assets const & character, std::vector<float> const & radii, lod_selector const & lods, meshlet_culler const & culler,
+                                 render_options const & options)
+    : character_(character)
+    , radii_(radii)
+    , lods_(lods)
+    , culler_(culler)
+    , options_(options)
+    , poses_(character.bones)
+    , keypoint_order_(character.source_bone_ids.size())
+{
+    for (std::size_t i = 0; i < character.source_bone_ids.size(); ++i)
+        keypoint_order_[character.source_bone_ids[i]] = std::uint32_t(i);
+
+    for (auto const & layer : options.layers)
+    {
+        if (layer.bone >= character.bones.size())
+            throw std::runtime_error("--layer bone " + std::to_string(layer.bone) + " is not in the skeleton of "
+                                     + std::to_string(character.bones.size()) + " bones");
+        layers_.push_back({&character.poses, layer.time_offset, poses_.subtree_mask(keypoint_order_[layer.bone], layer.weight)});
+    }
+}
+
+void frame_simulator::run(frame_job & job, camera_state const & camera, view_layout const & views)
+{
+    float near = 0.1f;
+    float far = 100.f;
+
+    job.model = glm::mat4(1.f);
+    job.model = glm::rotate(job.model, camera.model_rotation, {0.f, 1.f, 0.f});
+    job.model = glm::rotate(job.model, -glm::pi<float>() / 2.f, {1.f, 0.f, 0.f});
+
+    job.projection = glm::perspective(glm::pi<float>() / 2.f, (1.f * views.tile_width) / views.tile_height, near, far);
+
+    // the palette also covers ids the vertices use past the skeleton; those bones stay identity
+    job.bone_transforms.resize(character_.palette_size);
+    poses_.set_layered_poses(character_.poses, job.time, layers_);
+    job.bones_evaluated = poses_.evaluate();
+    std::copy(poses_.palette().begin(), poses_.palette().end(), job.bone_transforms.begin());
+
+    job.views.resize(views.count);
+    job.camera_positions.resize(views.count);
+    job.view_projections.resize(views.count);
+    job.crops.resize(views.count);
+    job.scissors.resize(views.count);
+
+    bool keypoints = job.capture && options_.keypoints;
+    if (options_.crop || keypoints)
+        posed_joints(job.bone_transforms, character_.bones, job.model, joints_);
+
+    for (int v = 0; v < views.count; ++v)
+    {
+        glm::mat4 view = camera_view(camera.view_angle, camera.camera_distance, camera.camera_height, view_orbit(v, views.count));
+
+        job.views[v] = view;
+        job.camera_positions[v] = glm::vec3(glm::inverse(view) * glm::vec4(0.f, 0.f, 0.f, 1.f));
+        job.view_projections[v] = job.projection * view;
+
+        // the bounds are conservative, so the scissor never cuts the character
+        if (options_.crop)
+        {
+            pixel_rect crop = skinned_bounds(joints_, radii_, job.bone_transforms, view, job.projection,
+                                             views.tile_width, views.tile_height, options_.crop_margin);
+            job.crops[v] = crop;
+            job.scissors[v] = {views.tile_x(v) + crop.x, views.tile_y(v) + views.tile_height - crop.y - crop.height,
+                               crop.width, crop.height};
+        }
+    }
+
+    job.lod = lods_.select(job.model, job.views, job.projection, views.tile_height);
+    culler_.cull(job.lod, job.bone_transforms, job.model, job.view_projections, job.camera_positions,
+                 job.meshlets, job.view_meshlets);
+
+    job.keypoints_json.clear();
+    if (keypoints)
+    {
+        project_keypoints(joints_, job.view_projections, views.tile_width, views.tile_height, keypoints_);
+        format_keypoints(job.keypoints_json, job.frame_id, joints_, keypoints_, keypoint_order_);
+        job.keypoints_json += '\n';
+    }
+}
+
+void print_pipeline_stats(std::ostream & out, std::uint64_t frames, std::chrono::steady_clock::duration wall,
+                          std::span<stage_report const> stages, std::span<queue_report const> queues)
+{
+    auto precision = out.precision();
+    double total = seconds(wall);
+    auto percent = [total](std::chrono::steady_clock::duration d) { return total > 0. ? 100. * seconds(d) / total : 0.; };
+
+    out << "pipeline: " << frames << " frames in " << std::fixed << std::setprecision(3) << total << " s, "
+        << std::setprecision(1) << (total > 0. ? frames / total : 0.) << " fps\n";
+
+    // a stage is busy whenever it is neither starved by upstream nor blocked by downstream;
+    // the busiest one, per thread it runs on, bounds the throughput
+    out << std::left << std::setw(18) << "stage" << std::right
+        << std::setw(8) << "busy" << std::setw(13) << "input wait" << std::setw(13) << "output wait" << '\n';
+    for (auto const & stage : stages)
+        out << std::left << std::setw(18) << stage.name << std::right
+            << std::setw(7) << percent(stage.elapsed - stage.input_wait - stage.output_wait) << '%'
+            << std::setw(12) << percent(stage.input_wait) << '%'
+            << std::setw(12) << percent(stage.output_wait) << '%' << '\n';
+
+    out << std::left << std::setw(18) << "queue" << std::right
+        << std::setw(8) << "slots" << std::setw(13) << "mean used" << std::setw(13) << "max used"
+        << std::setw(13) << "full" << std::setw(13) << "empty" << '\n';
+    for (auto const & queue : queues)
+        out << std::left << std::setw(18) << queue.name << std::right
+            << std::setw(8) << queue.capacity
+            << std::setw(13) << std::setprecision(2) << queue.stats.mean_occupancy()
+            << std::setw(13) << queue.stats.max_occupancy
+            << std::setw(12) << std::setprecision(1) << percent(queue.stats.full_wait) << '%'
+            << std::setw(12) << percent(queue.stats.empty_wait) << '%' << '\n';
+
+    out << std::defaultfloat << std::setprecision(precision);
+}
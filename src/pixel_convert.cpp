@@ -0,0 +1,142 @@
+#include "pixel_convert.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include "frame_memory.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+// Converts columns [x0, width) of one row
+void convert_row_scalar(char const * src, int x0, int width, bool bgra, int channels, char * dst)
+{
+    int r = bgra ? 2 : 0;
+    int b = bgra ? 0 : 2;
+    for (int x = x0; x < width; ++x)
+    {
+        char const * p = src + 4 * x;
+        char * q = dst + channels * x;
+        q[0] = p[r];
+        q[1] = p[1];
+        q[2] = p[b];
+        if (channels == 4)
+            q[3] = p[3];
+    }
+}
+
+#ifdef __SSE2__
+
+// Swaps bytes 0 and 2 of every 32-bit pixel
+__m128i swap_red_blue(__m128i p)
+{
+    __m128i const ga = _mm_set1_epi32(int(0xff00ff00u));
+    __m128i rb = _mm_andnot_si128(ga, p);
+    rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+    return _mm_or_si128(_mm_and_si128(p, ga), rb);
+}
+
+// Packs 4 pixels to 12 RGB bytes in the low bytes of the result
+__m128i drop_alpha(__m128i p)
+{
+    p = _mm_and_si128(p, _mm_set1_epi32(0x00ffffff));
+    // two pixels per 64-bit lane: the second one moves right behind the first
+    __m128i lanes = _mm_or_si128(_mm_and_si128(p, _mm_set_epi32(0, -1, 0, -1)),
+                                 _mm_slli_epi64(_mm_srli_epi64(p, 32), 24));
+    // then the 6 bytes of the high lane move right behind the 6 of the low one
+    return _mm_or_si128(_mm_move_epi64(lanes), _mm_slli_si128(_mm_srli_si128(lanes, 8), 6));
+}
+
+// Returns the first column left for the scalar tail
+int convert_row_sse2(char const * src, int width, bool bgra, int channels, char * dst)
+{
+    int x = 0;
+    for (; x + 4 <= width; x += 4)
+    {
+        __m128i p = _mm_loadu_si128(reinterpret_cast<__m128i const *>(src + 4 * x));
+        if (bgra)
+            p = swap_red_blue(p);
+
+        if (channels == 4)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4 * x), p);
+            continue;
+        }
+
+        __m128i rgb = drop_alpha(p);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + 3 * x), rgb);
+        std::uint32_t last = std::uint32_t(_mm_cvtsi128_si32(_mm_srli_si128(rgb, 8)));
+        std::memcpy(dst + 3 * x + 8, &last, 4);
+    }
+    return x;
+}
+
+#endif
+
+}
+
+read_layout native_read_layout()
+{
+    GLint format = 0, type = 0;
+    glGetIntegerv(GL_IMPLEMENTATION_COLOR_READ_FORMAT, &format);
+    glGetIntegerv(GL_IMPLEMENTATION_COLOR_READ_TYPE, &type);
+
+    // 8_8_8_8_REV has the byte order of UNSIGNED_BYTE on little-endian hosts
+    bool bytes = type == GL_UNSIGNED_BYTE || type == GL_UNSIGNED_INT_8_8_8_8_REV;
+    if ((format == GL_RGBA || format == GL_BGRA) && bytes)
+        return {GLenum(format), GLenum(type)};
+    return {};
+}
+
+std::vector<char> read_pixels(int x, int y, int width, int height, read_layout layout)
+{
+    std::vector<char> pixels(std::size_t(width) * height * 4);
+    glReadPixels(x, y, width, height, layout.format, layout.type, pixels.data());
+    return pixels;
+}
+
+void convert_pixels(char const * src, std::ptrdiff_t stride, int width, int height, bool bgra, int channels, char * dst)
+{
+    std::size_t dst_row = std::size_t(width) * channels;
+
+    for (int y = 0; y < height; ++y, src += stride, dst += dst_row)
+    {
+        // RGBA to RGBA is a plain copy of the row
+        if (!bgra && channels == 4)
+        {
+            std::memcpy(dst, src, dst_row);
+            continue;
+        }
+
+        int x = 0;
+#ifdef __SSE2__
+        x = convert_row_sse2(src, width, bgra, channels, dst);
+#endif
+        convert_row_scalar(src, x, width, bgra, channels, dst);
+    }
+}
+
+void convert_pixels_scalar(char const * src, std::ptrdiff_t stride, int width, int height, bool bgra, int channels, char * dst)
+{
+    std::size_t dst_row = std::size_t(width) * channels;
+
+    for (int y = 0; y < height; ++y, src += stride, dst += dst_row)
+        convert_row_scalar(src, 0, width, bgra, channels, dst);
+}
+
+std::vector<char> convert_region(std::vector<char> const & pixels, int row_length, int x, int y, int width, int height,
+                                 bool bgra, int channels)
+{
+    auto image = pixel_buffers().acquire(std::size_t(width) * height * channels);
+    if (width <= 0 || height <= 0)
+        return image;
+
+    std::ptrdiff_t stride = std::ptrdiff_t(row_length) * 4;
+    char const * top = pixels.data() + (y + height - 1) * stride + std::ptrdiff_t(x) * 4;
+    convert_pixels(top, -stride, width, height, bgra, channels, image.data());
+    return image;
+}
@@ -0,0 +1,197 @@
+#include "pose_evaluator.h"
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#include "frame_memory.h"
+
+namespace
+{
+
+// The key poses a clip blends at `time`, and the smoothed factor between them
+struct clip_key
+{
+    int n = 0;
+    int n1 = 0;
+    float s = 0.f;
+};
+
+clip_key key_at(std::size_t key_count, float time)
+{
+    int count = int(key_count);
+    float whole = std::floor(time);
+    float t = time - whole;
+
+    clip_key key;
+    key.n = (int(whole) % count + count) % count;
+    key.n1 = (key.n + 1) % count;
+    key.s = 3 * t * t - 2 * t * t * t;
+    return key;
+}
+
+// A bone's pose relative to its parent in `clip` at `key`; roots take the key pose as it is
+bone_pose sample(std::vector<std::vector<bone_pose>> const & clip, clip_key const & key, std::uint32_t bone, bool root)
+{
+    bone_pose const & from = clip[key.n][bone];
+    bone_pose const & to = clip[key.n1][bone];
+    return root || from == to ? from : blend_poses(from, to, key.s);
+}
+
+}
+
+bone_mask::bone_mask(std::size_t bone_count)
+    : bits((bone_count + 63) / 64, 0)
+    , weights(bone_count, 0.f)
+{
+}
+
+void bone_mask::set(std::uint32_t bone, float weight)
+{
+    std::uint64_t bit = std::uint64_t(1) << (bone % 64);
+    weights[bone] = weight;
+    if (weight != 0.f)
+        bits[bone / 64] |= bit;
+    else
+        bits[bone / 64] &= ~bit;
+}
+
+pose_evaluator::pose_evaluator(std::vector<bone> const & bones)
+    : locals_(bones.size())
+    , palette_(bones.size())
+    , depth_first_(bones.size())
+    , subtree_ends_(bones.size())
+    , positions_(bones.size())
+    , dirty_(bones.size(), 1)
+{
+    std::size_t count = bones.size();
+    parents_.reserve(count);
+    for (auto const & b : bones)
+        parents_.push_back(b.parent_id);
+
+    // parents come before their children, so walking the ids backwards sums every subtree
+    std::vector<std::uint32_t> sizes(count, 1);
+    for (std::size_t b = count; b-- > 0;)
+        if (parents_[b] >= 0)
+            sizes[parents_[b]] += sizes[b];
+
+    // a subtree takes the positions right behind its root, its children's subtrees one after the other
+    std::vector<std::uint32_t> next_child(count);
+    std::uint32_t next_root = 0;
+    for (std::size_t b = 0; b < count; ++b)
+    {
+        std::uint32_t & position = positions_[b];
+        if (parents_[b] < 0)
+        {
+            position = next_root;
+            next_root += sizes[b];
+        }
+        else
+        {
+            position = next_child[parents_[b]];
+            next_child[parents_[b]] += sizes[b];
+        }
+        next_child[b] = position + 1;
+        depth_first_[position] = std::uint32_t(b);
+        subtree_ends_[position] = position + sizes[b];
+    }
+}
+
+void pose_evaluator::set_local_pose(std::uint32_t bone, bone_pose const & from, bone_pose const & to, float blend)
+{
+    local_pose & local = locals_[bone];
+    // roots ignore `to` and the blend, and two equal poses need no blend
+    if (local.from == from && local.to == to && (local.blend == blend || parents_[bone] < 0 || from == to))
+        return;
+
+    local = {from, to, blend};
+    dirty_[positions_[bone]] = 1;
+}
+
+void pose_evaluator::set_key_poses(std::vector<std::vector<bone_pose>> const & poses, int n, float t)
+{
+    int n1 = (n + 1) % int(poses.size());
+    float s = 3 * t * t - 2 * t * t * t;
+
+    for (std::size_t b = 0; b < palette_.size(); ++b)
+        set_local_pose(std::uint32_t(b), poses[n][b], poses[n1][b], s);
+}
+
+void pose_evaluator::set_layered_poses(std::vector<std::vector<bone_pose>> const & clip, float time,
+                                       std::span<animation_layer const> layers)
+{
+    std::size_t count = palette_.size();
+    clip_key base = key_at(clip.size(), time);
+
+    arena_scope scope;
+    arena_vector<clip_key> keys(layers.size());
+    for (std::size_t l = 0; l < layers.size(); ++l)
+    {
+        if (layers[l].mask.weights.size() != count || layers[l].clip->size() == 0)
+            throw std::runtime_error("Animation layer " + std::to_string(l) + " does not fit the skeleton");
+        keys[l] = key_at(layers[l].clip->size(), time + layers[l].time_offset);
+    }
+
+    std::uint64_t covered = 0;
+    for (std::uint32_t b = 0; b < count; ++b)
+    {
+        // the bones any layer covers, 64 at a time
+        if (b % 64 == 0)
+        {
+            covered = 0;
+            for (auto const & layer : layers)
+                covered |= layer.mask.bits[b / 64];
+        }
+
+        bone_pose const & from = clip[base.n][b];
+        bone_pose const & to = clip[base.n1][b];
+        if (!(covered >> (b % 64) & 1))
+        {
+            set_local_pose(b, from, to, base.s);
+            continue;
+        }
+
+        bool root = parents_[b] < 0;
+        bone_pose local = sample(clip, base, b, root);
+        for (std::size_t l = 0; l < layers.size(); ++l)
+            if (layers[l].mask.covers(b))
+                local = blend_poses(local, sample(*layers[l].clip, keys[l], b, root), layers[l].mask.weights[b]);
+        set_local_pose(b, local, local, 0.f);
+    }
+}
+
+bone_mask pose_evaluator::subtree_mask(std::uint32_t bone, float weight) const
+{
+    bone_mask mask(palette_.size());
+    std::uint32_t position = positions_[bone];
+    for (std::uint32_t i = position; i < subtree_ends_[position]; ++i)
+        mask.set(depth_first_[i], weight);
+    return mask;
+}
+
+std::size_t pose_evaluator::evaluate()
+{
+    std::size_t evaluated = 0;
+    std::size_t count = palette_.size();
+
+    for (std::size_t i = 0; i < count;)
+    {
+        if (!dirty_[i])
+        {
+            ++i;
+            continue;
+        }
+
+        // the subtree follows its root, parents before children, and the root's parent is posed already
+        std::size_t end = subtree_ends_[i];
+        for (; i < end; ++i)
+        {
+            std::uint32_t b = depth_first_[i];
+            local_pose const & local = locals_[b];
+            palette_[b] = parents_[b] < 0 ? local.from : pose_child(palette_[parents_[b]], local.from, local.to, local.blend);
+            dirty_[i] = 0;
+            ++evaluated;
+        }
+    }
+    return evaluated;
+}
@@ -0,0 +1,144 @@
+#include "post_chain.h"
+
+#include <stdexcept>
+
+#include "memory_stats.h"
+#include "shader.h"
+#include "shader_sources.h"
+
+post_effect const * find_post_effect(std::string_view name)
+{
+    // "copy" is the former always-on display pass
+    static post_effect const effects[] = {
+        {"copy", rect_fragment_shader_source},
+        {"gamma", gamma_fragment_shader_source},
+        {"grayscale", grayscale_fragment_shader_source},
+    };
+
+    for (auto const & effect : effects)
+        if (name == effect.name)
+            return &effect;
+    return nullptr;
+}
+
+post_chain::post_chain(std::vector<std::string> const & effects)
+{
+    if (effects.empty())
+        return;
+
+    auto vertex_shader = create_shader(GL_VERTEX_SHADER, rect_vertex_shader_source);
+    for (auto const & name : effects)
+    {
+        auto effect = find_post_effect(name);
+        if (!effect)
+            throw std::runtime_error("Unknown post effect: " + name);
+
+        pass p;
+        p.program = create_program(vertex_shader, create_shader(GL_FRAGMENT_SHADER, effect->fragment_source));
+        p.texture_location = glGetUniformLocation(p.program, "renderedTexture");
+        p.time_location = glGetUniformLocation(p.program, "time");
+        p.uv_scale_location = glGetUniformLocation(p.program, "uv_scale");
+        passes_.push_back(p);
+    }
+
+    static const GLfloat quad[] = {
+        -1.0f, -1.0f, 0.0f,
+        1.0f, -1.0f, 0.0f,
+        -1.0f,  1.0f, 0.0f,
+        -1.0f,  1.0f, 0.0f,
+        1.0f, -1.0f, 0.0f,
+        1.0f,  1.0f, 0.0f,
+    };
+
+    glGenVertexArrays(1, &vao_);
+    glBindVertexArray(vao_);
+
+    glGenBuffers(1, &vbo_);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+    track_gl_object(gl_object_kind::buffer, vbo_, sizeof(quad));
+
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 3, (void*) 0);
+
+    // intermediate images ping-pong between two textures of one framebuffer
+    if (passes_.size() > 1)
+    {
+        glGenFramebuffers(1, &framebuffer_);
+        glGenTextures(2, textures_);
+        for (auto texture : textures_)
+        {
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        }
+    }
+}
+
+post_chain::~post_chain()
+{
+    for (auto const & p : passes_)
+        glDeleteProgram(p.program);
+    forget_gl_objects(gl_object_kind::texture, 2, textures_);
+    glDeleteTextures(2, textures_);
+    glDeleteFramebuffers(1, &framebuffer_);
+    forget_gl_objects(gl_object_kind::buffer, 1, &vbo_);
+    glDeleteBuffers(1, &vbo_);
+    glDeleteVertexArrays(1, &vao_);
+}
+
+void post_chain::resize(int width, int height)
+{
+    if (width == width_ && height == height_)
+        return;
+
+    width_ = width;
+    height_ = height;
+    for (auto texture : textures_)
+    {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        track_gl_object(gl_object_kind::texture, texture, std::size_t(width) * height * gl_format_bytes(GL_RGBA8));
+    }
+}
+
+void post_chain::apply(render_target const & source, GLuint output, int width, int height, float time)
+{
+    if (passes_.size() > 1)
+        resize(width, height);
+
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+    glViewport(0, 0, width, height);
+    glBindVertexArray(vao_);
+    glActiveTexture(GL_TEXTURE0);
+
+    // the source may be pooled storage larger than its image, intermediate textures are exact
+    GLuint input = source.color;
+    float u_scale = float(source.width) / source.storage_width;
+    float v_scale = float(source.height) / source.storage_height;
+
+    for (std::size_t i = 0; i < passes_.size(); ++i)
+    {
+        bool last = i + 1 == passes_.size();
+        GLuint result = textures_[i % 2];
+
+        if (last)
+            glBindFramebuffer(GL_FRAMEBUFFER, output);
+        else
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+            glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, result, 0);
+        }
+
+        glUseProgram(passes_[i].program);
+        glBindTexture(GL_TEXTURE_2D, input);
+        glUniform1i(passes_[i].texture_location, 0);
+        glUniform1f(passes_[i].time_location, time);
+        glUniform2f(passes_[i].uv_scale_location, u_scale, v_scale);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+
+        input = result;
+        u_scale = v_scale = 1.f;
+    }
+}
@@ -0,0 +1,134 @@
+#include "readback.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "frame_memory.h"
+#include "memory_stats.h"
+
+namespace
+{
+
+std::string gl_error_name(GLenum error)
+{
+    switch (error)
+    {
+        case GL_NO_ERROR:
+            return "no GL error";
+        case GL_INVALID_ENUM:
+            return "GL_INVALID_ENUM";
+        case GL_INVALID_VALUE:
+            return "GL_INVALID_VALUE";
+        case GL_INVALID_OPERATION:
+            return "GL_INVALID_OPERATION";
+        case GL_OUT_OF_MEMORY:
+            return "GL_OUT_OF_MEMORY";
+        default:
+            return "GL error " + std::to_string(error);
+    }
+}
+
+}
+
+async_readback::~async_readback()
+{
+    for (auto & s : in_flight_)
+    {
+        glDeleteSync(s.fence);
+        forget_gl_objects(gl_object_kind::buffer, 1, &s.buffer);
+        glDeleteBuffers(1, &s.buffer);
+    }
+    for (auto & s : free_)
+    {
+        forget_gl_objects(gl_object_kind::buffer, 1, &s.buffer);
+        glDeleteBuffers(1, &s.buffer);
+    }
+}
+
+void async_readback::start(std::uint64_t tag, int x, int y, int width, int height, GLenum format, GLenum type,
+                           std::size_t pixel_size)
+{
+    slot s;
+    if (!free_.empty())
+    {
+        s = free_.back();
+        free_.pop_back();
+    }
+    else
+        glGenBuffers(1, &s.buffer);
+
+    s.tag = tag;
+    s.x = x;
+    s.y = y;
+    s.width = width;
+    s.height = height;
+    s.size = std::size_t(width) * height * pixel_size;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, s.buffer);
+    if (s.capacity < s.size)
+    {
+        glBufferData(GL_PIXEL_PACK_BUFFER, s.size, nullptr, GL_STREAM_READ);
+        s.capacity = s.size;
+        track_gl_object(gl_object_kind::buffer, s.buffer, s.size);
+    }
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(x, y, width, height, format, type, nullptr);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    memory_scope scope(memory_category::queues);
+    in_flight_.push_back(s);
+}
+
+std::optional<readback_result> async_readback::poll(bool wait)
+{
+    if (in_flight_.empty())
+        return std::nullopt;
+
+    slot s = in_flight_.front();
+
+    GLenum status;
+    do
+        status = glClientWaitSync(s.fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? 1000000000 : 0);
+    while (wait && status == GL_TIMEOUT_EXPIRED);
+
+    if (status == GL_TIMEOUT_EXPIRED)
+        return std::nullopt;
+    if (status == GL_WAIT_FAILED)
+        throw std::runtime_error("Waiting for a readback failed");
+
+    in_flight_.erase(in_flight_.begin());
+    glDeleteSync(s.fence);
+    s.fence = nullptr;
+
+    {
+        // the slot can be reused whether or not its pixels arrive
+        memory_scope scope(memory_category::queues);
+        free_.push_back(s);
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, s.buffer);
+    void const * data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, s.size, GL_MAP_READ_BIT);
+    if (!data)
+    {
+        GLenum error = glGetError();
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        throw std::runtime_error("Mapping the " + std::string(name_) + " readback failed: " + gl_error_name(error));
+    }
+
+    readback_result result{s.tag, s.x, s.y, s.width, s.height, pixel_buffers().acquire(s.size)};
+    std::memcpy(result.pixels.data(), data, s.size);
+    // GL_FALSE means the buffer's contents were lost while it was mapped
+    bool intact = glUnmapBuffer(GL_PIXEL_PACK_BUFFER) == GL_TRUE;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (!intact)
+    {
+        pixel_buffers().release(std::move(result.pixels));
+        throw std::runtime_error("The " + std::string(name_) + " readback was corrupted while mapped");
+    }
+    return result;
+}
@@ -0,0 +1,115 @@
+#include "readback_bench.h"
+
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+#include "pixel_convert.h"
+
+namespace
+{
+
+using bench_clock = std::chrono::steady_clock;
+
+struct readback_path
+{
+    std::string name;
+    // glGetTexImage of the color texture instead of glReadPixels of the framebuffer
+    bool texture;
+    // 3-byte GL_RGB readback, flipped with a row copy
+    bool rgb_readback;
+    bool native;
+    bool simd;
+    int channels;
+};
+
+double seconds(bench_clock::duration d)
+{
+    return std::chrono::duration<double>(d).count();
+}
+
+}
+
+void bench_readback(render_target const & target, int iterations, std::ostream & out)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+
+    read_layout native = native_read_layout();
+    read_layout rgba;
+
+    int width = target.width;
+    int height = target.height;
+    double megabytes = double(width) * height * 4 / (1024. * 1024.);
+
+    std::vector<readback_path> paths = {
+        {"texture rgba, scalar flip", true, false, false, false, 4},
+        {"read rgb, row flip", false, true, false, false, 3},
+        {"read rgba, scalar flip", false, false, false, false, 4},
+        {"read rgba, row copy flip", false, false, false, true, 4},
+        {"read native, simd rgba", false, false, true, true, 4},
+        {"read native, scalar rgb", false, false, true, false, 3},
+        {"read native, simd rgb", false, false, true, true, 3},
+    };
+
+    out << "readback " << width << 'x' << height << ", native layout "
+        << (native.bgra() ? "BGRA" : "RGBA") << ", " << iterations << " iterations\n";
+    out << std::left << std::setw(28) << "path" << std::right
+        << std::setw(12) << "read MB/s" << std::setw(14) << "convert MB/s" << std::setw(12) << "total MB/s" << '\n';
+
+    // glGetTexImage returns the whole level, which may be larger pooled storage
+    std::vector<char> pixels(std::size_t(target.storage_width) * target.storage_height * 4);
+    std::vector<char> image(std::size_t(width) * height * 4);
+
+    for (auto const & path : paths)
+    {
+        read_layout layout = path.native ? native : rgba;
+        int row_length = path.texture ? target.storage_width : width;
+        std::ptrdiff_t stride = std::ptrdiff_t(row_length) * (path.rgb_readback ? 3 : 4);
+        char const * last_row = pixels.data() + (height - 1) * stride;
+
+        glFinish();
+
+        bench_clock::duration read_time{}, convert_time{};
+        for (int i = 0; i < iterations; ++i)
+        {
+            auto start = bench_clock::now();
+            if (path.texture)
+            {
+                glBindTexture(GL_TEXTURE_2D, target.color);
+                glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+            }
+            else if (path.rgb_readback)
+            {
+                glPixelStorei(GL_PACK_ALIGNMENT, 1);
+                glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+                glPixelStorei(GL_PACK_ALIGNMENT, 4);
+            }
+            else
+                glReadPixels(0, 0, width, height, layout.format, layout.type, pixels.data());
+            auto read = bench_clock::now();
+
+            if (path.rgb_readback)
+                for (int y = 0; y < height; ++y)
+                    std::memcpy(image.data() + y * stride, last_row - y * stride, stride);
+            else if (path.simd)
+                convert_pixels(last_row, -stride, width, height, layout.bgra(), path.channels, image.data());
+            else
+                convert_pixels_scalar(last_row, -stride, width, height, layout.bgra(), path.channels, image.data());
+            auto converted = bench_clock::now();
+
+            read_time += read - start;
+            convert_time += converted - read;
+        }
+
+        double total = megabytes * iterations;
+        out << std::left << std::setw(28) << path.name << std::right << std::fixed << std::setprecision(1)
+            << std::setw(12) << total / seconds(read_time)
+            << std::setw(14) << total / seconds(convert_time)
+            << std::setw(12) << total / seconds(read_time + convert_time) << '\n';
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
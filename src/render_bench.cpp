@@ -0,0 +1,169 @@
+#include "render_bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+#include <glm/ext/scalar_constants.hpp>
+
+namespace
+{
+
+// splitmix64: a well mixed 64-bit value for every input, no state to carry between frames
+std::uint64_t mix(std::uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+double milliseconds(frame_profiler::clock::duration d)
+{
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+// nearest rank
+double percentile(std::vector<double> const & sorted, double p)
+{
+    if (sorted.empty())
+        return 0.;
+    auto rank = std::size_t(std::ceil(p / 100. * sorted.size()));
+    return sorted[std::clamp<std::size_t>(rank, 1, sorted.size()) - 1];
+}
+
+}
+
+void bench_frame(std::uint32_t seed, std::uint64_t index, float & time, camera_state & camera)
+{
+    std::uint64_t state = mix(seed) ^ index;
+    auto uniform = [&state](float low, float high) {
+        state = mix(state);
+        return low + (high - low) * float(state >> 40) / float(1 << 24);
+    };
+
+    time = uniform(0.f, 6.f);
+    camera.view_angle = uniform(-0.2f, 0.3f);
+    camera.camera_distance = uniform(2.5f, 3.5f);
+    camera.camera_height = uniform(0.9f, 1.5f);
+    camera.model_rotation = uniform(0.f, 2.f * glm::pi<float>());
+}
+
+char const * bench_stage_name(bench_stage stage)
+{
+    switch (stage)
+    {
+        case bench_stage::animation:
+            return "animation";
+        case bench_stage::upload:
+            return "upload";
+        case bench_stage::draw:
+            return "draw";
+        case bench_stage::readback:
+            return "readback";
+        case bench_stage::encode:
+            return "encode";
+        case bench_stage::write:
+            return "write";
+    }
+    return "";
+}
+
+frame_profiler::frame_profiler(std::size_t frames)
+    : frames_(frames)
+{}
+
+void frame_profiler::start(std::uint64_t frame)
+{
+    if (frame < frames_.size())
+        frames_[frame].start = clock::now();
+}
+
+void frame_profiler::add(std::uint64_t frame, bench_stage stage, clock::duration time)
+{
+    if (frame < frames_.size())
+        frames_[frame].stages[int(stage)] += time;
+}
+
+void frame_profiler::finish(std::uint64_t frame)
+{
+    if (frame < frames_.size())
+        frames_[frame].finish = clock::now();
+}
+
+render_bench_summary summarize_render_bench(frame_profiler const & profiler, std::uint64_t warmup, int views)
+{
+    auto const & frames = profiler.frames();
+
+    render_bench_summary summary;
+    summary.frames = frames.size();
+    summary.warmup = std::min<std::uint64_t>(warmup, frames.empty() ? 0 : frames.size() - 1);
+    summary.views = views;
+
+    std::vector<double> latencies;
+    frame_profiler::clock::time_point last_finish = frames.empty() ? frame_profiler::clock::time_point() : frames[0].finish;
+    for (std::size_t i = summary.warmup; i < frames.size(); ++i)
+    {
+        auto const & frame = frames[i];
+        latencies.push_back(milliseconds(frame.finish - frame.start));
+        last_finish = std::max(last_finish, frame.finish);
+        for (int s = 0; s < bench_stage_count; ++s)
+            summary.stage_ms[s] += milliseconds(frame.stages[s]);
+    }
+    if (latencies.empty())
+        return summary;
+
+    std::size_t measured = latencies.size();
+    for (auto & ms : summary.stage_ms)
+        ms /= measured;
+
+    // frames finish in order; without warm-up the first frame's own time is all there is to go by
+    auto begin = summary.warmup > 0 ? frames[summary.warmup - 1].finish : frames[0].start;
+    double seconds = std::chrono::duration<double>(last_finish - begin).count();
+    if (seconds > 0.)
+        summary.images_per_second = double(measured) * views / seconds;
+
+    double sum = 0.;
+    for (double ms : latencies)
+        sum += ms;
+    summary.latency_mean_ms = sum / measured;
+
+    std::sort(latencies.begin(), latencies.end());
+    summary.latency_p50_ms = percentile(latencies, 50.);
+    summary.latency_p99_ms = percentile(latencies, 99.);
+    return summary;
+}
+
+void print_render_bench(std::ostream & out, render_bench_summary const & summary)
+{
+    auto precision = out.precision();
+    out << "render bench: " << summary.frames - summary.warmup << " frames after " << summary.warmup << " warm-up, "
+        << summary.views << " view" << (summary.views > 1 ? "s" : "") << " of " << summary.width << 'x' << summary.height
+        << ", seed " << summary.seed << '\n';
+    out << std::fixed << std::setprecision(1) << "images/s " << summary.images_per_second
+        << std::setprecision(2) << ", latency p50 " << summary.latency_p50_ms << " ms, p99 " << summary.latency_p99_ms
+        << " ms, mean " << summary.latency_mean_ms << " ms\n";
+
+    // stages of different frames overlap in a pipelined run, the costs add up to more than the frame interval
+    double total = 0.;
+    for (double ms : summary.stage_ms)
+        total += ms;
+    out << std::left << std::setw(18) << "stage" << std::right << std::setw(12) << "ms/frame" << std::setw(9) << "share" << '\n';
+    for (int s = 0; s < bench_stage_count; ++s)
+        out << std::left << std::setw(18) << bench_stage_name(bench_stage(s)) << std::right
+            << std::setw(12) << std::setprecision(3) << summary.stage_ms[s]
+            << std::setw(8) << std::setprecision(1) << (total > 0. ? 100. * summary.stage_ms[s] / total : 0.) << '%' << '\n';
+    out << std::defaultfloat << std::setprecision(precision);
+}
+
+void write_render_bench_json(std::ostream & out, render_bench_summary const & summary)
+{
+    out << "{\"frames\":" << summary.frames << ",\"warmup\":" << summary.warmup << ",\"views\":" << summary.views
+        << ",\"width\":" << summary.width << ",\"height\":" << summary.height << ",\"seed\":" << summary.seed
+        << ",\"images_per_second\":" << summary.images_per_second
+        << ",\"latency_ms\":{\"p50\":" << summary.latency_p50_ms << ",\"p99\":" << summary.latency_p99_ms
+        << ",\"mean\":" << summary.latency_mean_ms << "},\"stages_ms\":{";
+    for (int s = 0; s < bench_stage_count; ++s)
+        out << (s ? "," : "") << '"' << bench_stage_name(bench_stage(s)) << "\":" << summary.stage_ms[s];
+    out << "}}\n";
+}
@@ -0,0 +1,281 @@
+#include "render_target.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "memory_stats.h"
+
+aux_target_spec const & aux_spec(int target)
+{
+    // linear view depth, view-space normals packed to [0, 1] and the dominant bone id
+    static aux_target_spec const specs[aux_target_count] = {
+        {"depth", GL_R32F, GL_RED, GL_FLOAT, 4},
+        {"normals", GL_RGB10_A2, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, 4},
+        {"bones", GL_R8UI, GL_RED_INTEGER, GL_UNSIGNED_BYTE, 1},
+    };
+    return specs[target];
+}
+
+// Color and every aux target of the bound framebuffer are written by draws
+static void set_draw_buffers(render_target const & target)
+{
+    GLenum draw_buffers[1 + aux_target_count] = {GL_COLOR_ATTACHMENT0};
+    for (int i = 0; i < aux_target_count; ++i)
+        draw_buffers[1 + i] = target.aux[i] ? GL_COLOR_ATTACHMENT1 + i : GL_NONE;
+    glDrawBuffers(target.aux_mask ? 1 + aux_target_count : 1, draw_buffers);
+}
+
+render_target create_render_target(int width, int height, unsigned aux_mask, int samples)
+{
+    render_target target;
+    target.aux_mask = aux_mask;
+    target.samples = samples;
+
+    glGenFramebuffers(1, &target.framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+
+    glGenTextures(1, &target.color);
+    if (samples == 1)
+    {
+        glBindTexture(GL_TEXTURE_2D, target.color);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    }
+
+    for (int i = 0; i < aux_target_count; ++i)
+    {
+        if (!(aux_mask & aux_bit(i)))
+            continue;
+
+        glGenTextures(1, &target.aux[i]);
+        if (samples > 1)
+            continue;
+        glBindTexture(GL_TEXTURE_2D, target.aux[i]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    }
+
+    glGenRenderbuffers(1, &target.depth);
+
+    resize_render_target(target, width, height);
+
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, target.color, 0);
+
+    for (int i = 0; i < aux_target_count; ++i)
+        if (target.aux[i])
+            glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1 + i, target.aux[i], 0);
+    set_draw_buffers(target);
+
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, target.depth);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        throw std::runtime_error("Offscreen framebuffer is incomplete");
+
+    return target;
+}
+
+void resize_render_target(render_target & target, int width, int height)
+{
+    target.width = target.storage_width = width;
+    target.height = target.storage_height = height;
+
+    glBindRenderbuffer(GL_RENDERBUFFER, target.depth);
+    if (target.samples > 1)
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, target.samples, GL_DEPTH_COMPONENT24, width, height);
+    else
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width, height);
+    track_gl_object(gl_object_kind::renderbuffer, target.depth,
+                    std::size_t(width) * height * target.samples * gl_format_bytes(GL_DEPTH_COMPONENT24));
+
+    auto allocate = [&](GLuint texture, GLenum internal_format, GLenum format, GLenum type) {
+        track_gl_object(gl_object_kind::texture, texture,
+                        std::size_t(width) * height * target.samples * gl_format_bytes(internal_format));
+        if (target.samples > 1)
+        {
+            glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, texture);
+            glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, target.samples, internal_format, width, height, GL_TRUE);
+            return;
+        }
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, type, nullptr);
+    };
+
+    allocate(target.color, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+
+    for (int i = 0; i < aux_target_count; ++i)
+    {
+        if (!target.aux[i])
+            continue;
+
+        auto const & spec = aux_spec(i);
+        allocate(target.aux[i], spec.internal_format, spec.format, spec.type);
+    }
+}
+
+void destroy_render_target(render_target & target)
+{
+    forget_gl_objects(gl_object_kind::texture, 1, &target.color);
+    forget_gl_objects(gl_object_kind::texture, aux_target_count, target.aux);
+    forget_gl_objects(gl_object_kind::renderbuffer, 1, &target.depth);
+
+    glDeleteFramebuffers(1, &target.framebuffer);
+    glDeleteTextures(1, &target.color);
+    glDeleteTextures(aux_target_count, target.aux);
+    glDeleteRenderbuffers(1, &target.depth);
+    target = {};
+}
+
+void resolve_render_target(render_target const & source, render_target & resolved)
+{
+    resolved.width = source.width;
+    resolved.height = source.height;
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, source.framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolved.framebuffer);
+
+    // a blit copies the one read buffer into every draw buffer, so the attachments go one at a time
+    for (int i = 0; i <= aux_target_count; ++i)
+    {
+        if (i > 0 && !source.aux[i - 1])
+            continue;
+
+        GLenum draw_buffers[1 + aux_target_count] = {GL_NONE};
+        draw_buffers[i] = GL_COLOR_ATTACHMENT0 + i;
+        glReadBuffer(GL_COLOR_ATTACHMENT0 + i);
+        glDrawBuffers(i + 1, draw_buffers);
+        glBlitFramebuffer(0, 0, source.width, source.height, 0, 0, source.width, source.height,
+                          GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    }
+
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    set_draw_buffers(resolved);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, resolved.framebuffer);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+}
+
+std::size_t render_target_bytes(render_target const & target)
+{
+    // RGBA8 color and a depth buffer that is padded to 32 bits in practice
+    std::size_t pixel = 4 + 4;
+    for (int i = 0; i < aux_target_count; ++i)
+        if (target.aux[i])
+            pixel += aux_spec(i).pixel_size;
+    return std::size_t(target.storage_width) * target.storage_height * target.samples * pixel;
+}
+
+int max_render_target_size()
+{
+    GLint max_texture_size = 0;
+    GLint max_renderbuffer_size = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &max_renderbuffer_size);
+    return std::min(max_texture_size, max_renderbuffer_size);
+}
+
+int max_render_target_samples(unsigned aux_mask)
+{
+    GLint max_samples = 0;
+    GLint max_color_samples = 0;
+    glGetIntegerv(GL_MAX_SAMPLES, &max_samples);
+    glGetIntegerv(GL_MAX_COLOR_TEXTURE_SAMPLES, &max_color_samples);
+    int samples = std::min(max_samples, max_color_samples);
+    if (aux_mask & aux_bit(aux_bones))
+    {
+        GLint max_integer_samples = 0;
+        glGetIntegerv(GL_MAX_INTEGER_SAMPLES, &max_integer_samples);
+        samples = std::min(samples, int(max_integer_samples));
+    }
+    return std::max(samples, 1);
+}
+
+static int bucket_size(int size, int max_size)
+{
+    int bucket = 64;
+    while (bucket < size)
+        bucket *= 2;
+    return std::min(bucket, max_size);
+}
+
+render_target_pool::render_target_pool(std::size_t budget_bytes)
+    : budget_(budget_bytes)
+    , max_size_(max_render_target_size())
+{}
+
+render_target_pool::~render_target_pool()
+{
+    for (auto & target : idle_)
+        destroy_render_target(target);
+}
+
+render_target render_target_pool::acquire(int width, int height, unsigned aux_mask, int samples)
+{
+    if (width > max_size_ || height > max_size_)
+        throw std::runtime_error("A " + std::to_string(width) + "x" + std::to_string(height)
+                                 + " render target exceeds the driver's limit of " + std::to_string(max_size_) + " pixels");
+
+    int storage_width = bucket_size(width, max_size_);
+    int storage_height = bucket_size(height, max_size_);
+
+    for (auto it = idle_.begin(); it != idle_.end(); ++it)
+    {
+        if (it->aux_mask != aux_mask || it->samples != samples
+            || it->storage_width != storage_width || it->storage_height != storage_height)
+            continue;
+
+        render_target target = *it;
+        idle_.erase(it);
+        target.width = width;
+        target.height = height;
+        return target;
+    }
+
+    render_target target = create_render_target(storage_width, storage_height, aux_mask, samples);
+    target.width = width;
+    target.height = height;
+
+    allocated_ += render_target_bytes(target);
+    evict();
+    return target;
+}
+
+void render_target_pool::release(render_target target)
+{
+    if (!target.framebuffer)
+        return;
+
+    idle_.push_front(target);
+    evict();
+}
+
+void render_target_pool::evict()
+{
+    while (allocated_ > budget_ && !idle_.empty())
+    {
+        allocated_ -= render_target_bytes(idle_.back());
+        destroy_render_target(idle_.back());
+        idle_.pop_back();
+    }
+}
+
+void clear_render_target(render_target const & target)
+{
+    // only the used corner of pooled storage needs clearing
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(0, 0, target.width, target.height);
+
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // glClear is undefined for integer targets, and labels need their own background values
+    static GLfloat const zero[4] = {0.f, 0.f, 0.f, 0.f};
+    static GLuint const no_bone[4] = {255, 0, 0, 0};
+
+    if (target.aux[aux_depth])
+        glClearBufferfv(GL_COLOR, 1 + aux_depth, zero);
+    if (target.aux[aux_normals])
+        glClearBufferfv(GL_COLOR, 1 + aux_normals, zero);
+    if (target.aux[aux_bones])
+        glClearBufferuiv(GL_COLOR, 1 + aux_bones, no_bone);
+
+    glDisable(GL_SCISSOR_TEST);
+}
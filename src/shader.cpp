@@ -22,11 +22,24 @@ GLuint create_shader(GLenum type, const char * source)
     return result;
 }
 
-GLuint create_program(GLuint vertex_shader, GLuint fragment_shader)
+GLuint create_shader(GLenum type, const char * source, std::string_view defines)
+{
+    std::string_view text = source;
+    auto version_end = text.find('\n') + 1;
+
+    std::string patched;
+    patched.reserve(text.size() + defines.size() + 1);
+    patched.append(text.substr(0, version_end));
+    patched.append(defines);
+    if (!defines.empty() && defines.back() != '\n')
+        patched.push_back('\n');
+    patched.append(text.substr(version_end));
+
+    return create_shader(type, patched.c_str());
+}
+
+static GLuint link_program(GLuint result)
 {
-    GLuint result = glCreateProgram();
-    glAttachShader(result, vertex_shader);
-    glAttachShader(result, fragment_shader);
     glLinkProgram(result);
 
     GLint status;
@@ -42,3 +55,20 @@ GLuint create_program(GLuint vertex_shader, GLuint fragment_shader)
 
     return result;
 }
+
+GLuint create_program(GLuint vertex_shader, GLuint fragment_shader)
+{
+    GLuint result = glCreateProgram();
+    glAttachShader(result, vertex_shader);
+    glAttachShader(result, fragment_shader);
+    return link_program(result);
+}
+
+GLuint create_program(GLuint vertex_shader, GLuint geometry_shader, GLuint fragment_shader)
+{
+    GLuint result = glCreateProgram();
+    glAttachShader(result, vertex_shader);
+    glAttachShader(result, geometry_shader);
+    glAttachShader(result, fragment_shader);
+    return link_program(result);
+}
@@ -0,0 +1,100 @@
+#include "skeleton.h"
+
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/quaternion.hpp>
+
+bone_pose operator * (bone_pose const & p1, bone_pose const & p2)
+{
+    return {p1.rotation * p2.rotation, p1.scale * p2.scale, p1.scale * glm::rotate(p1.rotation, p2.translation) + p1.translation};
+}
+
+glm::vec3 operator * (bone_pose const & p, glm::vec3 const & v)
+{
+    return p.scale * glm::rotate(p.rotation, v) + p.translation;
+}
+
+bone_pose blend_poses(bone_pose const & p0, bone_pose const & p1, float s)
+{
+    bone_pose res;
+    res.rotation = glm::slerp(p0.rotation, p1.rotation, s);
+    res.translation = glm::mix(p0.translation, p1.translation, s);
+    res.scale = glm::mix(p0.scale, p1.scale, s);
+    return res;
+}
+
+bone_pose pose_child(bone_pose const & parent, bone_pose const & from, bone_pose const & to, float s)
+{
+    bone_pose p0 = parent * from;
+    if (from == to)
+        return p0;
+    return blend_poses(p0, parent * to, s);
+}
+
+bone_order sort_bones_breadth_first(std::vector<bone> const & bones)
+{
+    std::size_t count = bones.size();
+
+    // children of each bone in id order: [first[b], first[b + 1])
+    std::vector<std::uint32_t> first(count + 1, 0);
+    for (std::size_t b = 0; b < count; ++b)
+    {
+        std::int32_t parent = bones[b].parent_id;
+        if (parent < -1 || parent >= std::int32_t(count))
+            throw std::runtime_error("Bone " + std::to_string(b) + " has an invalid parent " + std::to_string(parent));
+        if (parent >= 0)
+            ++first[parent + 1];
+    }
+    std::partial_sum(first.begin(), first.end(), first.begin());
+
+    std::vector<std::uint32_t> children(first.back());
+    std::vector<std::uint32_t> filled(count, 0);
+    for (std::size_t b = 0; b < count; ++b)
+        if (bones[b].parent_id >= 0)
+            children[first[bones[b].parent_id] + filled[bones[b].parent_id]++] = std::uint32_t(b);
+
+    bone_order order;
+    order.level_starts.push_back(0);
+    for (std::size_t b = 0; b < count; ++b)
+        if (bones[b].parent_id == -1)
+            order.source_ids.push_back(std::uint32_t(b));
+
+    // each level is the children of the one before
+    std::size_t begin = 0;
+    while (begin < order.source_ids.size())
+    {
+        std::size_t end = order.source_ids.size();
+        order.level_starts.push_back(std::uint32_t(end));
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            std::uint32_t b = order.source_ids[i];
+            order.source_ids.insert(order.source_ids.end(), children.begin() + first[b], children.begin() + first[b + 1]);
+        }
+        begin = end;
+    }
+
+    // bones on a cycle never hang below a root
+    if (order.source_ids.size() != count)
+        throw std::runtime_error("The skeleton's parents form a cycle");
+
+    return order;
+}
+
+std::vector<bone> reorder_bones(std::vector<bone> const & bones, bone_order const & order)
+{
+    std::vector<std::int32_t> new_ids(bones.size());
+    for (std::size_t i = 0; i < order.source_ids.size(); ++i)
+        new_ids[order.source_ids[i]] = std::int32_t(i);
+
+    std::vector<bone> reordered(bones.size());
+    for (std::size_t i = 0; i < order.source_ids.size(); ++i)
+    {
+        reordered[i] = bones[order.source_ids[i]];
+        if (reordered[i].parent_id >= 0)
+            reordered[i].parent_id = new_ids[reordered[i].parent_id];
+    }
+    return reordered;
+}
@@ -4,8 +4,19 @@
 
 #include "utils.h"
 
+#include <cstring>
+#include <fstream>
+
+#include "frame_memory.h"
+#include "memory_stats.h"
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+// the PNG encoder's scratch memory comes from the thread arena and is dropped
+// with the arena_scope around every call
+#define STBIW_MALLOC(size) thread_arena().allocate(size)
+#define STBIW_REALLOC_SIZED(data, old_size, new_size) thread_arena().reallocate(data, old_size, new_size)
+#define STBIW_FREE(data) ((void) (data))
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 
@@ -20,15 +31,76 @@ void save_texture(GLuint target, const char * const filename) {
     glGetTexLevelParameteriv(target, 0, GL_TEXTURE_WIDTH, &width);
     glGetTexLevelParameteriv(target, 0, GL_TEXTURE_HEIGHT, &height);
 
-    auto *img = new std::vector<char>(width * height*4);
+    auto img = pixel_buffers().acquire(width * height*4);
 
-    glGetTexImage(target, 0, GL_RGBA, GL_UNSIGNED_BYTE, img->data());
+    glGetTexImage(target, 0, GL_RGBA, GL_UNSIGNED_BYTE, img.data());
 
     stbi_flip_vertically_on_write(true);
 
-    stbi_write_png(filename, width, height, 4, img->data(), width*4);
+    {
+        arena_scope scope;
+        stbi_write_png(filename, width, height, 4, img.data(), width*4);
+    }
+
+    // captures encode on several threads and rely on the global flag staying off
+    stbi_flip_vertically_on_write(false);
 
     std::cout << "Texture wrote " << filename << '\n';
 
-    delete img;
-}
\ No newline at end of file
+    pixel_buffers().release(std::move(img));
+}
+
+// stb hands over the whole file at once, it goes into a pooled buffer of exactly that size
+static void append_png(void * context, void * data, int size)
+{
+    auto & buffer = *static_cast<std::vector<char> *>(context);
+    std::size_t offset = buffer.size();
+    if (offset == 0)
+        buffer = pixel_buffers().acquire(size);
+    else {
+        memory_scope scope(memory_category::pixel_buffers);
+        buffer.resize(offset + size);
+    }
+    std::memcpy(buffer.data() + offset, data, size);
+}
+
+int capture_channels(frame_format format) {
+    return format == frame_format::png ? 4 : frame_format_channels(format);
+}
+
+std::vector<char> encode_png(int width, int height, int channels, std::vector<char> const & pixels) {
+
+    std::vector<char> png;
+    arena_scope scope;
+    stbi_write_png_to_func(append_png, &png, width, height, channels, pixels.data(), width * channels);
+    return png;
+}
+
+void save_encoded(const char * const filename, std::vector<char> const & png) {
+
+    std::ofstream(filename, std::ios::binary).write(png.data(), png.size());
+
+    std::cout << "Texture wrote " << filename << '\n';
+}
+
+void save_image(const char * const filename, int width, int height, int channels, std::vector<char> const & pixels) {
+
+    arena_scope scope;
+    stbi_write_png(filename, width, height, channels, pixels.data(), width * channels);
+
+    std::cout << "Texture wrote " << filename << '\n';
+}
+
+void append_image(shard_writer & shard, std::uint64_t frame_id, int width, int height, frame_format format,
+                  std::vector<char> const & pixels, int crop_x, int crop_y) {
+
+    if (format == frame_format::png) {
+        auto png = encode_png(width, height, 4, pixels);
+        shard.append(frame_id, width, height, format, png.data(), png.size(), crop_x, crop_y);
+        pixel_buffers().release(std::move(png));
+        return;
+    }
+
+    // raw frames are already top-down in the shard's layout
+    shard.append(frame_id, width, height, format, pixels.data(), pixels.size(), crop_x, crop_y);
+}
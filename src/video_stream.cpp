@@ -0,0 +1,350 @@
+#include "video_stream.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "frame_memory.h"
+#include "memory_stats.h"
+#include "pixel_convert.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+std::uint8_t luma(int r, int g, int b)
+{
+    return std::uint8_t(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+// r, g, b are sums over a 2x2 block
+std::uint8_t chroma_u(int r, int g, int b)
+{
+    return std::uint8_t(((-38 * r - 74 * g + 112 * b + 512) >> 10) + 128);
+}
+
+std::uint8_t chroma_v(int r, int g, int b)
+{
+    return std::uint8_t(((112 * r - 94 * g - 18 * b + 512) >> 10) + 128);
+}
+
+// Converts columns [x0, width) of a row pair; row1 is ignored for the last odd row
+void convert_pair_scalar(std::uint8_t const * row0, std::uint8_t const * row1, int x0, int width, bool has_row1,
+                         std::uint8_t * y0, std::uint8_t * y1, std::uint8_t * u, std::uint8_t * v)
+{
+    for (int x = x0; x < width; x += 2)
+    {
+        int r = 0, g = 0, b = 0, count = 0;
+        for (int dx = 0; dx < 2 && x + dx < width; ++dx)
+        {
+            auto p0 = row0 + 4 * (x + dx);
+            y0[x + dx] = luma(p0[0], p0[1], p0[2]);
+            r += p0[0]; g += p0[1]; b += p0[2]; ++count;
+
+            if (has_row1)
+            {
+                auto p1 = row1 + 4 * (x + dx);
+                y1[x + dx] = luma(p1[0], p1[1], p1[2]);
+                r += p1[0]; g += p1[1]; b += p1[2]; ++count;
+            }
+        }
+
+        // replicate edge samples so the average always covers four pixels
+        int scale = 4 / count;
+        u[x / 2] = chroma_u(r * scale, g * scale, b * scale);
+        v[x / 2] = chroma_v(r * scale, g * scale, b * scale);
+    }
+}
+
+#ifdef __SSE2__
+
+// Horizontal sum of adjacent 32-bit lanes of two madd results: [a0 b0 a1 b1], [a2 b2 a3 b3] -> [a0+b0 .. a3+b3]
+__m128i pair_sum(__m128i lo, __m128i hi)
+{
+    __m128 l = _mm_castsi128_ps(lo), h = _mm_castsi128_ps(hi);
+    __m128i even = _mm_castps_si128(_mm_shuffle_ps(l, h, _MM_SHUFFLE(2, 0, 2, 0)));
+    __m128i odd = _mm_castps_si128(_mm_shuffle_ps(l, h, _MM_SHUFFLE(3, 1, 3, 1)));
+    return _mm_add_epi32(even, odd);
+}
+
+// Luma of 8 RGBA pixels, returned in the low 8 bytes
+__m128i luma8(__m128i p0, __m128i p1, __m128i coeff, __m128i bias)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i y0 = pair_sum(_mm_madd_epi16(_mm_unpacklo_epi8(p0, zero), coeff), _mm_madd_epi16(_mm_unpackhi_epi8(p0, zero), coeff));
+    __m128i y1 = pair_sum(_mm_madd_epi16(_mm_unpacklo_epi8(p1, zero), coeff), _mm_madd_epi16(_mm_unpackhi_epi8(p1, zero), coeff));
+    y0 = _mm_srai_epi32(_mm_add_epi32(y0, bias), 8);
+    y1 = _mm_srai_epi32(_mm_add_epi32(y1, bias), 8);
+    __m128i y = _mm_add_epi16(_mm_packs_epi32(y0, y1), _mm_set1_epi16(16));
+    return _mm_packus_epi16(y, y);
+}
+
+// Sums each horizontal pixel pair of 4 RGBA pixels (both rows already added): [px0+px1, px2+px3] as 16-bit lanes
+__m128i pair_pixels(__m128i lo, __m128i hi)
+{
+    __m128i a = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+    __m128i b = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+    return _mm_unpacklo_epi64(a, b);
+}
+
+// Processes 8 columns of a row pair: 16 luma and 4 + 4 chroma samples
+void convert_pair_sse2(std::uint8_t const * row0, std::uint8_t const * row1,
+                       std::uint8_t * y0, std::uint8_t * y1, std::uint8_t * u, std::uint8_t * v)
+{
+    __m128i const y_coeff = _mm_setr_epi16(66, 129, 25, 0, 66, 129, 25, 0);
+    __m128i const u_coeff = _mm_setr_epi16(-38, -74, 112, 0, -38, -74, 112, 0);
+    __m128i const v_coeff = _mm_setr_epi16(112, -94, -18, 0, 112, -94, -18, 0);
+    __m128i const y_bias = _mm_set1_epi32(128);
+    __m128i const c_bias = _mm_set1_epi32(512);
+    __m128i const zero = _mm_setzero_si128();
+
+    __m128i a0 = _mm_loadu_si128(reinterpret_cast<__m128i const *>(row0));
+    __m128i a1 = _mm_loadu_si128(reinterpret_cast<__m128i const *>(row0 + 16));
+    __m128i b0 = _mm_loadu_si128(reinterpret_cast<__m128i const *>(row1));
+    __m128i b1 = _mm_loadu_si128(reinterpret_cast<__m128i const *>(row1 + 16));
+
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(y0), luma8(a0, a1, y_coeff, y_bias));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(y1), luma8(b0, b1, y_coeff, y_bias));
+
+    // 2x2 block sums of R, G, B, at most 4 * 255, fit the signed 16-bit madd inputs
+    __m128i q0 = pair_pixels(_mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero)),
+                             _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero)));
+    __m128i q1 = pair_pixels(_mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero)),
+                             _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero)));
+
+    __m128i cu = _mm_srai_epi32(_mm_add_epi32(pair_sum(_mm_madd_epi16(q0, u_coeff), _mm_madd_epi16(q1, u_coeff)), c_bias), 10);
+    __m128i cv = _mm_srai_epi32(_mm_add_epi32(pair_sum(_mm_madd_epi16(q0, v_coeff), _mm_madd_epi16(q1, v_coeff)), c_bias), 10);
+    __m128i c = _mm_add_epi16(_mm_packs_epi32(cu, cv), _mm_set1_epi16(128));
+    c = _mm_packus_epi16(c, c);
+
+    std::uint32_t uv[2];
+    std::memcpy(uv, &c, sizeof(uv));
+    std::memcpy(u, &uv[0], 4);
+    std::memcpy(v, &uv[1], 4);
+}
+
+#endif
+
+}
+
+void rgba_to_i420(std::uint8_t const * rgba, std::ptrdiff_t stride, int width, int height,
+                  std::uint8_t * y_plane, std::uint8_t * u_plane, std::uint8_t * v_plane)
+{
+    int chroma_width = (width + 1) / 2;
+
+    for (int y = 0; y < height; y += 2)
+    {
+        bool has_row1 = y + 1 < height;
+        auto row0 = rgba + y * stride;
+        auto row1 = has_row1 ? row0 + stride : row0;
+        auto y0 = y_plane + std::ptrdiff_t(y) * width;
+        auto y1 = has_row1 ? y0 + width : y0;
+        auto u = u_plane + std::ptrdiff_t(y / 2) * chroma_width;
+        auto v = v_plane + std::ptrdiff_t(y / 2) * chroma_width;
+
+        int x = 0;
+#ifdef __SSE2__
+        if (has_row1)
+            for (; x + 8 <= width; x += 8)
+                convert_pair_sse2(row0 + 4 * x, row1 + 4 * x, y0 + x, y1 + x, u + x / 2, v + x / 2);
+#endif
+        convert_pair_scalar(row0, row1, x, width, has_row1, y0, y1, u, v);
+    }
+}
+
+video_stream::video_stream(std::string const & path, stream_format format, int width, int height, float fps,
+                           bool bgra, std::size_t queue_depth)
+    : format_(format)
+    , bgra_(bgra)
+    , width_(width)
+    , height_(height)
+    , queue_depth_(queue_depth)
+{
+    {
+        memory_scope scope(memory_category::queues);
+        queue_.reserve(queue_depth);
+    }
+
+    if (path == "-")
+    {
+        fd_ = STDOUT_FILENO;
+        owns_fd_ = false;
+    }
+    else
+    {
+        // opening a named pipe blocks until the encoder opens its end
+        fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd_ < 0)
+            throw std::runtime_error("Cannot open video stream " + path + ": " + std::strerror(errno));
+        owns_fd_ = true;
+    }
+
+    // a closed pipe should end the stream with an error, not kill the renderer
+    std::signal(SIGPIPE, SIG_IGN);
+
+    // the destructor does not run for a constructor that throws, so the file is closed here
+    try
+    {
+        if (format_ == stream_format::y4m)
+        {
+            // fps is given as a rational with millisecond precision
+            std::string header = "YUV4MPEG2 W" + std::to_string(width_) + " H" + std::to_string(height_)
+                + " F" + std::to_string(int(fps * 1000.f + 0.5f)) + ":1000 Ip A1:1 C420jpeg\n";
+            write_all(header.data(), header.size());
+        }
+
+        thread_ = std::thread(&video_stream::worker, this);
+    }
+    catch (...)
+    {
+        if (owns_fd_)
+            ::close(fd_);
+        throw;
+    }
+}
+
+video_stream::~video_stream()
+{
+    try
+    {
+        close();
+    }
+    catch (std::exception const & e)
+    {
+        std::cerr << e.what() << std::endl;
+    }
+}
+
+void video_stream::push(int width, int height, std::vector<char> pixels)
+{
+    if (width != width_ || height != height_)
+    {
+        if (!warned_size_)
+            std::cerr << "Video stream is " << width_ << 'x' << height_ << ", dropping " << width << 'x' << height << " frames\n";
+        warned_size_ = true;
+        pixel_buffers().release(std::move(pixels));
+        return;
+    }
+
+    std::unique_lock lock(mutex_);
+    drained_.wait(lock, [&]{ return queue_.size() < queue_depth_ || error_; });
+    if (error_)
+        std::rethrow_exception(error_);
+
+    queue_.push_back(std::move(pixels));
+    lock.unlock();
+    queued_.notify_one();
+}
+
+void video_stream::close()
+{
+    if (!thread_.joinable())
+        return;
+
+    {
+        std::lock_guard lock(mutex_);
+        closing_ = true;
+    }
+    queued_.notify_one();
+    thread_.join();
+
+    if (owns_fd_)
+        ::close(fd_);
+
+    if (error_)
+        std::rethrow_exception(error_);
+}
+
+void video_stream::worker()
+{
+    while (true)
+    {
+        std::vector<char> frame;
+        {
+            std::unique_lock lock(mutex_);
+            queued_.wait(lock, [&]{ return !queue_.empty() || closing_; });
+            if (queue_.empty())
+                return;
+            frame = std::move(queue_.front());
+            queue_.erase(queue_.begin());
+        }
+        drained_.notify_one();
+
+        try
+        {
+            write_frame(frame);
+            pixel_buffers().release(std::move(frame));
+        }
+        catch (...)
+        {
+            {
+                std::lock_guard lock(mutex_);
+                error_ = std::current_exception();
+                queue_.clear();
+            }
+            drained_.notify_all();
+            return;
+        }
+    }
+}
+
+void video_stream::write_frame(std::vector<char> const & pixels)
+{
+    std::ptrdiff_t stride = std::ptrdiff_t(width_) * 4;
+    auto last_row = pixels.data() + (height_ - 1) * stride;
+
+    if (format_ == stream_format::rgb)
+    {
+        converted_.resize(std::size_t(width_) * height_ * 3);
+        convert_pixels(last_row, -stride, width_, height_, bgra_, 3, reinterpret_cast<char *>(converted_.data()));
+        write_all(converted_.data(), converted_.size());
+        return;
+    }
+
+    // the I420 kernel takes RGBA, BGRA frames are swizzled (and flipped) first
+    auto rgba = reinterpret_cast<std::uint8_t const *>(last_row);
+    std::ptrdiff_t rgba_stride = -stride;
+    if (bgra_)
+    {
+        rgba_.resize(pixels.size());
+        convert_pixels(last_row, -stride, width_, height_, true, 4, rgba_.data());
+        rgba = reinterpret_cast<std::uint8_t const *>(rgba_.data());
+        rgba_stride = stride;
+    }
+
+    std::size_t luma_size = std::size_t(width_) * height_;
+    std::size_t chroma_size = std::size_t((width_ + 1) / 2) * ((height_ + 1) / 2);
+    converted_.resize(luma_size + 2 * chroma_size);
+
+    auto y_plane = converted_.data();
+    rgba_to_i420(rgba, rgba_stride, width_, height_, y_plane, y_plane + luma_size, y_plane + luma_size + chroma_size);
+
+    static char const frame_header[] = "FRAME\n";
+    write_all(frame_header, sizeof(frame_header) - 1);
+    write_all(converted_.data(), converted_.size());
+}
+
+void video_stream::write_all(void const * data, std::size_t size)
+{
+    auto bytes = static_cast<char const *>(data);
+    while (size > 0)
+    {
+        ssize_t written = ::write(fd_, bytes, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error(std::string("Video stream write failed: ") + std::strerror(errno));
+        }
+        bytes += written;
+        size -= written;
+    }
+}
@@ -0,0 +1,121 @@
+// GPU-free checks of asset loading. Each check writes a small asset directory
+// under the system temp directory, loads it and compares what comes back.
+//
+//     mixamo_tests
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "assets.h"
+#include "mesh.h"
+
+namespace
+{
+
+int failures = 0;
+
+void check(bool condition, std::string const & what)
+{
+    if (!condition)
+    {
+        std::cerr << "FAILED: " << what << '\n';
+        ++failures;
+    }
+}
+
+void write_file(std::filesystem::path const & path, void const * data, std::size_t size)
+{
+    std::ofstream file(path, std::ios::binary);
+    file.write(static_cast<char const *>(data), std::streamsize(size));
+    if (!file)
+        throw std::runtime_error("Cannot write " + path.string());
+}
+
+// 300 bones whose breadth-first order moves bone 0, an 8-bit id in the mesh
+// file, to id 299: bone 299 is the root, bones 1 to 298 its children and
+// bone 0 the child of bone 1
+void renumbered_ids_widen_the_layout(std::filesystem::path const & directory)
+{
+    constexpr std::uint32_t bone_count = 300;
+    std::vector<bone> bones(bone_count, bone{0, glm::vec3(0.f), glm::quat(1.f, 0.f, 0.f, 0.f)});
+    bones[0].parent_id = 1;
+    for (std::uint32_t b = 1; b + 1 < bone_count; ++b)
+        bones[b].parent_id = std::int32_t(bone_count - 1);
+    bones[bone_count - 1].parent_id = -1;
+
+    std::vector<char> bones_file(sizeof(bone_count) + bones.size() * sizeof(bone));
+    std::memcpy(bones_file.data(), &bone_count, sizeof(bone_count));
+    std::memcpy(bones_file.data() + sizeof(bone_count), bones.data(), bones.size() * sizeof(bone));
+    write_file(directory / "bones.bin", bones_file.data(), bones_file.size());
+
+    std::vector<bone_pose> pose(bone_count);
+    for (int i = 0; i < character_pose_count; ++i)
+        write_file(directory / ("pose_" + std::to_string(i) + ".bin"), pose.data(), pose.size() * sizeof(bone_pose));
+
+    // one triangle, its first corner on bone 0 and the others on bone 1
+    mesh_data mesh;
+    mesh.vertices.resize(3);
+    for (std::size_t i = 0; i < 3; ++i)
+    {
+        vertex & v = mesh.vertices[i];
+        v = {};
+        v.position = glm::vec3(float(i == 1), float(i == 2), 0.f);
+        v.normal = glm::vec3(0.f, 0.f, 1.f);
+        v.bone_ids[0] = i == 0 ? 0 : 1;
+        v.bone_weights[0] = 255;
+    }
+    mesh.indices = {0, 1, 2};
+    mesh.lods.push_back({0, 3, 0.f});
+    mesh.bounds = compute_bounds(mesh.vertices);
+    for (vertex_format format : {vertex_format::full, vertex_format::compact})
+    {
+        mesh.layout = fit_vertex_layout(format, mesh.vertices);
+        check(mesh.layout.bone_id_size == 1, "the mesh file starts with 8-bit bone ids");
+        mesh.packed_vertices = pack_vertices(mesh.vertices, mesh.layout, mesh.bounds);
+        std::string mesh_path = (directory / "renumbered.mesh").string();
+        save_mesh_file(mesh_path, mesh);
+
+        character_assets character = load_character(directory.string(), mesh_path);
+        std::string name = vertex_format_name(format);
+        mesh_data const & loaded = character.mesh;
+        check(character.source_bone_ids[299] == 0, name + ": bone 0 sorts last");
+        check(loaded.layout.bone_id_size == 2, name + ": bone id 299 widens the layout to 16 bits");
+        check(loaded.packed_vertices.size() == loaded.vertices.size() * loaded.layout.stride(),
+              name + ": the vertices are packed in the widened layout");
+        check(loaded.vertices[0].bone_ids[0] == 299 && loaded.vertices[1].bone_ids[0] == 1,
+              name + ": the decoded vertices carry the new ids");
+
+        auto unpacked = unpack_vertices(loaded.packed_vertices.data(), loaded.vertices.size(), loaded.layout, loaded.bounds);
+        check(unpacked[0].bone_ids[0] == 299 && unpacked[1].bone_ids[0] == 1 && unpacked[2].bone_ids[0] == 1,
+              name + ": the packed vertices carry the new ids");
+        check(character.palette_size == bone_count, name + ": the palette holds every bone");
+    }
+}
+
+}
+
+int main() try
+{
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "mixamo_tests";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+
+    renumbered_ids_widen_the_layout(directory);
+
+    std::filesystem::remove_all(directory);
+    if (failures > 0)
+        return EXIT_FAILURE;
+    std::cout << "All checks passed\n";
+    return EXIT_SUCCESS;
+}
+catch (std::exception const & e)
+{
+    std::cerr << e.what() << '\n';
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,166 @@
+// Converts the character mesh (human.bin, or a mesh file) into a mesh file
+// the renderer loads with --mesh, and reports what the conversion cost. The
+// full-detail triangles are reordered for the post-transform cache and the
+// vertices for fetch locality, unless --no-optimize is given; --lods adds
+// simplified levels of detail (4 levels by default, 1 for none). Every level
+// is split into meshlets the renderer culls one by one, ordered for overdraw.
+//
+//     mixamo_mesh_convert INPUT OUTPUT [--format full|compact] [--lods N] [--no-optimize]
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <glm/geometric.hpp>
+
+#include "assets.h"
+#include "mesh.h"
+#include "mesh_cluster.h"
+#include "mesh_optimize.h"
+#include "mesh_simplify.h"
+
+namespace
+{
+
+vertex_format parse_vertex_format(std::string_view value)
+{
+    if (value == "full")
+        return vertex_format::full;
+    if (value == "compact")
+        return vertex_format::compact;
+    throw std::runtime_error("Unknown vertex format: " + std::string(value));
+}
+
+// Largest position error relative to the bounds and largest normal error in degrees
+void print_quantization_error(std::vector<vertex> const & original, std::vector<vertex> const & decoded, mesh_bounds const & bounds)
+{
+    float position_error = 0.f;
+    float normal_error = 0.f;
+    for (std::size_t i = 0; i < original.size(); ++i)
+    {
+        position_error = std::max(position_error, glm::distance(original[i].position, decoded[i].position));
+        if (glm::length(original[i].normal) > 0.f)
+        {
+            float cosine = glm::dot(glm::normalize(original[i].normal), decoded[i].normal);
+            normal_error = std::max(normal_error, std::acos(std::clamp(cosine, -1.f, 1.f)));
+        }
+    }
+
+    std::cout << "Largest position error " << position_error << " (" << position_error / glm::length(bounds.extent()) * 100.f
+              << "% of the bounds diagonal), largest normal error " << normal_error * 180.f / 3.14159265f << " degrees\n";
+}
+
+}
+
+int main(int argc, char ** argv) try
+{
+    char const usage[] = "Usage: mixamo_mesh_convert INPUT OUTPUT [--format full|compact] [--lods N] [--no-optimize]\n";
+    std::vector<std::string> paths;
+    vertex_format format = vertex_format::compact;
+    bool optimize = true;
+    int lods = 4;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string_view option = argv[i];
+        if (option == "--format" && i + 1 < argc)
+            format = parse_vertex_format(argv[++i]);
+        else if (option == "--lods" && i + 1 < argc)
+            lods = std::max(1, std::atoi(argv[++i]));
+        else if (option == "--no-optimize")
+            optimize = false;
+        else if (!option.starts_with("--"))
+            paths.emplace_back(option);
+        else
+        {
+            std::cerr << usage;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (paths.size() != 2)
+    {
+        std::cerr << usage;
+        return EXIT_FAILURE;
+    }
+    std::string const & input = paths[0];
+    std::string const & output = paths[1];
+
+    mesh_data mesh = load_mesh_file(input);
+    std::size_t input_bytes = mesh.vertex_bytes() + mesh.index_bytes();
+
+    // start over from full detail
+    mesh_lod full = mesh.lods.front();
+    mesh.indices = std::vector<std::uint32_t>(mesh.indices.begin() + full.first_index,
+                                              mesh.indices.begin() + full.first_index + full.index_count);
+    mesh.lods.assign(1, {0, full.index_count, 0.f});
+
+    // build_meshlets reorders the triangles again, and puts its meshlets in overdraw order
+    vertex_cache_stats before = analyze_vertex_cache(mesh.indices, mesh.vertices.size());
+    if (optimize)
+        mesh.indices = optimize_vertex_cache(mesh.indices, mesh.vertices.size());
+
+    build_lods(mesh, lods);
+    float diagonal = glm::length(compute_bounds(mesh.vertices).extent());
+    for (std::size_t i = 0; i < mesh.lods.size(); ++i)
+        std::cout << "Level " << i << ": " << mesh.lods[i].index_count / 3 << " triangles, error " << mesh.lods[i].error
+                  << " (" << mesh.lods[i].error / diagonal * 100.f << "% of the bounds diagonal)\n";
+
+    build_meshlets(mesh);
+    for (std::size_t i = 0; i < mesh.lods.size(); ++i)
+    {
+        std::size_t count = 0;
+        std::size_t cullable = 0;
+        for (auto const & m : mesh.meshlets)
+            if (m.first_index >= mesh.lods[i].first_index && m.first_index < mesh.lods[i].first_index + mesh.lods[i].index_count)
+            {
+                ++count;
+                cullable += m.cone_cosine > 0.f && m.bone_count <= 1;
+            }
+        std::cout << "Level " << i << ": " << count << " meshlets, " << float(mesh.lods[i].index_count / 3) / float(count)
+                  << " triangles each on average, " << cullable << " on one bone with a normal cone narrow enough to backface-cull\n";
+    }
+
+    // on the full-detail level as it is written
+    vertex_cache_stats after = analyze_vertex_cache(
+        std::vector<std::uint32_t>(mesh.indices.begin(), mesh.indices.begin() + mesh.lods.front().index_count), mesh.vertices.size());
+    std::cout << "Vertex cache (16-entry FIFO): ACMR " << before.acmr << " -> " << after.acmr
+              << ", ATVR " << before.atvr << " -> " << after.atvr << '\n';
+
+    // after the levels and meshlets exist, so that their vertices are reordered too
+    if (optimize)
+        optimize_vertex_fetch(mesh.vertices, mesh.indices);
+
+    // a compact input is requantized from its decoded vertices; the layout keeps as many
+    // influences and as wide bone ids as the vertices need
+    mesh.bounds = compute_bounds(mesh.vertices);
+    mesh.layout = fit_vertex_layout(format, mesh.vertices);
+    mesh.packed_vertices = pack_vertices(mesh.vertices, mesh.layout, mesh.bounds);
+    if (format == vertex_format::compact)
+    {
+        std::vector<vertex> decoded = unpack_vertices(mesh.packed_vertices.data(), mesh.vertices.size(), mesh.layout, mesh.bounds);
+        print_quantization_error(mesh.vertices, decoded, mesh.bounds);
+
+        // the meshlets bound what the GPU draws
+        mesh.vertices = std::move(decoded);
+        compute_meshlet_bounds(mesh);
+    }
+
+    save_mesh_file(output, mesh);
+
+    std::cout << mesh.vertices.size() << " vertices, " << mesh.indices.size() << " indices in all levels: "
+              << input_bytes << " -> " << mesh.vertex_bytes() + mesh.index_bytes() << " bytes of geometry ("
+              << vertex_format_name(format) << " vertices with " << mesh.layout.influences << " "
+              << 8 * mesh.layout.bone_id_size << "-bit bone ids, " << 8 * mesh.index_size() << "-bit indices)\n";
+}
+catch (std::exception const & e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}